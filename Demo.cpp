@@ -1,20 +1,36 @@
 ﻿// MiniGridMonitor - device condition capture UI
 #include <wx/wx.h>
+#include <wx/busyinfo.h>
 #include <wx/listctrl.h>
 #include <chrono>
 #include <random>
 #include <future>
 #include <sstream>
 #include <iomanip>
+#include <limits>
 #include <fstream>
 #include <filesystem>
 #include <vector>
 #include <regex>
 #include <cmath>
 #include <map>
+#include <memory>
 #include <string>
 #include <algorithm>
 
+#include "amendments.h"
+#include "device_master.h"
+#include "device_topology.h"
+#include "executor.h"
+#include "failure_correlation.h"
+#include "fleet_sketches.h"
+#include "ingest.h"
+#include "latency_sketch.h"
+#include "metrics_schema.h"
+#include "storage_backend.h"
+#include "trend_model.h"
+#include "waveform.h"
+
 // Debug logging function
 static void log_debug(const std::string& msg) {
     std::ofstream log("debug.log", std::ios::app);
@@ -165,73 +181,6 @@ static std::string json_escape(const std::string& s)
     return o.str();
 }
 
-static std::string csv_escape(const std::string& s)
-{
-    bool needQuotes = false;
-    for (unsigned char c : s)
-    {
-        if (c == '"' || c == ',' || c == '\n' || c == '\r') { needQuotes = true; break; }
-    }
-    std::string out;
-    if (!needQuotes) return s;
-    out.push_back('"');
-    for (unsigned char c : s)
-    {
-        if (c == '"') out.append("""");
-        else out.push_back(c);
-    }
-    out.push_back('"');
-    return out;
-}
-
-static std::vector<std::string> parse_csv_line(const std::string& line)
-{
-    std::vector<std::string> cols;
-    std::string cur;
-    bool inQuotes = false;
-    for (size_t i = 0; i < line.size(); ++i)
-    {
-        char c = line[i];
-        if (inQuotes)
-        {
-            if (c == '"')
-            {
-                if (i + 1 < line.size() && line[i + 1] == '"')
-                {
-                    cur.push_back('"');
-                    ++i;
-                }
-                else
-                {
-                    inQuotes = false;
-                }
-            }
-            else
-            {
-                cur.push_back(c);
-            }
-        }
-        else
-        {
-            if (c == '"')
-            {
-                inQuotes = true;
-            }
-            else if (c == ',')
-            {
-                cols.push_back(cur);
-                cur.clear();
-            }
-            else
-            {
-                cur.push_back(c);
-            }
-        }
-    }
-    cols.push_back(cur);
-    return cols;
-}
-
 static std::string get_appdata_devices_path()
 {
     // Use fixed project folder per user request
@@ -241,28 +190,74 @@ static std::string get_appdata_devices_path()
     fs::create_directories(dir, ec);
     return (dir / "devices.csv").string();
 }
-// Save CSV row into `path`. Creates file with header if missing. Appends rows.
-static void save_device_csv(const std::string& path, const std::string& csv_row)
+
+// substation/feeder/device hierarchy, see device_topology.h
+static std::string get_appdata_topology_path()
 {
     namespace fs = std::filesystem;
-    std::error_code ec;
-    bool exists = fs::exists(path, ec);
-    // Ensure directory exists (should be already)
-    fs::path p(path);
-    fs::path dir = p.parent_path();
-    if (!dir.empty()) fs::create_directories(dir, ec);
+    return (fs::path(get_appdata_devices_path()).parent_path() / "topology.csv").string();
+}
+
+// user-defined metric declarations, see metrics_schema.h
+static std::string get_appdata_metrics_schema_path()
+{
+    namespace fs = std::filesystem;
+    return (fs::path(get_appdata_devices_path()).parent_path() / "metrics_schema.csv").string();
+}
+
+// side heap for waveform captures, see waveform.h
+static std::string get_appdata_waveform_path()
+{
+    namespace fs = std::filesystem;
+    return (fs::path(get_appdata_devices_path()).parent_path() / "waveforms.bin").string();
+}
+
+// rated voltage / thermal limit per device, see device_master.h
+static std::string get_appdata_master_path()
+{
+    namespace fs = std::filesystem;
+    return (fs::path(get_appdata_devices_path()).parent_path() / "device_master.csv").string();
+}
 
-    std::ofstream out(path, std::ios::out | std::ios::app | std::ios::binary);
-    if (!out)
-        throw std::runtime_error("unable to open file for append: " + path);
+// storage backend name ("csv", "lsm" or "sqlite"), see storage_backend.h
+static std::string get_appdata_storage_config_path()
+{
+    namespace fs = std::filesystem;
+    return (fs::path(get_appdata_devices_path()).parent_path() / "storage.cfg").string();
+}
 
-    if (!exists)
+// Backend named in storage.cfg; CSV when the file is absent or names one
+// this build does not have
+static StorageBackend configured_storage_backend()
+{
+    StorageBackend backend = StorageBackend::Csv;
+    std::ifstream in(get_appdata_storage_config_path());
+    std::string name;
+    if (in >> name && !(parse_storage_backend(name, backend) && storage_backend_available(backend)))
     {
-        // write header
-        out << "uuid,created_at,operator_id,instance_id,app_version,device_id,device_name,status,action_type,voltage,temperature,severity,ui_latency_ms,notes\n";
+        log_debug("Unknown or unavailable storage backend '" + name + "', using csv");
+        backend = StorageBackend::Csv;
+    }
+    return backend;
+}
+
+// Folds accumulated corrections into the history before the frame reopens
+// it for append. Rewriting a long history takes a while, so it runs before
+// any window exists and behind a busy notice.
+static void compact_history()
+{
+    const std::string path = get_appdata_devices_path();
+    const size_t minCorrections = 256;
+    try {
+        AmendmentIndex pending;
+        if (!pending.load(amendment_path(path)) || pending.size() < minCorrections) return;
+        wxBusyInfo busy("Applying " + std::to_string(pending.size()) + " corrections to the device history...");
+        if (compact_segment(path, minCorrections))
+            log_debug("Compacted corrections into " + path);
+    }
+    catch (const std::exception& ex) {
+        log_debug(std::string("Compaction skipped: ") + ex.what());
     }
-    out << csv_row << "\n";
-    out.close();
 }
 
 class MyFrame : public wxFrame
@@ -273,6 +268,79 @@ public:
     {
         try {
             log_debug("MyFrame constructor starting");
+            m_store = open_record_store(configured_storage_backend(), get_appdata_devices_path());
+            m_waveforms = std::make_unique<WaveformHeap>(get_appdata_waveform_path());
+            m_store->sink().setBeforeSync([this]() { m_waveforms->sync(); });
+            m_ingest = std::make_unique<IngestPipeline>(m_store->sink());
+            m_ingest->setAlertHandler([](const DeviceRecord& rec) {
+                if (is_priority_record(rec))
+                    log_debug("ALERT " + rec.deviceId + " status=" + rec.status + " severity=" + rec.severity);
+            });
+            // Optional grid hierarchy kept next to the history file
+            std::error_code topoEc;
+            if (std::filesystem::exists(get_appdata_topology_path(), topoEc))
+            {
+                try {
+                    m_topology.load(get_appdata_topology_path());
+                }
+                catch (const std::exception& ex) {
+                    log_debug(std::string("Topology not loaded: ") + ex.what());
+                }
+            }
+            m_ingest->addCommitListener([this](const std::vector<DeviceRecord>& batch) {
+                m_topology.observe(batch);
+                m_latency.observe(batch);
+                m_fleet.observe(batch);
+                m_trends.observe(batch);
+                m_correlator.observe(batch);
+
+                std::vector<EnrichedReading> enriched;
+                auto masterSnapshot = m_master.enrich(batch, enriched);
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    const EnrichedReading& e = enriched[i];
+                    if (e.thermalPercent >= 100.0 || std::fabs(e.voltageDeviation) > 0.10)
+                        log_debug("OUT OF RATING " + batch[i].deviceId + " voltage " +
+                                  format_number(100.0 * e.voltageDeviation) + "% of rated, temperature " +
+                                  format_number(e.thermalPercent) + "% of thermal limit");
+                }
+            });
+
+            // Ratings for enrichment; reloading swaps the table without pausing ingest
+            m_background.run([this]() {
+                std::error_code ec;
+                if (!std::filesystem::exists(get_appdata_master_path(), ec)) return;
+                try {
+                    m_master.reload(get_appdata_master_path());
+                }
+                catch (const std::exception& ex) {
+                    log_debug(std::string("Device master not loaded: ") + ex.what());
+                }
+            }, TaskPriority::Low);
+
+            // Seed trend models from existing history without holding up the UI;
+            // the history is streamed, never held in memory
+            m_background.run([this]() {
+                try {
+                    auto scanHistory = [this](const std::function<void(DeviceRecord&&)>& fn) { m_store->scan(fn); };
+                    if (m_trends.rebuild(scanHistory, TrendConfig(), m_background.token()))
+                        log_debug("Trend models rebuilt for " + std::to_string(m_trends.deviceCount()) + " devices");
+                }
+                catch (const std::exception& ex) {
+                    log_debug(std::string("Trend models not rebuilt: ") + ex.what());
+                }
+            }, TaskPriority::Low);
+            // Site-specific metrics add form fields below the built-in ones
+            std::error_code schemaEc;
+            if (std::filesystem::exists(get_appdata_metrics_schema_path(), schemaEc))
+            {
+                try {
+                    m_metricsSchema.load(get_appdata_metrics_schema_path());
+                }
+                catch (const std::exception& ex) {
+                    log_debug(std::string("Metrics schema not loaded: ") + ex.what());
+                }
+            }
             SetMinSize(wxSize(800, 600));
             Centre();
         wxPanel* panel = new wxPanel(this);
@@ -407,6 +475,25 @@ public:
         addField("UI Latency (ms):", m_uiLatency, m_uiLatencyError);
         m_uiLatency->SetValue("0");
 
+        // User-defined metrics
+        for (const MetricDef& def : m_metricsSchema.metrics())
+        {
+            MetricControl mc;
+            wxString label = wxString::FromUTF8(def.label + (def.unit.empty() ? "" : " (" + def.unit + ")") + ":");
+            if (def.type == MetricType::Enum)
+            {
+                wxArrayString choices;
+                if (!def.required) choices.Add("");
+                for (const auto& v : def.values) choices.Add(wxString::FromUTF8(v));
+                addChoice(label, mc.choice, mc.error, choices);
+            }
+            else
+            {
+                addField(label, mc.text, mc.error);
+            }
+            m_metricControls.push_back(mc);
+        }
+
         // Notes field
         grid->Add(new wxStaticText(panel, wxID_ANY, "Notes:"), 0, wxALIGN_TOP);
         wxBoxSizer* notesContainer = new wxBoxSizer(wxVERTICAL);
@@ -510,6 +597,10 @@ public:
             // Bind events
             m_addBtn->Bind(wxEVT_BUTTON, &MyFrame::OnAddDevice, this);
             m_clearBtn->Bind(wxEVT_BUTTON, &MyFrame::OnClearFields, this);
+
+            // Periodic upkeep of the dashboard aggregates
+            Bind(wxEVT_TIMER, &MyFrame::OnHousekeeping, this);
+            m_housekeeping.Start(60 * 1000);
             log_debug("MyFrame constructor completed successfully");
         } catch (const std::exception& e) {
             log_debug("Exception in MyFrame constructor: " + std::string(e.what()));
@@ -520,6 +611,30 @@ public:
         }
     }
 
+    ~MyFrame() override
+    {
+        m_housekeeping.Stop();
+        // Background jobs use the store and dashboards; stop them first
+        m_shutdown.cancel();
+        try {
+            m_background.wait();
+        }
+        catch (const std::exception& ex) {
+            log_debug(std::string("Background job failed: ") + ex.what());
+        }
+        // A record the user already added is still handed to the pipeline
+        try {
+            m_submits.wait();
+        }
+        catch (const std::exception& ex) {
+            log_debug(std::string("Record submit failed: ") + ex.what());
+        }
+        // Drain queued readings through the commit listener first, then
+        // report the failure cluster still open, however recent
+        m_ingest.reset();
+        m_correlator.flush(std::numeric_limits<int64_t>::max());
+    }
+
 private:
     bool ValidateField(const std::string& value, const std::string& fieldName, wxStaticText* errorCtrl, 
                      const std::vector<FormValidator::ValidationResult(*)(const std::string&, const std::string&)>& validators) {
@@ -621,6 +736,22 @@ private:
             [](const auto& v, const auto& n) { return FormValidator::lengthRange(v, 0, 500, n); }
         })) hasErrors = true;
 
+        std::vector<std::pair<std::string, std::string>> metrics;
+        for (size_t i = 0; i < m_metricControls.size(); ++i)
+        {
+            const MetricControl& mc = m_metricControls[i];
+            const std::string value = std::string((mc.text ? mc.text->GetValue() : mc.choice->GetStringSelection()).ToUTF8());
+            std::string message;
+            if (!m_metricsSchema.validate(i, value, message))
+            {
+                mc.error->SetLabel(wxString::FromUTF8(message));
+                hasErrors = true;
+                continue;
+            }
+            mc.error->SetLabel("");
+            if (!value.empty()) metrics.emplace_back(m_metricsSchema.metrics()[i].name, value);
+        }
+
         if (hasErrors) {
             return; // Don't proceed if there are validation errors
         }
@@ -628,50 +759,69 @@ private:
         // Disable add button while generating defaults in background
         m_addBtn->Disable();
 
-        // Launch background task to generate UUID and timestamp
-        auto fut = std::async(std::launch::async, [=]() {
-            // Simulate light background work
-            std::string uuid = generate_uuid_v4();
-            std::string ts = current_timestamp();
-            return std::make_pair(uuid, ts);
+        // Build and submit the record on the blocking lane. submit() may wait
+        // for a credit under backpressure (bounded by blockTimeout), which
+        // must stall neither the UI thread nor the compute pool.
+        m_submits.run([this, operatorId, instanceId, appVersion, deviceId, deviceName, status, actionType, voltage, temperature, severity, uiLatency, notes, metrics]() {
+            auto onDone = [this](IngestStatus result) {
+                CallAfter([this, result]() {
+                    if (result == IngestStatus::Committed)
+                        wxMessageBox("Device added successfully!", "Success", wxOK | wxICON_INFORMATION);
+                    else
+                        wxMessageBox(wxString::Format("Failed to save device data (%s)", ingest_status_name(result)),
+                                     "Error", wxOK | wxICON_ERROR);
+                    m_addBtn->Enable();
+                });
+            };
+
+            // Errors are reported here: a task that throws would make
+            // m_submits skip every later record
+            try {
+                DeviceRecord rec;
+                rec.uuid = generate_uuid_v4();
+                rec.createdAt = current_timestamp();
+                rec.operatorId = operatorId;
+                rec.instanceId = instanceId;
+                rec.appVersion = appVersion;
+                rec.deviceId = deviceId;
+                rec.deviceName = deviceName;
+                rec.status = status;
+                rec.actionType = actionType;
+                rec.voltage = parse_number(voltage);
+                rec.temperature = parse_number(temperature);
+                rec.severity = severity;
+                rec.uiLatencyMs = uiLatency.empty() ? -1 : std::stoi(uiLatency);
+                rec.notes = notes;
+                rec.metrics = metrics;
+
+                IngestStatus admitted = m_ingest->submit(std::move(rec), onDone);
+                if (admitted != IngestStatus::Queued)
+                {
+                    log_debug(std::string("Ingest refused record: ") + ingest_status_name(admitted));
+                    onDone(admitted);
+                }
+            }
+            catch (const std::exception& ex) {
+                log_debug(std::string("Record not submitted: ") + ex.what());
+                onDone(IngestStatus::Failed);
+            }
         });
+    }
 
-        // When done, save to CSV on main thread
-        std::thread([this, fut = std::move(fut), operatorId, instanceId, appVersion, deviceId, deviceName, status, actionType, voltage, temperature, severity, uiLatency, notes]() mutable {
-            auto pair = fut.get();
-            const std::string uuid = pair.first;
-            const std::string ts = pair.second;
-
-            wxTheApp->CallAfter([=]() {
-                
-                        // Build CSV row (escape fields as needed)
-                std::string row;
-                row += csv_escape(uuid); row += ',';
-                row += csv_escape(ts); row += ',';
-                row += csv_escape(operatorId); row += ',';
-                row += csv_escape(instanceId); row += ',';
-                row += csv_escape(appVersion); row += ',';
-                row += csv_escape(deviceId); row += ',';
-                row += csv_escape(deviceName); row += ',';
-                row += csv_escape(status); row += ',';
-                row += csv_escape(actionType); row += ',';
-                row += csv_escape(voltage); row += ',';
-                row += csv_escape(temperature); row += ',';
-                row += csv_escape(severity); row += ',';
-                row += csv_escape(uiLatency); row += ',';
-                row += csv_escape(notes);
-
-                // Save to devices.csv in project folder
-                try {
-                    save_device_csv(get_appdata_devices_path(), row);
-                    wxMessageBox("Device added successfully!", "Success", wxOK | wxICON_INFORMATION);
-                } catch (...) {
-                    wxMessageBox("Failed to save device data", "Error", wxOK | wxICON_ERROR);
-                }
-                
-                m_addBtn->Enable();
-            });
-        }).detach();
+    // A failure cluster is only closed by a later failure; once the stream
+    // has been quiet for the window, report it from here. Latency keeps a
+    // week of hourly digests and a year of daily ones; the fleet overview
+    // a year of days and two years of months.
+    void OnHousekeeping(wxTimerEvent&)
+    {
+        const std::string stamp = current_timestamp();
+        int64_t now;
+        int year, month;
+        if (!parse_timestamp(stamp, now) || std::sscanf(stamp.c_str(), "%4d-%2d", &year, &month) != 2) return;
+        m_correlator.flush(now);
+        m_latency.pruneBefore(now - 7 * 86400, now - 366 * 86400);
+        m_fleet.pruneDaysBefore(now / 86400 - 366);
+        m_fleet.pruneMonthsBefore(year - 2, month);
     }
 
     void OnClearFields(wxCommandEvent&)
@@ -688,6 +838,12 @@ private:
         m_severity->SetSelection(0);
         m_uiLatency->SetValue("0");
         m_notes->Clear();
+        for (const MetricControl& mc : m_metricControls)
+        {
+            if (mc.text) mc.text->Clear();
+            else mc.choice->SetSelection(0);
+            mc.error->SetLabel("");
+        }
 
         // Clear all error messages
         m_operatorIdError->SetLabel("");
@@ -706,6 +862,39 @@ private:
 
 
 
+    // Dashboard aggregates fed by the commit listener
+    LatencySketchIndex m_latency;
+    FleetOverview m_fleet;
+    TrendRegistry m_trends;
+    DeviceTopology m_topology;
+    StringInterner m_deviceCodes;
+    DeviceMasterCache m_master{m_deviceCodes};
+    // Three or more devices entering Degraded/Offline within 10 minutes
+    FailureCorrelator m_correlator{600, 3, m_deviceCodes, [this](const FailureCluster& c) {
+        std::string ids;
+        for (uint32_t code : c.devices) ids += (ids.empty() ? "" : ",") + m_deviceCodes.name(code);
+        log_debug("Correlated failures on " + std::to_string(c.devices.size()) + " devices: " + ids);
+    }};
+    wxTimer m_housekeeping{this}; // OnHousekeeping, once a minute
+
+    // Bounded writer for captured readings (pipeline must die before its sink)
+    std::unique_ptr<WaveformHeap> m_waveforms; // samples referenced by DeviceRecord::waveform
+    std::unique_ptr<RecordStore> m_store;      // sink plus history reads, per storage.cfg
+    std::unique_ptr<IngestPipeline> m_ingest;
+    // Jobs on the members above; cancelled and joined by ~MyFrame
+    CancellationToken m_shutdown;
+    TaskGroup m_background{shared_executor(), m_shutdown};
+    TaskGroup m_submits{blocking_executor()}; // form records; joined, never cancelled
+
+    // Form fields generated from metrics_schema.csv, in schema order
+    struct MetricControl {
+        wxTextCtrl* text{nullptr};     // number/integer
+        wxChoice* choice{nullptr};     // enum
+        wxStaticText* error{nullptr};
+    };
+    MetricsSchema m_metricsSchema;
+    std::vector<MetricControl> m_metricControls;
+
     // Controls
     wxTextCtrl* m_operatorId{nullptr};
     wxTextCtrl* m_instanceId{nullptr};
@@ -755,7 +944,8 @@ public:
             log_debug("Application starting");
             // Enable call stack traces
             wxHandleFatalExceptions();
-            
+
+            compact_history();
             MyFrame* frame = new MyFrame();
             if (!frame) {
                 log_debug("Failed to create frame");
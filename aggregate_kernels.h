@@ -0,0 +1,537 @@
+// MiniGridMonitor - aggregation kernels over nullable float columns
+//
+// Kernels take a FloatColumnView (values plus an optional validity bitmap)
+// and pick an AVX-512, AVX2 or scalar implementation at runtime. All paths
+// produce the same counts and min/max; sums are accumulated in double.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GRID_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(GRID_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GRID_TARGET_AVX2 __attribute__((target("avx2")))
+#define GRID_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define GRID_TARGET_AVX2
+#define GRID_TARGET_AVX512
+#endif
+
+// Bit i of validity (LSB first within each word) set = row i has a value.
+// A null validity pointer means every row is valid.
+struct FloatColumnView {
+    const float* values = nullptr;
+    const uint64_t* validity = nullptr;
+    size_t size = 0;
+};
+
+struct ColumnStats {
+    uint64_t count = 0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    double sum = 0.0;
+    double sumSq = 0.0;
+
+    double mean() const { return count ? sum / count : NAN; }
+
+    // One value, rounded to float as the kernels read it; NaN (missing) is skipped
+    void add(double v) {
+        if (std::isnan(v)) return;
+        const float f = static_cast<float>(v);
+        ++count;
+        min = std::min(min, f);
+        max = std::max(max, f);
+        sum += f;
+        sumSq += double(f) * double(f);
+    }
+
+    // Population variance
+    double variance() const {
+        if (!count) return NAN;
+        double m = sum / count;
+        return std::max(0.0, sumSq / count - m * m);
+    }
+
+    void merge(const ColumnStats& o) {
+        count += o.count;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+        sum += o.sum;
+        sumSq += o.sumSq;
+    }
+};
+
+enum class SimdLevel { Scalar, Avx2, Avx512 };
+
+inline const char* simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Avx512: return "avx512";
+    case SimdLevel::Avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+inline SimdLevel detect_simd_level()
+{
+#if defined(GRID_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return SimdLevel::Scalar;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave) return SimdLevel::Scalar;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    if (avx512) return SimdLevel::Avx512;
+    if (avx2) return SimdLevel::Avx2;
+    return SimdLevel::Scalar;
+#elif defined(GRID_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Detected once per process
+inline SimdLevel active_simd_level()
+{
+    static const SimdLevel level = detect_simd_level();
+    return level;
+}
+
+inline unsigned popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+    unsigned n = 0;
+    while (x) { x &= x - 1; ++n; }
+    return n;
+#endif
+}
+
+inline unsigned lowest_bit(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+    unsigned i = 0;
+    while (!(x & 1)) { x >>= 1; ++i; }
+    return i;
+#endif
+}
+
+// Validity word covering rows [64*w, 64*w + 64), masked to `size`
+inline uint64_t validity_word(const FloatColumnView& col, size_t w)
+{
+    uint64_t bits = col.validity ? col.validity[w] : ~uint64_t(0);
+    size_t remaining = col.size - w * 64;
+    if (remaining < 64) bits &= (uint64_t(1) << remaining) - 1;
+    return bits;
+}
+
+namespace kernels_detail {
+
+inline void stats_word_scalar(const float* v, uint64_t bits, ColumnStats& s)
+{
+    while (bits)
+    {
+        unsigned i = lowest_bit(bits);
+        bits &= bits - 1;
+        float x = v[i];
+        s.min = std::min(s.min, x);
+        s.max = std::max(s.max, x);
+        s.sum += x;
+        s.sumSq += double(x) * x;
+        ++s.count;
+    }
+}
+
+inline ColumnStats stats_scalar(const FloatColumnView& col)
+{
+    ColumnStats s;
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        const float* v = col.values + w * 64;
+        if (bits == ~uint64_t(0))
+        {
+            // Dense word: plain loop the compiler can unroll
+            float mn = s.min, mx = s.max;
+            double sum = 0, sq = 0;
+            for (int i = 0; i < 64; ++i)
+            {
+                float x = v[i];
+                mn = std::min(mn, x);
+                mx = std::max(mx, x);
+                sum += x;
+                sq += double(x) * x;
+            }
+            s.min = mn; s.max = mx; s.sum += sum; s.sumSq += sq; s.count += 64;
+        }
+        else if (bits)
+        {
+            stats_word_scalar(v, bits, s);
+        }
+    }
+    return s;
+}
+
+inline uint64_t count_above_scalar(const FloatColumnView& col, float threshold)
+{
+    uint64_t n = 0;
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        if (!bits) continue;
+        const float* v = col.values + w * 64;
+        uint64_t above = 0;
+        size_t len = std::min<size_t>(64, col.size - w * 64);
+        for (size_t i = 0; i < len; ++i)
+            above |= uint64_t(v[i] > threshold) << i;
+        n += popcount64(above & bits);
+    }
+    return n;
+}
+
+inline size_t histogram_bin(float x, float lo, float scale, size_t nbins)
+{
+    float f = (x - lo) * scale;
+    if (!(f > 0.0f)) return 0; // also catches NaN
+    if (f >= float(nbins - 1)) return nbins - 1;
+    return static_cast<size_t>(f);
+}
+
+inline void histogram_scalar(const FloatColumnView& col, float lo, float scale, uint64_t* bins, size_t nbins)
+{
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        const float* v = col.values + w * 64;
+        while (bits)
+        {
+            unsigned i = lowest_bit(bits);
+            bits &= bits - 1;
+            ++bins[histogram_bin(v[i], lo, scale, nbins)];
+        }
+    }
+}
+
+#ifdef GRID_X86
+
+GRID_TARGET_AVX2 inline __m256 expand_mask8(unsigned m)
+{
+    const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i b = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(m)), lanes);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(b, lanes));
+}
+
+GRID_TARGET_AVX2 inline ColumnStats stats_avx2(const FloatColumnView& col)
+{
+    const __m256 posInf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 negInf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 mn = posInf, mx = negInf;
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sq0 = _mm256_setzero_pd(), sq1 = _mm256_setzero_pd();
+    uint64_t count = 0;
+
+    const size_t fullWords = col.size / 64;
+    for (size_t w = 0; w < fullWords; ++w)
+    {
+        uint64_t bits = col.validity ? col.validity[w] : ~uint64_t(0);
+        if (!bits) continue;
+        count += popcount64(bits);
+        const float* v = col.values + w * 64;
+        const bool dense = bits == ~uint64_t(0);
+        for (int j = 0; j < 8; ++j, bits >>= 8)
+        {
+            __m256 x = _mm256_loadu_ps(v + j * 8);
+            __m256 lo = x, hi = x;
+            if (!dense)
+            {
+                __m256 mk = expand_mask8(static_cast<unsigned>(bits & 0xff));
+                lo = _mm256_blendv_ps(posInf, x, mk);
+                hi = _mm256_blendv_ps(negInf, x, mk);
+                x = _mm256_and_ps(x, mk);
+            }
+            mn = _mm256_min_ps(mn, lo);
+            mx = _mm256_max_ps(mx, hi);
+            __m256d d0 = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+            __m256d d1 = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+            sum0 = _mm256_add_pd(sum0, d0);
+            sum1 = _mm256_add_pd(sum1, d1);
+            sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(d0, d0));
+            sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(d1, d1));
+        }
+    }
+
+    alignas(32) float fmn[8], fmx[8];
+    alignas(32) double dsum[4], dsq[4];
+    _mm256_store_ps(fmn, mn);
+    _mm256_store_ps(fmx, mx);
+    _mm256_store_pd(dsum, _mm256_add_pd(sum0, sum1));
+    _mm256_store_pd(dsq, _mm256_add_pd(sq0, sq1));
+
+    ColumnStats s;
+    s.count = count;
+    for (int i = 0; i < 8; ++i) { s.min = std::min(s.min, fmn[i]); s.max = std::max(s.max, fmx[i]); }
+    for (int i = 0; i < 4; ++i) { s.sum += dsum[i]; s.sumSq += dsq[i]; }
+
+    if (fullWords * 64 < col.size)
+        stats_word_scalar(col.values + fullWords * 64, validity_word(col, fullWords), s);
+    return s;
+}
+
+GRID_TARGET_AVX2 inline uint64_t count_above_avx2(const FloatColumnView& col, float threshold)
+{
+    const __m256 t = _mm256_set1_ps(threshold);
+    uint64_t n = 0;
+    const size_t fullWords = col.size / 64;
+    for (size_t w = 0; w < fullWords; ++w)
+    {
+        uint64_t bits = col.validity ? col.validity[w] : ~uint64_t(0);
+        if (!bits) continue;
+        const float* v = col.values + w * 64;
+        uint64_t above = 0;
+        for (int j = 0; j < 8; ++j)
+        {
+            unsigned m = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + j * 8), t, _CMP_GT_OQ)));
+            above |= uint64_t(m) << (j * 8);
+        }
+        n += popcount64(above & bits);
+    }
+    if (fullWords * 64 < col.size)
+    {
+        FloatColumnView tail;
+        tail.values = col.values + fullWords * 64;
+        tail.size = col.size - fullWords * 64;
+        uint64_t bits = validity_word(col, fullWords);
+        tail.validity = &bits;
+        n += count_above_scalar(tail, threshold);
+    }
+    return n;
+}
+
+GRID_TARGET_AVX2 inline void histogram_avx2(const FloatColumnView& col, float lo, float scale, uint64_t* bins, size_t nbins)
+{
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 top = _mm256_set1_ps(float(nbins - 1));
+    alignas(32) int32_t idx[8];
+
+    const size_t fullWords = col.size / 64;
+    for (size_t w = 0; w < fullWords; ++w)
+    {
+        uint64_t bits = col.validity ? col.validity[w] : ~uint64_t(0);
+        if (!bits) continue;
+        const float* v = col.values + w * 64;
+        for (int j = 0; j < 8; ++j, bits >>= 8)
+        {
+            unsigned m = static_cast<unsigned>(bits & 0xff);
+            if (!m) continue;
+            __m256 f = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(v + j * 8), vlo), vscale);
+            // max(f, 0) returns 0 for NaN lanes
+            f = _mm256_min_ps(_mm256_max_ps(f, zero), top);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(idx), _mm256_cvttps_epi32(f));
+            if (m == 0xff)
+            {
+                for (int k = 0; k < 8; ++k) ++bins[idx[k]];
+            }
+            else
+            {
+                for (int k = 0; k < 8; ++k)
+                    if (m & (1u << k)) ++bins[idx[k]];
+            }
+        }
+    }
+    if (fullWords * 64 < col.size)
+    {
+        FloatColumnView tail;
+        tail.values = col.values + fullWords * 64;
+        tail.size = col.size - fullWords * 64;
+        uint64_t bits = validity_word(col, fullWords);
+        tail.validity = &bits;
+        histogram_scalar(tail, lo, scale, bins, nbins);
+    }
+}
+
+GRID_TARGET_AVX512 inline ColumnStats stats_avx512(const FloatColumnView& col)
+{
+    __m512 mn = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    __m512 mx = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    __m512d sq0 = _mm512_setzero_pd(), sq1 = _mm512_setzero_pd();
+    uint64_t count = 0;
+
+    const size_t fullWords = col.size / 64;
+    for (size_t w = 0; w < fullWords; ++w)
+    {
+        uint64_t bits = col.validity ? col.validity[w] : ~uint64_t(0);
+        if (!bits) continue;
+        count += popcount64(bits);
+        const float* v = col.values + w * 64;
+        for (int j = 0; j < 4; ++j, bits >>= 16)
+        {
+            // Full words are in bounds, so plain loads are safe; the mask
+            // only decides which lanes contribute.
+            __mmask16 k = static_cast<__mmask16>(bits & 0xffff);
+            __m512 x = _mm512_loadu_ps(v + j * 16);
+            mn = _mm512_mask_min_ps(mn, k, mn, x);
+            mx = _mm512_mask_max_ps(mx, k, mx, x);
+            const __m512d zero = _mm512_setzero_pd();
+            __m512d d0 = _mm512_mask_cvtps_pd(zero, static_cast<__mmask8>(k), _mm256_loadu_ps(v + j * 16));
+            __m512d d1 = _mm512_mask_cvtps_pd(zero, static_cast<__mmask8>(k >> 8), _mm256_loadu_ps(v + j * 16 + 8));
+            sum0 = _mm512_add_pd(sum0, d0);
+            sum1 = _mm512_add_pd(sum1, d1);
+            sq0 = _mm512_fmadd_pd(d0, d0, sq0);
+            sq1 = _mm512_fmadd_pd(d1, d1, sq1);
+        }
+    }
+
+    alignas(64) float fmn[16], fmx[16];
+    alignas(64) double dsum[8], dsq[8];
+    _mm512_store_ps(fmn, mn);
+    _mm512_store_ps(fmx, mx);
+    _mm512_store_pd(dsum, _mm512_add_pd(sum0, sum1));
+    _mm512_store_pd(dsq, _mm512_add_pd(sq0, sq1));
+
+    ColumnStats s;
+    s.count = count;
+    for (int i = 0; i < 16; ++i) { s.min = std::min(s.min, fmn[i]); s.max = std::max(s.max, fmx[i]); }
+    for (int i = 0; i < 8; ++i) { s.sum += dsum[i]; s.sumSq += dsq[i]; }
+
+    if (fullWords * 64 < col.size)
+        stats_word_scalar(col.values + fullWords * 64, validity_word(col, fullWords), s);
+    return s;
+}
+
+GRID_TARGET_AVX512 inline uint64_t count_above_avx512(const FloatColumnView& col, float threshold)
+{
+    const __m512 t = _mm512_set1_ps(threshold);
+    uint64_t n = 0;
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        if (!bits) continue;
+        const float* v = col.values + w * 64;
+        for (int j = 0; j < 4; ++j, bits >>= 16)
+        {
+            __mmask16 k = static_cast<__mmask16>(bits & 0xffff);
+            if (!k) continue;
+            // Masked loads never touch rows past the end of the column
+            __m512 x = _mm512_maskz_loadu_ps(k, v + j * 16);
+            n += popcount64(_mm512_mask_cmp_ps_mask(k, x, t, _CMP_GT_OQ));
+        }
+    }
+    return n;
+}
+
+#endif // GRID_X86
+
+} // namespace kernels_detail
+
+inline ColumnStats column_stats(const FloatColumnView& col, SimdLevel level = active_simd_level())
+{
+#ifdef GRID_X86
+    if (level == SimdLevel::Avx512) return kernels_detail::stats_avx512(col);
+    if (level == SimdLevel::Avx2) return kernels_detail::stats_avx2(col);
+#endif
+    (void)level;
+    return kernels_detail::stats_scalar(col);
+}
+
+// Number of valid rows strictly greater than `threshold`
+inline uint64_t count_above(const FloatColumnView& col, float threshold, SimdLevel level = active_simd_level())
+{
+#ifdef GRID_X86
+    if (level == SimdLevel::Avx512) return kernels_detail::count_above_avx512(col, threshold);
+    if (level == SimdLevel::Avx2) return kernels_detail::count_above_avx2(col, threshold);
+#endif
+    (void)level;
+    return kernels_detail::count_above_scalar(col, threshold);
+}
+
+// Adds valid rows into `nbins` equal-width bins over [lo, hi). Rows outside
+// the range land in the first or last bin. `bins` is not cleared.
+inline void column_histogram(const FloatColumnView& col, float lo, float hi, uint64_t* bins, size_t nbins,
+                             SimdLevel level = active_simd_level())
+{
+    if (nbins == 0 || !(hi > lo)) return;
+    const float scale = float(nbins) / (hi - lo);
+#ifdef GRID_X86
+    // Bin scatter is the bottleneck, so AVX-512 gains nothing over AVX2 here
+    if (level != SimdLevel::Scalar) return kernels_detail::histogram_avx2(col, lo, scale, bins, nbins);
+#endif
+    (void)level;
+    kernels_detail::histogram_scalar(col, lo, scale, bins, nbins);
+}
+
+// Per-group stats keyed by dictionary code (e.g. interned device_id).
+// groups[codes[i]] accumulates row i; codes >= ngroups are ignored.
+// The scatter defeats SIMD, so this walks validity words in plain code.
+inline void grouped_column_stats(const FloatColumnView& col, const uint32_t* codes, ColumnStats* groups, size_t ngroups)
+{
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        const size_t base = w * 64;
+        while (bits)
+        {
+            unsigned i = lowest_bit(bits);
+            bits &= bits - 1;
+            uint32_t g = codes[base + i];
+            if (g >= ngroups) continue;
+            float x = col.values[base + i];
+            ColumnStats& s = groups[g];
+            s.min = std::min(s.min, x);
+            s.max = std::max(s.max, x);
+            s.sum += x;
+            s.sumSq += double(x) * x;
+            ++s.count;
+        }
+    }
+}
+
+// Per-group count of valid rows strictly greater than `threshold`
+inline void grouped_count_above(const FloatColumnView& col, const uint32_t* codes, float threshold,
+                                uint64_t* counts, size_t ngroups)
+{
+    if (ngroups == 0) return;
+    const size_t words = (col.size + 63) / 64;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t bits = validity_word(col, w);
+        const size_t base = w * 64;
+        size_t len = std::min<size_t>(64, col.size - base);
+        for (size_t i = 0; i < len; ++i)
+        {
+            uint32_t g = codes[base + i];
+            bool hit = ((bits >> i) & 1) && col.values[base + i] > threshold && g < ngroups;
+            counts[hit ? g : 0] += hit;
+        }
+    }
+}
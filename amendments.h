@@ -0,0 +1,259 @@
+// MiniGridMonitor - corrections to committed readings, applied on read
+//
+// Data rows are never edited in place. A correction is a small delta row
+// in the segment's sidecar file (devices.csv -> devices.csv.amend) that
+// either amends named fields of one uuid or voids it. Readers load the
+// sidecar into an AmendmentIndex and patch rows as they stream past;
+// segments without a sidecar are scanned exactly as before. compact_segment
+// eventually rewrites a segment with its corrections folded in.
+#pragma once
+
+#include "device_record.h"
+#include "file_sync.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+static const char* const kAmendmentCsvHeader = "target_uuid,created_at,operator_id,action,changes,reason";
+
+struct Amendment {
+    std::string targetUuid;
+    std::string createdAt;
+    std::string operatorId;
+    bool voids = false;  // true = the reading should be treated as never taken
+    std::vector<std::pair<std::string, std::string>> changes; // column name -> new value
+    std::string reason;
+};
+
+inline std::string amendment_path(const std::string& segmentPath)
+{
+    return segmentPath + ".amend";
+}
+
+// Throws std::runtime_error for a missing target or an unknown or
+// read-only field
+inline void check_amendment(const Amendment& a)
+{
+    if (a.targetUuid.empty())
+        throw std::runtime_error("amendment has no target uuid");
+    for (const auto& change : a.changes)
+    {
+        const int column = device_column_index(change.first);
+        if (column < 0) throw std::runtime_error("cannot amend unknown field: " + change.first);
+        if (column == static_cast<int>(device_columns().uuid)) throw std::runtime_error("cannot amend uuid");
+    }
+}
+
+// For backends that store whole readings: patches `rec` with a checked
+// amendment. False when it voids the reading.
+inline bool apply_amendment(const Amendment& a, DeviceRecord& rec)
+{
+    if (a.voids) return false;
+    std::vector<std::string> values = parse_csv_line(to_csv_row(rec));
+    values.resize(device_csv_columns().size());
+    for (const auto& change : a.changes) values[device_column_index(change.first)] = change.second;
+    return from_csv_row(values, rec);
+}
+
+// Corrections for one segment, merged per uuid in log order: later values
+// for the same field win, and a void is final.
+class AmendmentIndex {
+public:
+    // Missing sidecar = no corrections. Returns false only if it exists
+    // but cannot be read.
+    bool load(const std::string& sidecarPath) {
+        m_byUuid.clear();
+        std::error_code ec;
+        if (!std::filesystem::exists(sidecarPath, ec)) return true;
+        std::ifstream in(sidecarPath, std::ios::in | std::ios::binary);
+        if (!in) return false;
+        std::string record;
+        if (!read_csv_record(in, record)) return true; // header
+        while (read_csv_record(in, record))
+        {
+            if (record.empty()) continue;
+            auto cols = parse_csv_line(record);
+            if (cols.size() < 6 || cols[0].empty()) continue; // torn last line
+            Amendment a;
+            a.targetUuid = cols[0];
+            a.createdAt = cols[1];
+            a.operatorId = cols[2];
+            a.voids = cols[3] == "void";
+            a.changes = decode_metrics(cols[4]);
+            a.reason = cols[5];
+            add(a);
+        }
+        return true;
+    }
+
+    void add(const Amendment& a) {
+        Entry& e = m_byUuid[a.targetUuid];
+        e.voided = e.voided || a.voids;
+        for (const auto& change : a.changes)
+        {
+            const int column = device_column_index(change.first);
+            if (column < 0 || column == static_cast<int>(device_columns().uuid)) continue;
+            bool replaced = false;
+            for (auto& f : e.fields)
+            {
+                if (f.first == column) { f.second = change.second; replaced = true; }
+            }
+            if (!replaced) e.fields.emplace_back(column, change.second);
+        }
+    }
+
+    bool empty() const { return m_byUuid.empty(); }
+    bool affects(const std::string& uuid) const { return !m_byUuid.empty() && m_byUuid.count(uuid) != 0; }
+    size_t size() const { return m_byUuid.size(); }
+
+    // `values` holds one row in device_csv_columns() order. Patches it in
+    // place; false when the row is voided.
+    bool apply(std::vector<std::string>& values) const {
+        if (m_byUuid.empty()) return true;
+        auto it = m_byUuid.find(values[device_columns().uuid]);
+        if (it == m_byUuid.end()) return true;
+        if (it->second.voided) return false;
+        for (const auto& f : it->second.fields) values[f.first] = f.second;
+        return true;
+    }
+
+private:
+    struct Entry {
+        bool voided = false;
+        std::vector<std::pair<int, std::string>> fields;
+    };
+
+    std::unordered_map<std::string, Entry> m_byUuid;
+};
+
+// Appends corrections to a segment's sidecar. One short row and one fsync
+// per correction; the data file is not touched.
+class AmendmentLog {
+public:
+    explicit AmendmentLog(const std::string& segmentPath)
+        : m_path(amendment_path(segmentPath)) {}
+
+    ~AmendmentLog() {
+        if (m_file) std::fclose(m_file);
+    }
+
+    AmendmentLog(const AmendmentLog&) = delete;
+    AmendmentLog& operator=(const AmendmentLog&) = delete;
+
+    // Throws std::runtime_error for unknown or read-only fields and I/O errors
+    void append(const Amendment& a) {
+        check_amendment(a);
+        std::string row = csv_escape(a.targetUuid) + ',' + csv_escape(a.createdAt) + ',' + csv_escape(a.operatorId) +
+                          ',' + (a.voids ? "void" : "amend") + ',' + csv_escape(encode_metrics(a.changes)) + ',' +
+                          csv_escape(a.reason) + '\n';
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        open();
+        if (std::fwrite(row.data(), 1, row.size(), m_file) != row.size())
+            throw std::runtime_error("unable to write file: " + m_path);
+        sync_file(m_file, m_path);
+    }
+
+    const std::string& path() const { return m_path; }
+
+private:
+    void open() {
+        if (m_file) return;
+        std::error_code ec;
+        bool exists = std::filesystem::exists(m_path, ec) && std::filesystem::file_size(m_path, ec) > 0;
+        m_file = std::fopen(m_path.c_str(), "ab");
+        if (!m_file)
+            throw std::runtime_error("unable to open file for append: " + m_path);
+        if (!exists)
+        {
+            std::fputs(kAmendmentCsvHeader, m_file);
+            std::fputc('\n', m_file);
+        }
+    }
+
+    std::string m_path;
+    std::mutex m_mutex;
+    std::FILE* m_file = nullptr;
+};
+
+// for_each_device_record with the segment's corrections merged in:
+// amended rows arrive patched, voided rows are skipped. Rows too short to
+// parse go to `skipped` as read, if given.
+inline bool for_each_current_record(const std::string& segmentPath, const std::function<void(DeviceRecord&&)>& fn,
+                                    const std::function<void(const std::string&)>& skipped = nullptr)
+{
+    AmendmentIndex index;
+    if (!index.load(amendment_path(segmentPath)))
+        throw std::runtime_error("unable to read corrections: " + amendment_path(segmentPath));
+    std::vector<std::string> patched;
+    return for_each_projected({segmentPath}, device_csv_columns(), [&](const std::vector<std::string>& values) {
+        DeviceRecord rec;
+        if (!index.affects(values[0]))
+        {
+            if (from_csv_row(values, rec)) fn(std::move(rec));
+            return;
+        }
+        patched = values;
+        if (index.apply(patched) && from_csv_row(patched, rec)) fn(std::move(rec));
+    }, skipped);
+}
+
+// Rewrites a segment with its corrections applied (voided rows dropped,
+// header upgraded to the current schema) and removes the sidecar. Rows too
+// short to parse are copied through unchanged. The segment must not be
+// open for append. The new file is synced and renamed over the old one;
+// if the sidecar outlives a crash, re-applying it to the compacted rows is
+// harmless. Returns false when there was nothing to fold.
+inline bool compact_segment(const std::string& segmentPath, size_t minCorrections = 1)
+{
+    namespace fs = std::filesystem;
+    const std::string sidecar = amendment_path(segmentPath);
+    AmendmentIndex index;
+    if (!index.load(sidecar))
+        throw std::runtime_error("unable to read corrections: " + sidecar);
+    if (index.empty() || index.size() < minCorrections) return false;
+
+    const std::string tmp = segmentPath + ".compact";
+    std::FILE* out = std::fopen(tmp.c_str(), "wb");
+    if (!out)
+        throw std::runtime_error("unable to open file for writing: " + tmp);
+    bool ok = std::fputs(kDeviceCsvHeader, out) >= 0 && std::fputc('\n', out) != EOF;
+    std::string buffer;
+    auto writeRow = [&](const std::string& row) {
+        buffer += row;
+        buffer += '\n';
+        if (buffer.size() >= (1 << 20))
+        {
+            ok = ok && std::fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+            buffer.clear();
+        }
+    };
+    for_each_current_record(segmentPath, [&](DeviceRecord&& rec) { writeRow(to_csv_row(rec)); }, writeRow);
+    ok = ok && std::fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size() && std::fflush(out) == 0 &&
+         fsync_file(out);
+    std::fclose(out);
+    if (!ok)
+    {
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        throw std::runtime_error("unable to write compacted segment: " + tmp);
+    }
+    fs::rename(tmp, segmentPath);
+    sync_parent_directory(segmentPath);
+    // Row offsets moved: drop the segment's index so it is rebuilt. An
+    // index still open elsewhere notices the rewrite by its segment check.
+    std::error_code ec;
+    fs::remove(segmentPath + ".idx", ec);
+    fs::remove(segmentPath + ".idx.names", ec);
+    fs::remove(sidecar);
+    return true;
+}
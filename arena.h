@@ -0,0 +1,174 @@
+// MiniGridMonitor - per-batch monotonic arenas and a pool that recycles them
+//
+// A batch's short-lived bytes (field text, record structs, error messages)
+// are bump-allocated from one arena and released together by reset()
+// once the batch is committed. reset() keeps the arena's chunks, and the
+// pool hands reset arenas to the next batch, so a steady stream of
+// similar batches stops calling malloc after the first few.
+#pragma once
+
+#include "object_pool.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Not thread safe: one batch, one thread at a time. Also usable as a
+// std::pmr::memory_resource; deallocation is a no-op.
+class MonotonicArena : public std::pmr::memory_resource {
+public:
+    // `chunkBytes` is the usual chunk size; larger requests get a chunk of
+    // their own. reset() keeps up to `retainBytes` of chunks.
+    explicit MonotonicArena(size_t chunkBytes = 64 << 10, size_t retainBytes = 4 << 20)
+        : m_chunkBytes(std::max<size_t>(chunkBytes, 256)), m_retainBytes(retainBytes) {}
+
+    ~MonotonicArena() override {
+        for (auto& c : m_chunks) ::operator delete(c.data);
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    // Constructs a T in the arena. T's destructor never runs, so it must
+    // not own anything outside the arena.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Arena-owned copy of `s`
+    std::string_view copy(std::string_view s) {
+        if (s.empty()) return std::string_view();
+        char* p = static_cast<char*>(allocate(s.size(), 1));
+        std::memcpy(p, s.data(), s.size());
+        return std::string_view(p, s.size());
+    }
+
+    // printf() into the arena, e.g. for per-row error messages
+    std::string_view format(const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        va_list again;
+        va_copy(again, args);
+        const int n = std::vsnprintf(nullptr, 0, fmt, args);
+        va_end(args);
+        if (n <= 0)
+        {
+            va_end(again);
+            return std::string_view();
+        }
+        char* p = static_cast<char*>(allocate(static_cast<size_t>(n) + 1, 1));
+        std::vsnprintf(p, static_cast<size_t>(n) + 1, fmt, again);
+        va_end(again);
+        return std::string_view(p, static_cast<size_t>(n));
+    }
+
+    // Releases everything allocated so far. Chunks are kept for reuse, the
+    // oldest first, until `retainBytes` is reached.
+    void reset() {
+        size_t kept = 0, n = 0;
+        for (auto& c : m_chunks)
+        {
+            if (kept + c.size <= m_retainBytes || n == 0)
+            {
+                kept += c.size;
+                m_chunks[n++] = c;
+            }
+            else
+            {
+                ::operator delete(c.data);
+            }
+        }
+        m_chunks.resize(n);
+        m_current = 0;
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    // Bytes handed out since the last reset
+    size_t used() const { return m_used; }
+
+    // Bytes held in chunks
+    size_t capacity() const {
+        size_t n = 0;
+        for (const auto& c : m_chunks) n += c.size;
+        return n;
+    }
+
+    // Chunks obtained from the system over the arena's lifetime
+    uint64_t chunkAllocations() const { return m_chunkAllocations; }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        for (;;)
+        {
+            if (m_current < m_chunks.size())
+            {
+                Chunk& c = m_chunks[m_current];
+                const uintptr_t base = reinterpret_cast<uintptr_t>(c.data);
+                const size_t aligned = static_cast<size_t>(((base + m_offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base);
+                if (aligned + bytes <= c.size)
+                {
+                    m_offset = aligned + bytes;
+                    m_used += bytes;
+                    return c.data + aligned;
+                }
+                // Try the next retained chunk before asking for a new one
+                if (m_current + 1 < m_chunks.size())
+                {
+                    ++m_current;
+                    m_offset = 0;
+                    continue;
+                }
+            }
+            const size_t size = std::max(m_chunkBytes, bytes + alignment);
+            m_chunks.push_back(Chunk{static_cast<char*>(::operator new(size)), size});
+            ++m_chunkAllocations;
+            m_current = m_chunks.size() - 1;
+            m_offset = 0;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    struct Chunk {
+        char* data;
+        size_t size;
+    };
+
+    size_t m_chunkBytes;
+    size_t m_retainBytes;
+    std::vector<Chunk> m_chunks;
+    size_t m_current = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0;
+    uint64_t m_chunkAllocations = 0;
+};
+
+struct ArenaReset {
+    void operator()(MonotonicArena& arena) const { arena.reset(); }
+};
+
+// Recycles arenas between batches (see object_pool.h)
+class ArenaPool : public ObjectPool<MonotonicArena, ArenaReset> {
+public:
+    // Keeps at most `maxIdle` reset arenas around
+    explicit ArenaPool(size_t maxIdle = 8, size_t chunkBytes = 64 << 10, size_t retainBytes = 4 << 20)
+        : ObjectPool(maxIdle, [chunkBytes, retainBytes]() {
+              return std::make_unique<MonotonicArena>(chunkBytes, retainBytes);
+          }) {}
+};
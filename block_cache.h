@@ -0,0 +1,232 @@
+// MiniGridMonitor - sharded cache of decoded blocks with TinyLFU admission
+//
+// History browsing, charts, exports and range queries keep re-reading the
+// same recent blocks. Blocks are cached decoded, keyed by (file number,
+// block offset), and handed out as shared_ptr<const Block>: readers share
+// one decoded copy, and an evicted block stays valid until its last
+// reader lets go.
+//
+// Each shard keeps a small LRU admission window in front of a main LRU.
+// When the window overflows, its oldest entry only displaces the main
+// LRU's victim if a count-min sketch says it has been asked for more
+// often (W-TinyLFU), so one long export scan cannot flush the blocks the
+// dashboard keeps using.
+#pragma once
+
+#include "fleet_sketches.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename Block>
+class BlockCache {
+public:
+    using Handle = std::shared_ptr<const Block>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t admitted = 0;   // window entries promoted to the main LRU
+        uint64_t rejected = 0;   // window entries that lost to the main victim
+        uint64_t evictions = 0;  // main entries displaced
+        size_t bytes = 0;
+        size_t entries = 0;
+
+        double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+    };
+
+    // `capacityBytes` is split evenly across shards; each shard gives 1% of
+    // its share to the admission window
+    explicit BlockCache(size_t capacityBytes, size_t shardCount = 16)
+        : m_shards(std::max<size_t>(shardCount, 1)) {
+        const size_t perShard = capacityBytes / m_shards.size();
+        for (auto& s : m_shards)
+        {
+            s.windowCapacity = std::max<size_t>(perShard / 100, 1);
+            s.mainCapacity = perShard - std::min(perShard, s.windowCapacity);
+            // Sized for ~4 KB blocks; aged after 10 accesses per counter column
+            const size_t width = std::max<size_t>(256, 4 * (perShard / 4096));
+            s.sketch = CountMinSketch(width, 4);
+            s.sampleSize = 10 * width;
+        }
+    }
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // Null on a miss. Every lookup counts toward the key's frequency.
+    Handle lookup(uint64_t file, uint64_t offset) {
+        const uint64_t h = hashKey(file, offset);
+        Shard& s = shard(h);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        record(s, h);
+        auto it = s.index.find(Key{file, offset});
+        if (it == s.index.end())
+        {
+            ++s.misses;
+            return nullptr;
+        }
+        ++s.hits;
+        Node& n = *it->second;
+        std::list<Node>& list = n.inWindow ? s.window : s.main;
+        list.splice(list.begin(), list, it->second);
+        return n.block;
+    }
+
+    // Offers a freshly decoded block. Returns its handle whether or not it
+    // ends up cached; `charge` is its approximate size in bytes.
+    Handle insert(uint64_t file, uint64_t offset, Block block, size_t charge) {
+        Handle handle = std::make_shared<const Block>(std::move(block));
+        const uint64_t h = hashKey(file, offset);
+        Shard& s = shard(h);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const Key key{file, offset};
+        auto existing = s.index.find(key);
+        if (existing != s.index.end()) return existing->second->block; // raced with another loader
+        s.window.push_front(Node{key, h, handle, charge, true});
+        s.index[key] = s.window.begin();
+        s.windowBytes += charge;
+        while (s.windowBytes > s.windowCapacity && !s.window.empty()) promoteOrReject(s);
+        return handle;
+    }
+
+    // lookup(), else load() -> std::pair<Block, size_t charge> and insert()
+    template <typename Load>
+    Handle getOrLoad(uint64_t file, uint64_t offset, Load&& load) {
+        if (Handle h = lookup(file, offset)) return h;
+        auto loaded = load();
+        return insert(file, offset, std::move(loaded.first), loaded.second);
+    }
+
+    // Drops every block of a file (e.g. once the file is deleted)
+    void eraseFile(uint64_t file) {
+        for (auto& s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (auto it = s.index.begin(); it != s.index.end();)
+            {
+                if (it->first.file != file) { ++it; continue; }
+                Node& n = *it->second;
+                (n.inWindow ? s.windowBytes : s.mainBytes) -= n.charge;
+                (n.inWindow ? s.window : s.main).erase(it->second);
+                it = s.index.erase(it);
+            }
+        }
+    }
+
+    Stats stats() const {
+        Stats total;
+        for (auto& s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            total.hits += s.hits;
+            total.misses += s.misses;
+            total.admitted += s.admitted;
+            total.rejected += s.rejected;
+            total.evictions += s.evictions;
+            total.bytes += s.windowBytes + s.mainBytes;
+            total.entries += s.index.size();
+        }
+        return total;
+    }
+
+private:
+    struct Key {
+        uint64_t file;
+        uint64_t offset;
+        bool operator==(const Key& o) const { return file == o.file && offset == o.offset; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const { return static_cast<size_t>(hashKey(k.file, k.offset)); }
+    };
+
+    struct Node {
+        Key key;
+        uint64_t hash;
+        Handle block;
+        size_t charge;
+        bool inWindow;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Node> window;  // most recent first
+        std::list<Node> main;
+        std::unordered_map<Key, typename std::list<Node>::iterator, KeyHash> index;
+        size_t windowBytes = 0;
+        size_t mainBytes = 0;
+        size_t windowCapacity = 0;
+        size_t mainCapacity = 0;
+        CountMinSketch sketch{256, 4};
+        size_t samples = 0;
+        size_t sampleSize = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        uint64_t evictions = 0;
+    };
+
+    static uint64_t hashKey(uint64_t file, uint64_t offset) {
+        uint64_t h = file * 0x9e3779b97f4a7c15ull ^ offset;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    Shard& shard(uint64_t hash) { return m_shards[(hash >> 48) % m_shards.size()]; }
+
+    static void record(Shard& s, uint64_t hash) {
+        s.sketch.add(hash);
+        if (++s.samples >= s.sampleSize)
+        {
+            s.sketch.halve();
+            s.samples /= 2;
+        }
+    }
+
+    // Moves the window's oldest entry into the main LRU if there is room or
+    // it is more popular than the main LRU's victims; otherwise drops it
+    static void promoteOrReject(Shard& s) {
+        auto candidate = std::prev(s.window.end());
+        s.windowBytes -= candidate->charge;
+        const uint32_t freq = s.sketch.estimate(candidate->hash);
+        std::vector<typename std::list<Node>::iterator> victims;
+        size_t freed = 0;
+        for (auto v = s.main.end(); s.mainBytes - freed + candidate->charge > s.mainCapacity && v != s.main.begin();)
+        {
+            --v;
+            if (s.sketch.estimate(v->hash) >= freq) break;
+            victims.push_back(v);
+            freed += v->charge;
+        }
+        if (s.mainBytes - freed + candidate->charge > s.mainCapacity)
+        {
+            s.index.erase(candidate->key);
+            s.window.erase(candidate);
+            ++s.rejected;
+            return;
+        }
+        for (auto v : victims)
+        {
+            s.mainBytes -= v->charge;
+            s.index.erase(v->key);
+            s.main.erase(v);
+            ++s.evictions;
+        }
+        candidate->inWindow = false;
+        s.main.splice(s.main.begin(), s.window, candidate);
+        s.mainBytes += candidate->charge;
+        ++s.admitted;
+    }
+
+    std::vector<Shard> m_shards;
+};
@@ -0,0 +1,853 @@
+// MiniGridMonitor - page-based B+tree index over an append-only devices.csv
+//
+// The CSV segment stays the system of record. Its index file
+// (devices.csv -> devices.csv.idx) maps (device, created_at) to the byte
+// offset of each row, so "device X between T1 and T2" is a root-to-leaf
+// descent plus a walk along linked leaves, however long the history.
+//
+// Device ids are interned to dense codes; the code list is kept in a
+// second sidecar (devices.csv.idx.names, one id per line). Pages are 4 KB
+// and go through a clock-replacement buffer pool. The index is a cache:
+// a crash while it is being written leaves it marked unclean and it is
+// rebuilt from the segment on the next open.
+#pragma once
+
+#include "amendments.h"
+#include "csv_projection.h"
+#include "device_record.h"
+#include "file_sync.h"
+#include "string_interner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct BTreeKey {
+    uint32_t device = 0;  // interned device id
+    int64_t time = 0;     // created_at, seconds since the epoch
+    uint64_t offset = 0;  // row offset in the segment; makes keys unique
+
+    bool operator<(const BTreeKey& o) const {
+        if (device != o.device) return device < o.device;
+        if (time != o.time) return time < o.time;
+        return offset < o.offset;
+    }
+    bool operator<=(const BTreeKey& o) const { return !(o < *this); }
+};
+
+namespace btree_detail {
+
+static const uint32_t kPageSize = 4096;
+static const uint32_t kNoPage = UINT32_MAX;
+static const size_t kKeyBytes = 20;
+static const size_t kHeaderBytes = 8;
+// Leaf: header (type, count, next leaf), then keys
+static const size_t kLeafCapacity = (kPageSize - kHeaderBytes) / kKeyBytes;
+// Internal: header (type, count, child 0), then (key, right child) pairs
+static const size_t kInternalCapacity = (kPageSize - kHeaderBytes) / (kKeyBytes + 4);
+
+inline std::FILE* open_file(const std::string& path, bool truncate)
+{
+    std::FILE* f = truncate ? nullptr : std::fopen(path.c_str(), "r+b");
+    if (!f) f = std::fopen(path.c_str(), "w+b");
+    if (!f)
+        throw std::runtime_error("unable to open file for writing: " + path);
+    return f;
+}
+
+inline void seek(std::FILE* f, uint64_t offset)
+{
+#ifdef _WIN32
+    _fseeki64(f, static_cast<int64_t>(offset), SEEK_SET);
+#else
+    fseeko(f, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+// Fixed-layout view over one node page
+struct Node {
+    char* p;
+
+    bool leaf() const { return p[0] == 1; }
+    uint16_t count() const { uint16_t c; std::memcpy(&c, p + 2, 2); return c; }
+    void setCount(size_t c) { uint16_t v = static_cast<uint16_t>(c); std::memcpy(p + 2, &v, 2); }
+    // Next leaf for leaves, leftmost child for internal nodes
+    uint32_t link() const { uint32_t v; std::memcpy(&v, p + 4, 4); return v; }
+    void setLink(uint32_t v) { std::memcpy(p + 4, &v, 4); }
+
+    void init(bool isLeaf, uint32_t linkValue) {
+        std::memset(p, 0, kPageSize);
+        p[0] = isLeaf ? 1 : 2;
+        setLink(linkValue);
+    }
+
+    size_t stride() const { return leaf() ? kKeyBytes : kKeyBytes + 4; }
+    char* slot(size_t i) const { return p + kHeaderBytes + i * stride(); }
+
+    BTreeKey key(size_t i) const {
+        BTreeKey k;
+        const char* s = slot(i);
+        std::memcpy(&k.device, s, 4);
+        std::memcpy(&k.time, s + 4, 8);
+        std::memcpy(&k.offset, s + 12, 8);
+        return k;
+    }
+    void setKey(size_t i, const BTreeKey& k) {
+        char* s = slot(i);
+        std::memcpy(s, &k.device, 4);
+        std::memcpy(s + 4, &k.time, 8);
+        std::memcpy(s + 12, &k.offset, 8);
+    }
+
+    // Internal nodes: child(0) is link(), child(i) sits right of key(i - 1)
+    uint32_t child(size_t i) const {
+        if (i == 0) return link();
+        uint32_t v;
+        std::memcpy(&v, slot(i - 1) + kKeyBytes, 4);
+        return v;
+    }
+    void setRightChild(size_t keyIndex, uint32_t page) { std::memcpy(slot(keyIndex) + kKeyBytes, &page, 4); }
+
+    // First slot whose key is >= k (leaves) or > k (internal descent)
+    size_t lowerBound(const BTreeKey& k) const {
+        size_t lo = 0, hi = count();
+        while (lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if (key(mid) < k) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    size_t upperBound(const BTreeKey& k) const {
+        size_t lo = 0, hi = count();
+        while (lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if (key(mid) <= k) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    void insertSlot(size_t i) {
+        std::memmove(slot(i + 1), slot(i), (count() - i) * stride());
+        setCount(count() + 1);
+    }
+};
+
+} // namespace btree_detail
+
+// Fixed set of page frames over one file with clock (second chance)
+// replacement. Pinned frames are never evicted; dirty frames are written
+// back on eviction and by flush(). Not thread-safe; BTreeIndex serializes.
+class BufferPool {
+public:
+    BufferPool(std::FILE* file, std::string path, size_t frames)
+        : m_file(file), m_path(std::move(path)), m_frames(std::max<size_t>(frames, 8)),
+          m_data(m_frames.size() * btree_detail::kPageSize) {}
+
+    // Pins `page` and returns its bytes. `fresh` skips the read for a page
+    // that has just been allocated past the end of the file.
+    char* pin(uint32_t page, bool fresh = false) {
+        auto it = m_table.find(page);
+        if (it != m_table.end())
+        {
+            Frame& f = m_frames[it->second];
+            f.referenced = true;
+            ++f.pins;
+            ++m_hits;
+            return frameData(it->second);
+        }
+        ++m_misses;
+        const size_t victim = evict();
+        Frame& f = m_frames[victim];
+        char* data = frameData(victim);
+        if (fresh)
+        {
+            std::memset(data, 0, btree_detail::kPageSize);
+        }
+        else
+        {
+            btree_detail::seek(m_file, uint64_t(page) * btree_detail::kPageSize);
+            if (std::fread(data, 1, btree_detail::kPageSize, m_file) != btree_detail::kPageSize)
+                throw std::runtime_error("unable to read index page from " + m_path);
+        }
+        f.page = page;
+        f.pins = 1;
+        f.dirty = fresh;
+        f.referenced = true;
+        m_table[page] = victim;
+        return data;
+    }
+
+    void unpin(uint32_t page, bool dirty) {
+        Frame& f = m_frames[m_table.at(page)];
+        f.dirty = f.dirty || dirty;
+        --f.pins;
+    }
+
+    // Writes every dirty frame, in page order so the writes are sequential
+    void flush() {
+        std::vector<size_t> dirty;
+        for (size_t i = 0; i < m_frames.size(); ++i)
+        {
+            if (m_frames[i].dirty) dirty.push_back(i);
+        }
+        std::sort(dirty.begin(), dirty.end(), [this](size_t a, size_t b) { return m_frames[a].page < m_frames[b].page; });
+        for (size_t i : dirty) writeBack(i);
+    }
+
+    // Forgets every frame without writing it
+    void discard() {
+        for (auto& f : m_frames) f = Frame();
+        m_table.clear();
+    }
+
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+private:
+    struct Frame {
+        uint32_t page = btree_detail::kNoPage;
+        int pins = 0;
+        bool dirty = false;
+        bool referenced = false;
+    };
+
+    char* frameData(size_t i) { return m_data.data() + i * btree_detail::kPageSize; }
+
+    size_t evict() {
+        // Two full sweeps clear every reference bit; a third finding
+        // nothing means every frame is pinned
+        for (size_t step = 0; step < 3 * m_frames.size(); ++step)
+        {
+            const size_t i = m_hand;
+            m_hand = (m_hand + 1) % m_frames.size();
+            Frame& f = m_frames[i];
+            if (f.page == btree_detail::kNoPage) return i;
+            if (f.pins > 0) continue;
+            if (f.referenced) { f.referenced = false; continue; }
+            if (f.dirty) writeBack(i);
+            m_table.erase(f.page);
+            f = Frame();
+            return i;
+        }
+        throw std::runtime_error("index buffer pool exhausted: every page is pinned");
+    }
+
+    void writeBack(size_t i) {
+        Frame& f = m_frames[i];
+        btree_detail::seek(m_file, uint64_t(f.page) * btree_detail::kPageSize);
+        if (std::fwrite(frameData(i), 1, btree_detail::kPageSize, m_file) != btree_detail::kPageSize)
+            throw std::runtime_error("unable to write file: " + m_path);
+        f.dirty = false;
+    }
+
+    std::FILE* m_file;
+    std::string m_path;
+    std::vector<Frame> m_frames;
+    std::vector<char> m_data;
+    std::unordered_map<uint32_t, size_t> m_table; // page -> frame
+    size_t m_hand = 0;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+};
+
+// The index file. Page 0 is the meta page; the tree starts as a single
+// empty leaf in page 1.
+class BTreeIndex {
+public:
+    struct Entry {
+        std::string deviceId;
+        int64_t time = 0;
+        uint64_t offset = 0;
+    };
+
+    explicit BTreeIndex(const std::string& path, size_t poolPages = 1024)
+        : m_path(path), m_namesPath(path + ".names"), m_poolPages(poolPages), m_names(std::make_unique<StringInterner>()) {
+        m_file = btree_detail::open_file(m_path, false);
+        m_pool = std::make_unique<BufferPool>(m_file, m_path, poolPages);
+        if (!readMeta()) reset();
+    }
+
+    ~BTreeIndex() {
+        try {
+            flush();
+        }
+        catch (const std::exception&) {
+            // Left unclean; rebuilt on the next open
+        }
+        m_pool.reset();
+        std::fclose(m_file);
+    }
+
+    BTreeIndex(const BTreeIndex&) = delete;
+    BTreeIndex& operator=(const BTreeIndex&) = delete;
+
+    // Replaces the contents with `entries`, which need not be sorted. Leaves
+    // are packed full and written left to right, then each internal level
+    // is built over the one below.
+    void bulkLoad(const std::vector<Entry>& entries) {
+        using namespace btree_detail;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<BTreeKey> keys;
+        keys.reserve(entries.size());
+        for (const auto& e : entries) keys.push_back(BTreeKey{intern(e.deviceId), e.time, e.offset});
+        std::sort(keys.begin(), keys.end());
+
+        markUnclean();
+        m_pool->discard();
+        m_pages = 1;
+        std::vector<std::pair<BTreeKey, uint32_t>> level; // (first key, page)
+        for (size_t i = 0; i < keys.size() || level.empty(); i += kLeafCapacity)
+        {
+            const uint32_t page = m_pages++;
+            Node n{m_pool->pin(page, true)};
+            n.init(true, kNoPage);
+            const size_t end = std::min(keys.size(), i + kLeafCapacity);
+            for (size_t k = i; k < end; ++k) n.setKey(k - i, keys[k]);
+            n.setCount(end - i);
+            if (!level.empty())
+            {
+                Node prev{m_pool->pin(level.back().second)};
+                prev.setLink(page);
+                m_pool->unpin(level.back().second, true);
+            }
+            m_pool->unpin(page, true);
+            level.emplace_back(i < keys.size() ? keys[i] : BTreeKey(), page);
+        }
+        m_height = 1;
+        while (level.size() > 1)
+        {
+            std::vector<std::pair<BTreeKey, uint32_t>> parents;
+            for (size_t i = 0; i < level.size(); i += kInternalCapacity + 1)
+            {
+                const uint32_t page = m_pages++;
+                Node n{m_pool->pin(page, true)};
+                n.init(false, level[i].second);
+                const size_t end = std::min(level.size(), i + kInternalCapacity + 1);
+                for (size_t c = i + 1; c < end; ++c)
+                {
+                    n.setKey(c - i - 1, level[c].first);
+                    n.setRightChild(c - i - 1, level[c].second);
+                }
+                n.setCount(end - i - 1);
+                m_pool->unpin(page, true);
+                parents.emplace_back(level[i].first, page);
+            }
+            level.swap(parents);
+            ++m_height;
+        }
+        m_root = level.front().second;
+        m_entries = keys.size();
+    }
+
+    // Descends to the leaf covering the key. Keys arriving in time order
+    // for a device land at the right edge of its range, so a full leaf
+    // splits by starting a new one rather than halving: history packs
+    // densely instead of leaving half-empty pages behind.
+    void insert(const std::string& deviceId, int64_t time, uint64_t offset) {
+        using namespace btree_detail;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        markUnclean();
+        const BTreeKey key{intern(deviceId), time, offset};
+
+        std::vector<std::pair<uint32_t, size_t>> path; // (internal page, child taken)
+        uint32_t page = m_root;
+        for (uint32_t h = m_height; h > 1; --h)
+        {
+            Node n{m_pool->pin(page)};
+            const size_t c = n.upperBound(key);
+            const uint32_t next = n.child(c);
+            m_pool->unpin(page, false);
+            path.emplace_back(page, c);
+            page = next;
+        }
+
+        BTreeKey separator;
+        uint32_t right = splitInsertLeaf(page, key, separator);
+        while (right != kNoPage && !path.empty())
+        {
+            const auto parent = path.back();
+            path.pop_back();
+            right = splitInsertInternal(parent.first, parent.second, separator, right, separator);
+        }
+        if (right != kNoPage)
+        {
+            // Root split: the tree grows one level
+            const uint32_t root = m_pages++;
+            Node n{m_pool->pin(root, true)};
+            n.init(false, m_root);
+            n.setKey(0, separator);
+            n.setRightChild(0, right);
+            n.setCount(1);
+            m_pool->unpin(root, true);
+            m_root = root;
+            ++m_height;
+        }
+        ++m_entries;
+    }
+
+    void insert(const Entry& e) { insert(e.deviceId, e.time, e.offset); }
+
+    // Row offsets for `deviceId` with from <= created_at <= to, in time order
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(uint64_t offset)>& fn) {
+        using namespace btree_detail;
+        std::vector<uint64_t> offsets;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto code = m_names->find(deviceId);
+            if (code == StringInterner::kNone) return;
+            const BTreeKey lo{code, from, 0};
+            uint32_t page = m_root;
+            for (uint32_t h = m_height; h > 1; --h)
+            {
+                Node n{m_pool->pin(page)};
+                const uint32_t next = n.child(n.upperBound(lo));
+                m_pool->unpin(page, false);
+                page = next;
+            }
+            bool done = false;
+            while (!done && page != kNoPage)
+            {
+                Node n{m_pool->pin(page)};
+                for (size_t i = n.lowerBound(lo); i < n.count(); ++i)
+                {
+                    const BTreeKey k = n.key(i);
+                    if (k.device != code || k.time > to) { done = true; break; }
+                    offsets.push_back(k.offset);
+                }
+                const uint32_t next = n.link();
+                m_pool->unpin(page, false);
+                page = next;
+            }
+        }
+        for (uint64_t off : offsets) fn(off);
+    }
+
+    // Byte offset in the segment up to which rows are indexed
+    uint64_t indexedBytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_indexedBytes;
+    }
+
+    // Fingerprint of the segment bytes just before indexedBytes(), so a
+    // rewritten segment is noticed whatever its new size
+    uint64_t segmentCheck() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_segmentCheck;
+    }
+
+    void setIndexedBytes(uint64_t bytes, uint64_t segmentCheck) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        markUnclean();
+        m_indexedBytes = bytes;
+        m_segmentCheck = segmentCheck;
+    }
+
+    // Empties the index (e.g. when its segment was rewritten)
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        reset();
+    }
+
+    // Makes the index durable: dirty pages, then new device names, then
+    // the meta page marked clean
+    void flush() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_clean) return;
+        m_pool->flush();
+        sync_file(m_file, m_path);
+        if (m_savedNames < m_names->size())
+        {
+            std::FILE* f = std::fopen(m_namesPath.c_str(), "ab");
+            if (!f)
+                throw std::runtime_error("unable to open file for append: " + m_namesPath);
+            std::string text;
+            for (size_t i = m_savedNames; i < m_names->size(); ++i) text += csv_escape(m_names->name(static_cast<uint32_t>(i))) + '\n';
+            const bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+            sync_file(f, m_namesPath);
+            std::fclose(f);
+            if (!ok)
+                throw std::runtime_error("unable to write file: " + m_namesPath);
+            m_savedNames = m_names->size();
+        }
+        m_clean = true;
+        writeMeta();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries;
+    }
+
+    uint32_t height() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_height;
+    }
+
+    uint32_t pages() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pages;
+    }
+
+    uint64_t poolHits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pool->hits();
+    }
+
+    uint64_t poolMisses() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pool->misses();
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x4d47524250545231ull; // "MGRBPTR1"
+
+    uint32_t intern(const std::string& deviceId) { return m_names->intern(deviceId); }
+
+    // Inserts into a leaf; on overflow returns the new right sibling and
+    // its first key, otherwise kNoPage
+    uint32_t splitInsertLeaf(uint32_t page, const BTreeKey& key, BTreeKey& separator) {
+        using namespace btree_detail;
+        Node n{m_pool->pin(page)};
+        const size_t pos = n.lowerBound(key);
+        if (n.count() < kLeafCapacity)
+        {
+            n.insertSlot(pos);
+            n.setKey(pos, key);
+            m_pool->unpin(page, true);
+            return kNoPage;
+        }
+        // Appending the newest key of a device: keep the full leaf and start
+        // the new one with this key. Anything else splits in half, so keys
+        // filling a gap do not each get a page.
+        const size_t count = n.count();
+        bool append = pos == count;
+        if (append && n.link() != kNoPage)
+        {
+            Node next{m_pool->pin(n.link())};
+            append = next.count() == 0 || next.key(0).device != key.device;
+            m_pool->unpin(n.link(), false);
+        }
+        const uint32_t right = m_pages++;
+        Node r{m_pool->pin(right, true)};
+        r.init(true, n.link());
+        const size_t keep = append ? count : count / 2;
+        for (size_t i = keep; i < count; ++i) r.setKey(i - keep, n.key(i));
+        r.setCount(count - keep);
+        n.setCount(keep);
+        n.setLink(right);
+        Node& target = !append && pos <= keep ? n : r;
+        const size_t at = !append && pos <= keep ? pos : pos - keep;
+        target.insertSlot(at);
+        target.setKey(at, key);
+        separator = r.key(0);
+        m_pool->unpin(right, true);
+        m_pool->unpin(page, true);
+        return right;
+    }
+
+    // Adds (key, rightChild) after child `c` of an internal node; splits it
+    // when full, returning the new node and the key promoted to the parent
+    uint32_t splitInsertInternal(uint32_t page, size_t c, const BTreeKey& key, uint32_t rightChild, BTreeKey& promoted) {
+        using namespace btree_detail;
+        Node n{m_pool->pin(page)};
+        if (n.count() < kInternalCapacity)
+        {
+            n.insertSlot(c);
+            n.setKey(c, key);
+            n.setRightChild(c, rightChild);
+            m_pool->unpin(page, true);
+            return kNoPage;
+        }
+        std::vector<std::pair<BTreeKey, uint32_t>> all;
+        all.reserve(n.count() + 1);
+        for (size_t i = 0; i < n.count(); ++i) all.emplace_back(n.key(i), n.child(i + 1));
+        all.insert(all.begin() + static_cast<std::ptrdiff_t>(c), std::make_pair(key, rightChild));
+
+        // all[mid] moves up; its child becomes the new node's leftmost
+        const size_t mid = all.size() / 2;
+        const uint32_t right = m_pages++;
+        Node r{m_pool->pin(right, true)};
+        r.init(false, all[mid].second);
+        for (size_t i = mid + 1; i < all.size(); ++i)
+        {
+            r.setKey(i - mid - 1, all[i].first);
+            r.setRightChild(i - mid - 1, all[i].second);
+        }
+        r.setCount(all.size() - mid - 1);
+        for (size_t i = 0; i < mid; ++i)
+        {
+            n.setKey(i, all[i].first);
+            n.setRightChild(i, all[i].second);
+        }
+        n.setCount(mid);
+        promoted = all[mid].first;
+        m_pool->unpin(right, true);
+        m_pool->unpin(page, true);
+        return right;
+    }
+
+    // Meta page: magic, root, pages, height, clean flag, entries,
+    // indexed bytes, saved device names, segment check
+    void writeMeta() {
+        std::vector<char> meta(btree_detail::kPageSize, 0);
+        char* p = meta.data();
+        const uint32_t clean = m_clean ? 1 : 0;
+        const uint64_t names = m_savedNames;
+        std::memcpy(p, &kMagic, 8);
+        std::memcpy(p + 8, &m_root, 4);
+        std::memcpy(p + 12, &m_pages, 4);
+        std::memcpy(p + 16, &m_height, 4);
+        std::memcpy(p + 20, &clean, 4);
+        std::memcpy(p + 24, &m_entries, 8);
+        std::memcpy(p + 32, &m_indexedBytes, 8);
+        std::memcpy(p + 40, &names, 8);
+        std::memcpy(p + 48, &m_segmentCheck, 8);
+        btree_detail::seek(m_file, 0);
+        if (std::fwrite(meta.data(), 1, meta.size(), m_file) != meta.size())
+            throw std::runtime_error("unable to write file: " + m_path);
+        sync_file(m_file, m_path);
+    }
+
+    // False when the file is new, foreign or was not closed cleanly
+    bool readMeta() {
+        std::vector<char> meta(btree_detail::kPageSize, 0);
+        btree_detail::seek(m_file, 0);
+        if (std::fread(meta.data(), 1, meta.size(), m_file) != meta.size()) return false;
+        const char* p = meta.data();
+        uint64_t magic, names;
+        uint32_t clean;
+        std::memcpy(&magic, p, 8);
+        std::memcpy(&m_root, p + 8, 4);
+        std::memcpy(&m_pages, p + 12, 4);
+        std::memcpy(&m_height, p + 16, 4);
+        std::memcpy(&clean, p + 20, 4);
+        std::memcpy(&m_entries, p + 24, 8);
+        std::memcpy(&m_indexedBytes, p + 32, 8);
+        std::memcpy(&names, p + 40, 8);
+        std::memcpy(&m_segmentCheck, p + 48, 8);
+        if (magic != kMagic || clean != 1 || m_root == 0 || m_root >= m_pages) return false;
+
+        std::ifstream in(m_namesPath, std::ios::in | std::ios::binary);
+        std::string record;
+        while (m_names->size() < names && read_csv_record(in, record))
+        {
+            const auto cols = parse_csv_line(record);
+            m_names->intern(cols.empty() ? std::string() : cols[0]);
+        }
+        if (m_names->size() != names) return false;
+        m_savedNames = names;
+        m_clean = true;
+        return true;
+    }
+
+    // Truncates both files to an empty tree
+    void reset() {
+        using namespace btree_detail;
+        m_pool.reset();
+        std::fclose(m_file);
+        m_file = open_file(m_path, true);
+        std::FILE* names = open_file(m_namesPath, true);
+        std::fclose(names);
+        m_pool = std::make_unique<BufferPool>(m_file, m_path, m_poolPages);
+        m_names = std::make_unique<StringInterner>();
+        m_savedNames = 0;
+        m_root = 1;
+        m_pages = 2;
+        m_height = 1;
+        m_entries = 0;
+        m_indexedBytes = 0;
+        m_segmentCheck = 0;
+        Node n{m_pool->pin(1, true)};
+        n.init(true, kNoPage);
+        m_pool->unpin(1, true);
+        m_clean = false;
+        flushUnlocked();
+    }
+
+    void flushUnlocked() {
+        m_pool->flush();
+        sync_file(m_file, m_path);
+        m_clean = true;
+        writeMeta();
+    }
+
+    // Before the first page write after a clean state, record on disk that
+    // the file is being modified
+    void markUnclean() {
+        if (!m_clean) return;
+        m_clean = false;
+        writeMeta();
+    }
+
+    std::string m_path;
+    std::string m_namesPath;
+    std::FILE* m_file = nullptr;
+    size_t m_poolPages = 1024;
+    std::unique_ptr<BufferPool> m_pool;
+    mutable std::mutex m_mutex;
+    std::unique_ptr<StringInterner> m_names; // device id <-> code, replaced on reset
+    size_t m_savedNames = 0;
+    uint32_t m_root = 1;
+    uint32_t m_pages = 2;
+    uint32_t m_height = 1;
+    uint64_t m_entries = 0;
+    uint64_t m_indexedBytes = 0;
+    uint64_t m_segmentCheck = 0;
+    bool m_clean = false;
+};
+
+// A segment plus its index. catchUp() indexes rows appended since the last
+// call (bulk-loading the first time); query() reads only the matching rows.
+class SegmentIndex {
+public:
+    explicit SegmentIndex(const std::string& segmentPath, size_t poolPages = 1024)
+        : m_segment(segmentPath), m_index(segmentPath + ".idx", poolPages) {}
+
+    // Returns the number of rows indexed. A row is indexed once its line
+    // is complete; a torn tail is picked up by a later call.
+    size_t catchUp() {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::exists(m_segment, ec) ? std::filesystem::file_size(m_segment, ec) : 0;
+        // A compacted segment may be shorter, equal or longer than the
+        // watermark, so compare the bytes just before it as well
+        const uint64_t indexed = m_index.indexedBytes();
+        if (size < indexed || (indexed > 0 && segmentCheck(indexed) != m_index.segmentCheck())) m_index.clear();
+        if (size == m_index.indexedBytes()) return 0;
+
+        std::ifstream in(m_segment, std::ios::in | std::ios::binary);
+        if (!in) return 0;
+        const uint64_t start = m_index.indexedBytes();
+        const bool bulk = start == 0;
+        std::vector<BTreeIndex::Entry> entries;
+        size_t rows = 0;
+
+        CsvProjection projection({"device_id", "created_at"});
+        if (!bindHeader(in, projection)) return 0;
+        if (start > 0) in.seekg(static_cast<std::streamoff>(start));
+        uint64_t offset = static_cast<uint64_t>(in.tellg());
+        std::string record;
+        std::vector<std::string> values;
+        while (read_csv_record(in, record))
+        {
+            if (in.eof()) break; // no trailing newline yet
+            const uint64_t rowOffset = offset;
+            offset = static_cast<uint64_t>(in.tellg());
+            int64_t ts;
+            if (record.empty() || projection.project(record, values) < projection.span()) continue;
+            if (!parse_timestamp(values[1], ts)) continue;
+            if (bulk) entries.push_back(BTreeIndex::Entry{values[0], ts, rowOffset});
+            else m_index.insert(values[0], ts, rowOffset);
+            ++rows;
+        }
+        if (bulk) m_index.bulkLoad(entries);
+        if (offset != start)
+        {
+            m_index.setIndexedBytes(offset, segmentCheck(offset));
+            m_index.flush();
+        }
+        return rows;
+    }
+
+    // Rows of `deviceId` with from <= created_at <= to, with the segment's
+    // corrections applied. Rows starting at or past `below` are skipped.
+    void query(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn,
+               uint64_t below = UINT64_MAX) {
+        std::ifstream in(m_segment, std::ios::in | std::ios::binary);
+        if (!in) return;
+        CsvProjection projection(device_csv_columns());
+        if (!bindHeader(in, projection)) return;
+        AmendmentIndex amendments;
+        if (!amendments.load(amendment_path(m_segment)))
+            throw std::runtime_error("unable to read corrections: " + amendment_path(m_segment));
+
+        std::string record;
+        std::vector<std::string> values;
+        m_index.scan(deviceId, from, to, [&](uint64_t offset) {
+            if (offset >= below) return;
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(offset));
+            DeviceRecord rec;
+            if (!read_csv_record(in, record)) return;
+            projection.project(record, values);
+            if (amendments.apply(values) && from_csv_row(values, rec)) fn(std::move(rec));
+        });
+    }
+
+    // Rows that start in [begin, end) of the segment, filtered and corrected
+    // like query() (empty `deviceId` = every device). Reads the byte range
+    // sequentially without the index; `end` must be on a row boundary.
+    void scanBytes(const std::string& deviceId, int64_t from, int64_t to, uint64_t begin, uint64_t end,
+                   const std::function<void(DeviceRecord&&)>& fn) {
+        std::ifstream in(m_segment, std::ios::in | std::ios::binary);
+        if (!in) return;
+        CsvProjection projection(device_csv_columns());
+        if (!bindHeader(in, projection)) return;
+        if (begin > static_cast<uint64_t>(in.tellg())) in.seekg(static_cast<std::streamoff>(begin));
+        AmendmentIndex amendments;
+        if (!amendments.load(amendment_path(m_segment)))
+            throw std::runtime_error("unable to read corrections: " + amendment_path(m_segment));
+
+        const DeviceColumnIndex& col = device_columns();
+        std::string record;
+        std::vector<std::string> values;
+        while (static_cast<uint64_t>(in.tellg()) < end && read_csv_record(in, record))
+        {
+            int64_t ts;
+            if (record.empty() || projection.project(record, values) < projection.span()) continue;
+            if (!amendments.apply(values)) continue;
+            if (!deviceId.empty() && values[col.deviceId] != deviceId) continue;
+            if (!parse_timestamp(values[col.createdAt], ts) || ts < from || ts > to) continue;
+            DeviceRecord rec;
+            if (from_csv_row(values, rec)) fn(std::move(rec));
+        }
+    }
+
+    BTreeIndex& index() { return m_index; }
+
+private:
+    static constexpr size_t kCheckBytes = 256;
+
+    // FNV-1a over the (up to) kCheckBytes ending at `end`. Those bytes
+    // close the last indexed row, which moves or changes whenever any row
+    // before it is rewritten.
+    uint64_t segmentCheck(uint64_t end) const {
+        std::ifstream in(m_segment, std::ios::in | std::ios::binary);
+        const uint64_t begin = end > kCheckBytes ? end - kCheckBytes : 0;
+        char bytes[kCheckBytes];
+        in.seekg(static_cast<std::streamoff>(begin));
+        in.read(bytes, static_cast<std::streamsize>(end - begin));
+        const size_t n = static_cast<size_t>(in.gcount());
+        uint64_t h = 1469598103934665603ull ^ end;
+        for (size_t i = 0; i < n; ++i)
+        {
+            h ^= static_cast<unsigned char>(bytes[i]);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    static bool bindHeader(std::ifstream& in, CsvProjection& projection) {
+        std::string record;
+        if (in.peek() == 0xEF) in.ignore(3);
+        if (!read_csv_record(in, record)) return false;
+        projection.bind(parse_csv_line(record), device_csv_columns());
+        return true;
+    }
+
+    std::string m_segment;
+    BTreeIndex m_index;
+};
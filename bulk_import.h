@@ -0,0 +1,94 @@
+// MiniGridMonitor - bulk import of a devices.csv export into a record sink
+//
+// Rows are parsed into RecordArenaBatch batches: field text, record
+// structs and rejection messages all live in the batch's pooled arena and
+// are dropped together once the batch is synced. The line, record and
+// projected-field buffers are reused across rows, so after the first few
+// batches an import runs without per-row allocations.
+#pragma once
+
+#include "arena.h"
+#include "csv_projection.h"
+#include "device_record.h"
+#include "record_arena.h"
+#include "record_sink.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ImportResult {
+    size_t rows = 0;      // appended and synced
+    size_t rejected = 0;
+    size_t batches = 0;
+};
+
+// Appends every valid data row of `path` to `sink`, syncing after each
+// `batchRows` rows. Rows without a uuid, device_id or parseable created_at
+// are skipped and reported through onError(line, message), lines counting
+// CSV records from the header; the message is only valid during the call.
+// Throws if the file cannot be opened or the sink fails.
+inline ImportResult import_csv(const std::string& path, RecordSink& sink, ArenaPool& pool, size_t batchRows = 4096,
+                               const std::function<void(size_t, std::string_view)>& onError = {})
+{
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) throw std::runtime_error("unable to open import file: " + path);
+
+    ImportResult result;
+    // Skip the UTF-8 BOM some editors add, then map the header
+    if (in.peek() == 0xEF) in.ignore(3);
+    std::string record, line;
+    if (!read_csv_record(in, record, line)) return result;
+    CsvProjection projection(device_csv_columns());
+    const std::vector<std::string> header = parse_csv_line(record);
+    projection.bind(header, device_csv_columns());
+    const size_t minFields = std::min(header.size(), projection.span());
+
+    RecordArenaBatch batch(pool);
+    auto commit = [&] {
+        if (!batch.empty())
+        {
+            sink.append(batch);
+            sink.sync();
+            result.rows += batch.size();
+            ++result.batches;
+        }
+        if (onError)
+        {
+            for (const auto& r : batch.rejections()) onError(r.line, r.message);
+        }
+        result.rejected += batch.rejections().size();
+        batch.clear();
+    };
+
+    const DeviceColumnIndex& col = device_columns();
+    std::vector<std::string> values;
+    size_t lineNo = 1;
+    int64_t ts;
+    while (read_csv_record(in, record, line))
+    {
+        ++lineNo;
+        if (record.empty()) continue;
+        MonotonicArena& arena = batch.arena();
+        if (projection.project(record, values) < minFields)
+            batch.reject(lineNo, arena.format("line %zu: too few fields", lineNo));
+        else if (values[col.uuid].empty())
+            batch.reject(lineNo, arena.format("line %zu: missing uuid", lineNo));
+        else if (values[col.deviceId].empty())
+            batch.reject(lineNo, arena.format("line %zu: record %s has no device_id", lineNo, values[col.uuid].c_str()));
+        else if (!parse_timestamp(values[col.createdAt], ts))
+            batch.reject(lineNo, arena.format("line %zu: record %s has invalid created_at '%s'", lineNo,
+                                              values[col.uuid].c_str(), values[col.createdAt].c_str()));
+        else
+            from_csv_row(values, arena, batch.add());
+
+        if (batch.size() >= batchRows) commit();
+    }
+    commit();
+    return result;
+}
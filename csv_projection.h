@@ -0,0 +1,119 @@
+// MiniGridMonitor - read selected CSV columns by name without splitting whole rows
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Reads a fixed list of columns out of CSV records. bind() maps the
+// requested names to positions once per file; project() then walks each
+// record with memchr, copying only requested fields and skipping the rest
+// (quoted ones included) without unescaping them. Scanning stops after the
+// last requested column.
+class CsvProjection {
+public:
+    explicit CsvProjection(std::vector<std::string> columns)
+        : m_columns(std::move(columns)) {}
+
+    // `header` is the file's header row. A requested name the header lacks
+    // falls back to its position in `extendedSchema` when the header is a
+    // prefix of it: schemas only append columns, so rows written after an
+    // upgrade carry the newer trailing fields under the old header.
+    // Otherwise the column reads as empty.
+    void bind(const std::vector<std::string>& header, const std::vector<std::string>& extendedSchema = {}) {
+        bool prefix = header.size() <= extendedSchema.size();
+        for (size_t i = 0; prefix && i < header.size(); ++i) prefix = header[i] == extendedSchema[i];
+
+        m_positions.assign(m_columns.size(), -1);
+        m_last = -1;
+        for (size_t c = 0; c < m_columns.size(); ++c)
+        {
+            const std::vector<std::string>* sources[] = {&header, prefix ? &extendedSchema : nullptr};
+            for (const auto* src : sources)
+            {
+                if (!src || m_positions[c] >= 0) continue;
+                for (size_t p = 0; p < src->size(); ++p)
+                {
+                    if ((*src)[p] == m_columns[c]) { m_positions[c] = static_cast<int>(p); break; }
+                }
+            }
+            m_last = std::max(m_last, m_positions[c]);
+        }
+        m_slotAt.assign(static_cast<size_t>(m_last + 1), -1);
+        m_duplicates.clear();
+        for (size_t c = 0; c < m_columns.size(); ++c)
+        {
+            const int p = m_positions[c];
+            if (p < 0) continue;
+            if (m_slotAt[p] < 0) m_slotAt[p] = static_cast<int>(c);
+            else m_duplicates.emplace_back(c, static_cast<size_t>(m_slotAt[p]));
+        }
+    }
+
+    const std::vector<std::string>& columns() const { return m_columns; }
+
+    // File position of each requested column, -1 when absent
+    const std::vector<int>& positions() const { return m_positions; }
+
+    // Number of fields project() needs to see in a complete record
+    size_t span() const { return static_cast<size_t>(m_last + 1); }
+
+    // Fills out[i] with requested column i (empty when absent). Returns how
+    // many fields the record had, counting at most span().
+    size_t project(std::string_view rec, std::vector<std::string>& out) const {
+        out.resize(m_columns.size());
+        for (auto& s : out) s.clear();
+        const char* p = rec.data();
+        const char* const end = p + rec.size();
+        size_t field = 0;
+        while (static_cast<int>(field) <= m_last)
+        {
+            const int slot = m_slotAt[field];
+            std::string* dst = slot >= 0 ? &out[slot] : nullptr;
+            if (p < end && *p == '"')
+            {
+                p = quoted(p + 1, end, dst);
+            }
+            const char* comma = static_cast<const char*>(std::memchr(p, ',', static_cast<size_t>(end - p)));
+            const char* stop = comma ? comma : end;
+            if (dst) dst->append(p, static_cast<size_t>(stop - p));
+            ++field;
+            if (!comma) break;
+            p = comma + 1;
+        }
+        for (const auto& d : m_duplicates) out[d.first] = out[d.second];
+        return field;
+    }
+
+private:
+    // Consumes a quoted field body starting after the opening quote; "" is
+    // an escaped quote. Returns the position after the closing quote.
+    static const char* quoted(const char* p, const char* end, std::string* dst) {
+        for (;;)
+        {
+            const char* q = static_cast<const char*>(std::memchr(p, '"', static_cast<size_t>(end - p)));
+            if (!q)
+            {
+                if (dst) dst->append(p, static_cast<size_t>(end - p));
+                return end;
+            }
+            if (dst) dst->append(p, static_cast<size_t>(q - p));
+            if (q + 1 < end && q[1] == '"')
+            {
+                if (dst) dst->push_back('"');
+                p = q + 2;
+                continue;
+            }
+            return q + 1;
+        }
+    }
+
+    std::vector<std::string> m_columns;
+    std::vector<int> m_positions;
+    std::vector<int> m_slotAt;   // file position -> requested column, -1 = skip
+    std::vector<std::pair<size_t, size_t>> m_duplicates; // (copy to, copy from)
+    int m_last = -1;
+};
@@ -0,0 +1,118 @@
+// MiniGridMonitor - readings per device, day and severity over any span
+//
+// The group count grows with devices x days, so multi-year reports run on
+// SpillingAggregator under a MemoryBudget; ranking groups by readings goes
+// through ExternalSorter on the same budget. Rows are streamed to the
+// caller and never collected.
+#pragma once
+
+#include "aggregate_kernels.h"
+#include "device_record.h"
+#include "spill.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+struct DeviceDayStats {
+    uint64_t readings = 0;
+    ColumnStats voltage;
+    ColumnStats temperature;
+
+    void add(const DeviceRecord& rec) {
+        ++readings;
+        voltage.add(rec.voltage);
+        temperature.add(rec.temperature);
+    }
+
+    void merge(const DeviceDayStats& o) {
+        readings += o.readings;
+        voltage.merge(o.voltage);
+        temperature.merge(o.temperature);
+    }
+
+    // Raw bytes; spill files are read back by the same build
+    void encode(std::string& out) const { out.append(reinterpret_cast<const char*>(this), sizeof(*this)); }
+    bool decode(std::string_view in) {
+        if (in.size() != sizeof(*this)) return false;
+        std::memcpy(this, in.data(), sizeof(*this));
+        return true;
+    }
+};
+
+static_assert(std::is_trivially_copyable<DeviceDayStats>::value, "encoded as raw bytes");
+
+struct DeviceDayRow {
+    std::string_view deviceId;
+    std::string_view day;      // YYYY-MM-DD
+    std::string_view severity; // as recorded, may be empty
+    const DeviceDayStats* stats;
+};
+
+class DeviceDayReport {
+public:
+    enum class Order {
+        Device,  // device, then day, then severity
+        Busiest  // most readings first, ties in Device order
+    };
+
+    explicit DeviceDayReport(MemoryBudget& budget, std::filesystem::path spillDir = std::filesystem::temp_directory_path())
+        : m_budget(budget), m_spillDir(spillDir), m_groups(budget, std::move(spillDir)) {}
+
+    // Rows without a parseable created_at have no day and are skipped. The
+    // day comes from the parsed time, so loosely written timestamps
+    // ("2026-3-1 ...") group with the rest of their day.
+    void add(const DeviceRecord& rec) {
+        int64_t ts;
+        if (!parse_timestamp(rec.createdAt, ts)) return;
+        m_key.assign(rec.deviceId);
+        m_key.push_back('\0');
+        m_key.append(format_day(ts));
+        m_key.push_back('\0');
+        m_key.append(rec.severity);
+        m_groups.update(m_key, [&](DeviceDayStats& s) { s.add(rec); });
+    }
+
+    // fn(row) once per group; the report is empty afterwards
+    void finish(Order order, const std::function<void(const DeviceDayRow&)>& fn) {
+        if (order == Order::Device)
+        {
+            m_groups.finish([&](std::string_view key, const DeviceDayStats& s) { fn(row(key, s)); });
+            return;
+        }
+        // Sort key: inverted big-endian count, then the group key
+        ExternalSorter sorter(m_budget, m_spillDir);
+        std::string sortKey, value;
+        m_groups.finish([&](std::string_view key, const DeviceDayStats& s) {
+            sortKey.clear();
+            for (int i = 7; i >= 0; --i) sortKey.push_back(static_cast<char>((~s.readings >> (8 * i)) & 0xff));
+            sortKey.append(key.data(), key.size());
+            value.clear();
+            s.encode(value);
+            sorter.add(sortKey, value);
+        });
+        DeviceDayStats s;
+        sorter.finish([&](std::string_view key, std::string_view encoded) {
+            if (!s.decode(encoded)) throw std::runtime_error("corrupt spill record");
+            fn(row(key.substr(8), s));
+        });
+    }
+
+    SpillingAggregator<DeviceDayStats>::Stats stats() const { return m_groups.stats(); }
+
+private:
+    static DeviceDayRow row(std::string_view key, const DeviceDayStats& s) {
+        const size_t a = key.find('\0');
+        const size_t b = key.find('\0', a + 1);
+        return DeviceDayRow{key.substr(0, a), key.substr(a + 1, b - a - 1), key.substr(b + 1), &s};
+    }
+
+    MemoryBudget& m_budget;
+    std::filesystem::path m_spillDir;
+    SpillingAggregator<DeviceDayStats> m_groups;
+    std::string m_key;
+};
@@ -0,0 +1,180 @@
+// MiniGridMonitor - device master data (ratings, model, location) and reading enrichment
+#pragma once
+
+#include "device_record.h"
+#include "epoch.h"
+#include "string_interner.h"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct DeviceMaster {
+    double ratedVoltage = NAN;
+    double thermalLimit = NAN;  // degrees C
+    std::string model;
+    std::string installDate;    // YYYY-MM-DD
+    std::string location;
+};
+
+// Per-reading values relative to the device's ratings; NaN where the
+// reading or the rating is missing.
+struct EnrichedReading {
+    double voltageDeviation = NAN; // (voltage - rated) / rated
+    double thermalPercent = NAN;   // temperature as % of thermal limit
+    const DeviceMaster* master = nullptr; // valid while the snapshot is held
+};
+
+// Immutable open-addressing table from interned device_id to master row.
+// Slots are 8 bytes (code, row) with linear probing at <= 50% load, so a
+// lookup is normally one cache line.
+class DeviceMasterTable {
+public:
+    DeviceMasterTable(std::vector<std::pair<uint32_t, DeviceMaster>> rows) {
+        size_t cap = 16;
+        while (cap < rows.size() * 2) cap <<= 1;
+        m_mask = cap - 1;
+        m_slots.assign(cap, Slot{StringInterner::kNone, 0});
+        m_rows.reserve(rows.size());
+        for (auto& r : rows)
+        {
+            size_t i = slotFor(r.first);
+            while (m_slots[i].code != StringInterner::kNone && m_slots[i].code != r.first) i = (i + 1) & m_mask;
+            if (m_slots[i].code == r.first)
+            {
+                m_rows[m_slots[i].row] = std::move(r.second); // last line wins
+                continue;
+            }
+            m_slots[i] = Slot{r.first, static_cast<uint32_t>(m_rows.size())};
+            m_rows.push_back(std::move(r.second));
+        }
+    }
+
+    const DeviceMaster* find(uint32_t code) const {
+        for (size_t i = slotFor(code);; i = (i + 1) & m_mask)
+        {
+            const Slot& s = m_slots[i];
+            if (s.code == code) return &m_rows[s.row];
+            if (s.code == StringInterner::kNone) return nullptr;
+        }
+    }
+
+    size_t size() const { return m_rows.size(); }
+
+private:
+    struct Slot {
+        uint32_t code;
+        uint32_t row;
+    };
+
+    size_t slotFor(uint32_t code) const {
+        return static_cast<size_t>((code * 0x9e3779b1u) >> 7) & m_mask;
+    }
+
+    size_t m_mask = 0;
+    std::vector<Slot> m_slots;
+    std::vector<DeviceMaster> m_rows;
+};
+
+// Master table shared with the commit path. reload() parses and builds a
+// new table off to the side and publishes it with one atomic pointer swap,
+// so ingest never waits on a refresh. A snapshot pins the epoch instead of
+// touching a reference count; the table it points at is freed only after
+// every snapshot taken before the swap is gone. Hold snapshots briefly
+// (one batch), on one thread.
+//
+// File format (header required):
+//     device_id,rated_voltage,thermal_limit,model,install_date,location
+class DeviceMasterCache {
+public:
+    class Snapshot {
+    public:
+        const DeviceMasterTable& operator*() const { return *m_table; }
+        const DeviceMasterTable* operator->() const { return m_table; }
+
+    private:
+        friend class DeviceMasterCache;
+        Snapshot(EpochDomain::Guard guard, const DeviceMasterTable* table)
+            : m_guard(std::move(guard)), m_table(table) {}
+
+        EpochDomain::Guard m_guard;
+        const DeviceMasterTable* m_table;
+    };
+
+    explicit DeviceMasterCache(StringInterner& devices)
+        : m_devices(devices),
+          m_table(std::make_unique<const DeviceMasterTable>(std::vector<std::pair<uint32_t, DeviceMaster>>())) {}
+
+    // Throws std::runtime_error if the file cannot be read; the previous
+    // table stays in place.
+    void reload(const std::string& path) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in)
+            throw std::runtime_error("unable to open device master file: " + path);
+
+        std::vector<std::pair<uint32_t, DeviceMaster>> rows;
+        std::string line;
+        bool header = true;
+        while (read_csv_record(in, line))
+        {
+            if (header) { header = false; continue; }
+            if (line.empty()) continue;
+            auto cols = parse_csv_line(line);
+            if (cols.empty() || cols[0].empty()) continue;
+            cols.resize(6);
+            DeviceMaster m;
+            m.ratedVoltage = parse_number(cols[1]);
+            m.thermalLimit = parse_number(cols[2]);
+            m.model = cols[3];
+            m.installDate = cols[4];
+            m.location = cols[5];
+            rows.emplace_back(m_devices.intern(cols[0]), std::move(m));
+        }
+        auto table = std::make_unique<const DeviceMasterTable>(std::move(rows));
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        m_table.publish(std::move(table));
+    }
+
+    Snapshot snapshot() const {
+        EpochDomain::Guard guard = m_table.domain().pin();
+        const DeviceMasterTable* table = m_table.load(guard);
+        return Snapshot(std::move(guard), table);
+    }
+
+    // Single reading; prefer enrich(batch) on hot paths
+    EnrichedReading enrich(const DeviceRecord& rec) const {
+        return enrich(*snapshot(), rec);
+    }
+
+    // One snapshot for the whole batch; out[i] pairs with batch[i]. The
+    // returned snapshot keeps every out[i].master pointer valid.
+    Snapshot enrich(const std::vector<DeviceRecord>& batch, std::vector<EnrichedReading>& out) const {
+        Snapshot table = snapshot();
+        out.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) out[i] = enrich(*table, batch[i]);
+        return table;
+    }
+
+    EnrichedReading enrich(const DeviceMasterTable& table, const DeviceRecord& rec) const {
+        EnrichedReading e;
+        const uint32_t code = m_devices.find(rec.deviceId);
+        if (code == StringInterner::kNone) return e;
+        e.master = table.find(code);
+        if (!e.master) return e;
+        if (e.master->ratedVoltage > 0)
+            e.voltageDeviation = (rec.voltage - e.master->ratedVoltage) / e.master->ratedVoltage;
+        if (e.master->thermalLimit > 0)
+            e.thermalPercent = 100.0 * rec.temperature / e.master->thermalLimit;
+        return e;
+    }
+
+private:
+    StringInterner& m_devices;
+    std::mutex m_reloadMutex; // one publisher at a time
+    RcuPtr<const DeviceMasterTable> m_table;
+};
@@ -0,0 +1,467 @@
+// MiniGridMonitor - device reading record and CSV helpers
+#pragma once
+
+#include "csv_projection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Location of an optional sampled waveform in the waveform heap
+// (waveform.h). Serialized as "offset:samples:rate"; empty = no capture.
+struct WaveformRef {
+    int64_t offset = -1;   // byte offset of the first float32 sample
+    uint32_t samples = 0;
+    float sampleRate = 0;  // Hz
+
+    bool empty() const { return offset < 0 || samples == 0; }
+};
+
+// One captured device reading. Mirrors a row of devices.csv.
+// Missing numeric values are NaN (voltage/temperature) or -1 (latency).
+struct DeviceRecord {
+    std::string uuid;
+    std::string createdAt;
+    std::string operatorId;
+    std::string instanceId;
+    std::string appVersion;
+    std::string deviceId;
+    std::string deviceName;
+    std::string status;
+    std::string actionType;
+    double voltage = NAN;
+    double temperature = NAN;
+    std::string severity;
+    int uiLatencyMs = -1;
+    std::string notes;
+    WaveformRef waveform;
+    // User-defined metrics as name -> raw value (see metrics_schema.h)
+    std::vector<std::pair<std::string, std::string>> metrics;
+};
+
+// devices.csv schema history. Versions only ever append columns:
+//   1  original 14 columns, through notes
+//   2  + waveform
+//   3  + metrics
+// A file's header row records its version; rows may run longer than the
+// header when the file was written to again after an upgrade.
+static const int kDeviceSchemaVersion = 3;
+
+static const char* const kDeviceCsvHeader =
+    "uuid,created_at,operator_id,instance_id,app_version,device_id,device_name,status,action_type,voltage,temperature,severity,ui_latency_ms,notes,waveform,metrics";
+
+inline std::string csv_escape(const std::string& s)
+{
+    bool needQuotes = false;
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == ',' || c == '\n' || c == '\r') { needQuotes = true; break; }
+    }
+    std::string out;
+    if (!needQuotes) return s;
+    out.push_back('"');
+    for (unsigned char c : s)
+    {
+        if (c == '"') out.append("\"\"");
+        else out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+inline std::vector<std::string> parse_csv_line(const std::string& line)
+{
+    std::vector<std::string> cols;
+    std::string cur;
+    bool inQuotes = false;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        char c = line[i];
+        if (inQuotes)
+        {
+            if (c == '"')
+            {
+                if (i + 1 < line.size() && line[i + 1] == '"')
+                {
+                    cur.push_back('"');
+                    ++i;
+                }
+                else
+                {
+                    inQuotes = false;
+                }
+            }
+            else
+            {
+                cur.push_back(c);
+            }
+        }
+        else
+        {
+            if (c == '"')
+            {
+                inQuotes = true;
+            }
+            else if (c == ',')
+            {
+                cols.push_back(cur);
+                cur.clear();
+            }
+            else
+            {
+                cur.push_back(c);
+            }
+        }
+    }
+    cols.push_back(cur);
+    return cols;
+}
+
+// Low=0 .. Critical=3, -1 for empty or unknown values
+inline int severity_rank(std::string_view severity)
+{
+    if (severity == "Low") return 0;
+    if (severity == "Medium") return 1;
+    if (severity == "High") return 2;
+    if (severity == "Critical") return 3;
+    return -1;
+}
+
+// Unknown=0, Online=1, Offline=2, Degraded=3 (form order); other values map to Unknown
+inline int status_index(std::string_view status)
+{
+    if (status == "Online") return 1;
+    if (status == "Offline") return 2;
+    if (status == "Degraded") return 3;
+    return 0;
+}
+
+// Empty string or garbage -> NaN
+inline double parse_number(const std::string& s)
+{
+    if (s.empty()) return NAN;
+    try {
+        return std::stod(s);
+    } catch (...) {
+        return NAN;
+    }
+}
+
+inline std::string format_number(double v)
+{
+    if (std::isnan(v)) return std::string();
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.10g", v);
+    return std::string(buf);
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Inverse of days_from_civil
+inline void civil_from_days(int64_t days, int64_t& y, unsigned& m, unsigned& d)
+{
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+// "YYYY-MM-DD" of the day holding `ts` (seconds since the epoch)
+inline std::string format_day(int64_t ts)
+{
+    const int64_t days = ts >= 0 ? ts / 86400 : -((-ts + 86399) / 86400);
+    int64_t y;
+    unsigned m, d;
+    civil_from_days(days, y, m, d);
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%04lld-%02u-%02u", static_cast<long long>(y), m, d);
+    return std::string(buf);
+}
+
+// "YYYY-MM-DD HH:MM:SS" (as written by current_timestamp) to seconds since
+// the epoch. The wall-clock value is taken as-is; no time zone is applied.
+inline bool parse_timestamp(std::string_view s, int64_t& out)
+{
+    // sscanf needs a terminated string; the fields fit well within 32 bytes
+    char text[32];
+    const size_t n = std::min(s.size(), sizeof(text) - 1);
+    if (n) std::memcpy(text, s.data(), n);
+    text[n] = '\0';
+    int y, mo, d, h, mi, sec;
+    if (std::sscanf(text, "%4d-%2d-%2d %2d:%2d:%2d", &y, &mo, &d, &h, &mi, &sec) != 6) return false;
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60) return false;
+    out = days_from_civil(y, static_cast<unsigned>(mo), static_cast<unsigned>(d)) * 86400 + h * 3600 + mi * 60 + sec;
+    return true;
+}
+
+// Encoded metrics column: "name=value;name=value". '%', ';' and '=' in
+// values are percent-escaped; names are written as-is and may not contain
+// them (MetricsSchema::load rejects such names). Appends onto `out`.
+inline void append_encoded_metrics(std::string& out, const std::vector<std::pair<std::string, std::string>>& metrics)
+{
+    bool first = true;
+    for (const auto& kv : metrics)
+    {
+        if (!first) out += ';';
+        first = false;
+        out += kv.first;
+        out += '=';
+        for (char c : kv.second)
+        {
+            if (c == '%') out += "%25";
+            else if (c == ';') out += "%3B";
+            else if (c == '=') out += "%3D";
+            else out += c;
+        }
+    }
+}
+
+inline std::string encode_metrics(const std::vector<std::pair<std::string, std::string>>& metrics)
+{
+    std::string out;
+    append_encoded_metrics(out, metrics);
+    return out;
+}
+
+inline std::vector<std::pair<std::string, std::string>> decode_metrics(const std::string& s)
+{
+    std::vector<std::pair<std::string, std::string>> out;
+    size_t pos = 0;
+    while (pos < s.size())
+    {
+        size_t end = s.find(';', pos);
+        if (end == std::string::npos) end = s.size();
+        size_t eq = s.find('=', pos);
+        if (eq != std::string::npos && eq < end)
+        {
+            std::string value;
+            for (size_t i = eq + 1; i < end; ++i)
+            {
+                if (s[i] == '%' && i + 2 < end)
+                {
+                    const std::string hex = s.substr(i + 1, 2);
+                    if (hex == "25") { value += '%'; i += 2; continue; }
+                    if (hex == "3B") { value += ';'; i += 2; continue; }
+                    if (hex == "3D") { value += '='; i += 2; continue; }
+                }
+                value += s[i];
+            }
+            out.emplace_back(s.substr(pos, eq - pos), std::move(value));
+        }
+        pos = end + 1;
+    }
+    return out;
+}
+
+// "offset:samples:rate", empty when there is no capture
+inline std::string format_waveform_ref(const WaveformRef& w)
+{
+    if (w.empty()) return std::string();
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%lld:%u:%.9g", static_cast<long long>(w.offset), w.samples, w.sampleRate);
+    return buf;
+}
+
+inline std::string to_csv_row(const DeviceRecord& r)
+{
+    std::string row;
+    row += csv_escape(r.uuid); row += ',';
+    row += csv_escape(r.createdAt); row += ',';
+    row += csv_escape(r.operatorId); row += ',';
+    row += csv_escape(r.instanceId); row += ',';
+    row += csv_escape(r.appVersion); row += ',';
+    row += csv_escape(r.deviceId); row += ',';
+    row += csv_escape(r.deviceName); row += ',';
+    row += csv_escape(r.status); row += ',';
+    row += csv_escape(r.actionType); row += ',';
+    row += format_number(r.voltage); row += ',';
+    row += format_number(r.temperature); row += ',';
+    row += csv_escape(r.severity); row += ',';
+    if (r.uiLatencyMs >= 0) row += std::to_string(r.uiLatencyMs);
+    row += ',';
+    row += csv_escape(r.notes); row += ',';
+    row += format_waveform_ref(r.waveform);
+    row += ',';
+    row += csv_escape(encode_metrics(r.metrics));
+    return row;
+}
+
+inline bool parse_waveform_ref(const std::string& s, WaveformRef& out)
+{
+    long long offset;
+    unsigned samples;
+    float rate;
+    if (std::sscanf(s.c_str(), "%lld:%u:%g", &offset, &samples, &rate) != 3 || offset < 0) return false;
+    out = WaveformRef{offset, samples, rate};
+    return true;
+}
+
+// Parse a devices.csv data row (header order). Returns false on short rows;
+// older rows stop before the waveform (14 fields) or metrics (15) column.
+inline bool from_csv_row(const std::vector<std::string>& cols, DeviceRecord& r)
+{
+    if (cols.size() < 14) return false;
+    r.uuid = cols[0];
+    r.createdAt = cols[1];
+    r.operatorId = cols[2];
+    r.instanceId = cols[3];
+    r.appVersion = cols[4];
+    r.deviceId = cols[5];
+    r.deviceName = cols[6];
+    r.status = cols[7];
+    r.actionType = cols[8];
+    r.voltage = parse_number(cols[9]);
+    r.temperature = parse_number(cols[10]);
+    r.severity = cols[11];
+    double lat = parse_number(cols[12]);
+    r.uiLatencyMs = std::isnan(lat) ? -1 : static_cast<int>(lat);
+    r.notes = cols[13];
+    r.waveform = WaveformRef();
+    if (cols.size() > 14) parse_waveform_ref(cols[14], r.waveform);
+    r.metrics.clear();
+    if (cols.size() > 15) r.metrics = decode_metrics(cols[15]);
+    return true;
+}
+
+// Reads one CSV record, joining physical lines while a quoted field is
+// open (notes may contain newlines). Strips a trailing '\r'. `line` is
+// scratch space, so a read loop can keep reusing one buffer.
+inline bool read_csv_record(std::istream& in, std::string& record, std::string& line)
+{
+    record.clear();
+    bool inQuotes = false;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        for (char c : line)
+        {
+            if (c == '"') inQuotes = !inQuotes;
+        }
+        record += line;
+        if (!inQuotes) return true;
+        record += '\n';
+    }
+    return !record.empty();
+}
+
+inline bool read_csv_record(std::istream& in, std::string& record)
+{
+    std::string line;
+    return read_csv_record(in, record, line);
+}
+
+// Current column names, in kDeviceCsvHeader order
+inline const std::vector<std::string>& device_csv_columns()
+{
+    static const std::vector<std::string> columns = parse_csv_line(kDeviceCsvHeader);
+    return columns;
+}
+
+// Column index in device_csv_columns(), -1 if unknown
+inline int device_column_index(const std::string& name)
+{
+    const auto& columns = device_csv_columns();
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (columns[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+// Positions in device_csv_columns() of the fields rows are checked and
+// filtered by, for code holding a full row of values
+struct DeviceColumnIndex {
+    size_t uuid = static_cast<size_t>(device_column_index("uuid"));
+    size_t createdAt = static_cast<size_t>(device_column_index("created_at"));
+    size_t deviceId = static_cast<size_t>(device_column_index("device_id"));
+};
+
+inline const DeviceColumnIndex& device_columns()
+{
+    static const DeviceColumnIndex index;
+    return index;
+}
+
+// 1..kDeviceSchemaVersion for a header written by this program, 0 for a
+// header with renamed or reordered columns (still readable by name)
+inline int device_schema_version(const std::vector<std::string>& header)
+{
+    static const size_t kColumnsByVersion[] = {14, 15, 16};
+    const auto& current = device_csv_columns();
+    for (int v = kDeviceSchemaVersion; v >= 1; --v)
+    {
+        const size_t n = kColumnsByVersion[v - 1];
+        if (header.size() == n && std::equal(header.begin(), header.end(), current.begin())) return v;
+    }
+    return 0;
+}
+
+// Calls fn(values) for every data row of every file, values[i] holding
+// column `columns[i]`. Each file's header is mapped once, so files of
+// different schema versions (or column orders) can be read together;
+// columns a file lacks come back empty. Rows shorter than their header
+// are skipped, or passed to `skipped` as read. Returns false if any file
+// cannot be opened.
+inline bool for_each_projected(const std::vector<std::string>& paths, const std::vector<std::string>& columns,
+                               const std::function<void(const std::vector<std::string>&)>& fn,
+                               const std::function<void(const std::string&)>& skipped = nullptr)
+{
+    bool ok = true;
+    CsvProjection projection(columns);
+    std::vector<std::string> values;
+    std::string record;
+    for (const auto& path : paths)
+    {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in) { ok = false; continue; }
+        // Skip the UTF-8 BOM some editors add, then map the header
+        if (in.peek() == 0xEF) in.ignore(3);
+        if (!read_csv_record(in, record)) continue;
+        const std::vector<std::string> header = parse_csv_line(record);
+        projection.bind(header, device_csv_columns());
+        const size_t minFields = std::min(header.size(), projection.span());
+        while (read_csv_record(in, record))
+        {
+            if (record.empty()) continue;
+            if (projection.project(record, values) < minFields)
+            {
+                if (skipped) skipped(record);
+                continue;
+            }
+            fn(values);
+        }
+    }
+    return ok;
+}
+
+// Calls fn for every data row of a devices.csv file, whatever its schema
+// version. Returns false if the file cannot be opened.
+inline bool for_each_device_record(const std::string& path, const std::function<void(DeviceRecord&&)>& fn)
+{
+    return for_each_projected({path}, device_csv_columns(), [&](const std::vector<std::string>& values) {
+        DeviceRecord rec;
+        if (from_csv_row(values, rec)) fn(std::move(rec));
+    });
+}
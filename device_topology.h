@@ -0,0 +1,239 @@
+// MiniGridMonitor - substation/feeder/device hierarchy with health rollups
+#pragma once
+
+#include "device_record.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Aggregate health of every device under a node
+struct HealthRollup {
+    uint32_t devices = 0;       // devices that have reported at least once
+    uint32_t byStatus[4] = {};  // indexed by status_index()
+    uint32_t bySeverity[4] = {}; // indexed by severity_rank()
+
+    // Highest severity currently held by any device below, -1 if none
+    int worstSeverity() const {
+        for (int s = 3; s >= 0; --s)
+        {
+            if (bySeverity[s]) return s;
+        }
+        return -1;
+    }
+
+    uint32_t online() const { return byStatus[1]; }
+    uint32_t unhealthy() const { return byStatus[2] + byStatus[3]; }
+};
+
+// Grid hierarchy loaded from a topology file, one edge per line:
+//
+//     node_id,parent_id,kind,name
+//     SUB-1,,substation,North Substation
+//     FDR-7,SUB-1,feeder,Feeder 7
+//     TR-101,FDR-7,device,Transformer A
+//
+// A node listed with several parents makes the hierarchy a DAG; it is
+// counted once in every ancestor. Readings for devices missing from the
+// file roll up under an "unassigned" root.
+//
+// Each device's latest status and severity are counted in all of its
+// ancestors, so an append touches only its precomputed ancestor list
+// (O(depth) for a tree) and any subtree's rollup is a lookup.
+class DeviceTopology {
+public:
+    static constexpr const char* kUnassigned = "unassigned";
+
+    struct Node {
+        std::string id;
+        std::string kind;
+        std::string name;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> children;
+        HealthRollup rollup;
+    };
+
+    DeviceTopology() {
+        addNode(kUnassigned, "root", "Unassigned devices");
+        computeAllAncestors();
+    }
+
+    // Replaces the hierarchy with the one in `path`; rollups start over and
+    // fill in again as devices report. Throws std::runtime_error if the file
+    // cannot be read or has a cycle, leaving the current hierarchy in place.
+    void load(const std::string& path) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in)
+            throw std::runtime_error("unable to open topology file: " + path);
+
+        DeviceTopology fresh;
+        std::string line;
+        bool first = true;
+        while (read_csv_record(in, line))
+        {
+            if (line.empty() || line[0] == '#') continue;
+            auto cols = parse_csv_line(line);
+            if (first && !cols.empty() && cols[0] == "node_id") { first = false; continue; }
+            first = false;
+            if (cols.empty() || cols[0].empty()) continue;
+            cols.resize(4);
+            fresh.addEdge(cols[0], cols[1], cols[2], cols[3]);
+        }
+        fresh.computeAllAncestors();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nodes = std::move(fresh.m_nodes);
+        m_index = std::move(fresh.m_index);
+        m_ancestors = std::move(fresh.m_ancestors);
+        m_lastState.clear();
+    }
+
+    void observe(const DeviceRecord& rec) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t device;
+        auto it = m_index.find(rec.deviceId);
+        if (it == m_index.end())
+        {
+            device = addNode(rec.deviceId, "device", rec.deviceName);
+            m_nodes[device].parents.push_back(0);
+            m_nodes[0].children.push_back(device);
+            m_ancestors.push_back({device, 0});
+        }
+        else
+        {
+            device = it->second;
+        }
+
+        if (m_lastState.size() < m_nodes.size()) m_lastState.resize(m_nodes.size());
+        DeviceState& last = m_lastState[device];
+        const DeviceState now{static_cast<int8_t>(status_index(rec.status)),
+                              static_cast<int8_t>(severity_rank(rec.severity)), true};
+        if (last.seen && last.status == now.status && last.severity == now.severity) return;
+
+        for (uint32_t a : m_ancestors[device])
+        {
+            HealthRollup& r = m_nodes[a].rollup;
+            if (last.seen)
+            {
+                --r.byStatus[last.status];
+                if (last.severity >= 0) --r.bySeverity[last.severity];
+            }
+            else
+            {
+                ++r.devices;
+            }
+            ++r.byStatus[now.status];
+            if (now.severity >= 0) ++r.bySeverity[now.severity];
+        }
+        last = now;
+    }
+
+    void observe(const std::vector<DeviceRecord>& batch) {
+        for (const auto& rec : batch) observe(rec);
+    }
+
+    // false when the node is unknown
+    bool rollup(const std::string& nodeId, HealthRollup& out) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(nodeId);
+        if (it == m_index.end()) return false;
+        out = m_nodes[it->second].rollup;
+        return true;
+    }
+
+    std::vector<std::string> children(const std::string& nodeId) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::string> out;
+        auto it = m_index.find(nodeId);
+        if (it == m_index.end()) return out;
+        for (uint32_t c : m_nodes[it->second].children) out.push_back(m_nodes[c].id);
+        return out;
+    }
+
+    // Nodes without parents, including the unassigned root
+    std::vector<std::string> roots() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::string> out;
+        for (const auto& n : m_nodes)
+        {
+            if (n.parents.empty()) out.push_back(n.id);
+        }
+        return out;
+    }
+
+private:
+    struct DeviceState {
+        int8_t status = 0;
+        int8_t severity = -1;
+        bool seen = false;
+    };
+
+    uint32_t addNode(const std::string& id, const std::string& kind, const std::string& name) {
+        uint32_t idx = static_cast<uint32_t>(m_nodes.size());
+        Node n;
+        n.id = id;
+        n.kind = kind;
+        n.name = name;
+        m_nodes.push_back(std::move(n));
+        m_index.emplace(id, idx);
+        return idx;
+    }
+
+    void addEdge(const std::string& id, const std::string& parentId, const std::string& kind, const std::string& name) {
+        uint32_t node = nodeIndex(id, kind, name);
+        if (parentId.empty()) return;
+        uint32_t parent = nodeIndex(parentId, "", "");
+        auto& parents = m_nodes[node].parents;
+        if (std::find(parents.begin(), parents.end(), parent) == parents.end())
+        {
+            parents.push_back(parent);
+            m_nodes[parent].children.push_back(node);
+        }
+    }
+
+    void computeAllAncestors() {
+        m_ancestors.assign(m_nodes.size(), {});
+        std::vector<int> state(m_nodes.size(), 0); // 0 new, 1 visiting, 2 done
+        for (uint32_t n = 0; n < m_nodes.size(); ++n) computeAncestors(n, state);
+    }
+
+    // Parents may be referenced before their own line; fill in details later
+    uint32_t nodeIndex(const std::string& id, const std::string& kind, const std::string& name) {
+        auto it = m_index.find(id);
+        if (it == m_index.end()) return addNode(id, kind, name);
+        Node& n = m_nodes[it->second];
+        if (n.kind.empty()) n.kind = kind;
+        if (n.name.empty()) n.name = name;
+        return it->second;
+    }
+
+    // Self first, then each ancestor once (diamonds in a DAG are deduped)
+    void computeAncestors(uint32_t n, std::vector<int>& state) {
+        if (state[n] == 2) return;
+        if (state[n] == 1)
+            throw std::runtime_error("topology has a cycle through " + m_nodes[n].id);
+        state[n] = 1;
+        std::vector<uint32_t> out{n};
+        for (uint32_t p : m_nodes[n].parents)
+        {
+            computeAncestors(p, state);
+            for (uint32_t a : m_ancestors[p])
+            {
+                if (std::find(out.begin(), out.end(), a) == out.end()) out.push_back(a);
+            }
+        }
+        m_ancestors[n] = std::move(out);
+        state[n] = 2;
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<Node> m_nodes;
+    std::unordered_map<std::string, uint32_t> m_index;
+    std::vector<std::vector<uint32_t>> m_ancestors; // self included
+    std::vector<DeviceState> m_lastState;
+};
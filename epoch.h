@@ -0,0 +1,249 @@
+// MiniGridMonitor - epoch-based reclamation for lock-free readers
+//
+// Readers pin the current epoch for the length of a read (a Guard), follow
+// RcuPtr pointers without locking, and unpin. Writers publish a new
+// version with one atomic exchange and retire the old one; it is freed
+// once the global epoch has advanced twice past the retirement, by which
+// time every reader that could have seen it has unpinned. The epoch only
+// advances when every pinned reader has caught up with it, so a reader
+// that holds a guard for a long time delays frees but never blocks
+// writers.
+//
+// Pinning costs one fenced store to a slot the thread owns; there
+// is no shared counter for readers to contend on.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+class EpochDomain {
+    struct Slot;
+
+public:
+    static constexpr size_t kMaxThreads = 256;
+
+    // Pins the epoch until destroyed. Nested guards on one thread are
+    // free. A guard must be released on the thread that took it.
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& o) noexcept : m_slot(std::exchange(o.m_slot, nullptr)) {}
+        Guard& operator=(Guard&& o) noexcept {
+            if (this != &o)
+            {
+                release();
+                m_slot = std::exchange(o.m_slot, nullptr);
+            }
+            return *this;
+        }
+        ~Guard() { release(); }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        friend class EpochDomain;
+        explicit Guard(Slot* slot) : m_slot(slot) {}
+
+        void release() {
+            if (m_slot && --m_slot->depth == 0) m_slot->epoch.store(kIdle, std::memory_order_release);
+            m_slot = nullptr;
+        }
+
+        Slot* m_slot = nullptr;
+    };
+
+    EpochDomain() : m_id(nextId()), m_slots(new Slot[kMaxThreads]) {}
+
+    // Runs whatever is still retired; no guard may be held any more.
+    // Threads that pinned this domain may outlive it (see ThreadSlots).
+    ~EpochDomain() {
+        for (auto& r : m_retired) r.second();
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Throws std::runtime_error when more than kMaxThreads threads read
+    // at once
+    Guard pin() {
+        Slot* slot = threadSlot();
+        if (slot->depth++ == 0)
+        {
+            // seq_cst exchange = store plus full fence, ordered before the reads that follow
+            slot->epoch.exchange(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+        return Guard(slot);
+    }
+
+    // Schedules `free` to run once no reader can still see what it frees.
+    // Call after the object has been unlinked.
+    void retire(std::function<void()> free) {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_retireMutex);
+            m_retired.emplace_back(m_epoch.load(std::memory_order_seq_cst), std::move(free));
+            if (m_retired.size() < kCollectEvery) return;
+            ready = collectLocked();
+        }
+        for (auto& fn : ready) fn();
+    }
+
+    template <typename T>
+    void retire(T* p) {
+        retire([p]() { delete p; });
+    }
+
+    // Advances the epoch if every reader allows it and frees what is due
+    void collect() {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_retireMutex);
+            ready = collectLocked();
+        }
+        for (auto& fn : ready) fn();
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(m_retireMutex);
+        return m_retired.size();
+    }
+
+    uint64_t epoch() const { return m_epoch.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint64_t kIdle = UINT64_MAX;
+    static constexpr size_t kCollectEvery = 64;
+
+    // One cache line per thread so pins do not share lines
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{kIdle};
+        std::atomic<bool> claimed{false};
+        uint32_t depth = 0; // touched only by the owning thread
+    };
+
+    // A thread's claim on one domain's slot. The domain is matched by an id
+    // that is never reused and its slots are held weakly, so a registration
+    // outliving its domain is skipped rather than followed.
+    struct Registration {
+        uint64_t domain;
+        std::weak_ptr<Slot[]> slots;
+        Slot* slot;
+    };
+
+    // Slots are claimed on a thread's first pin and given back when it exits
+    struct ThreadSlots {
+        std::vector<Registration> slots;
+        ~ThreadSlots() {
+            for (auto& r : slots)
+            {
+                if (auto live = r.slots.lock()) r.slot->claimed.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> next{0};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Slot* threadSlot() {
+        thread_local ThreadSlots mine;
+        for (auto& r : mine.slots)
+        {
+            if (r.domain == m_id) return r.slot;
+        }
+        // First pin of this domain; forget domains that are gone
+        mine.slots.erase(std::remove_if(mine.slots.begin(), mine.slots.end(),
+                                        [](const Registration& r) { return r.slots.expired(); }),
+                         mine.slots.end());
+        for (size_t i = 0; i < kMaxThreads; ++i)
+        {
+            bool expected = false;
+            if (m_slots[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+            {
+                size_t used = m_slotsUsed.load(std::memory_order_relaxed);
+                while (used < i + 1 && !m_slotsUsed.compare_exchange_weak(used, i + 1, std::memory_order_acq_rel)) {}
+                mine.slots.push_back(Registration{m_id, m_slots, &m_slots[i]});
+                return &m_slots[i];
+            }
+        }
+        throw std::runtime_error("too many threads reading one epoch domain");
+    }
+
+    // Caller holds m_retireMutex
+    std::vector<std::function<void()>> collectLocked() {
+        uint64_t e = m_epoch.load(std::memory_order_seq_cst);
+        bool quiescent = true;
+        const size_t used = m_slotsUsed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < used && quiescent; ++i)
+        {
+            const uint64_t pinned = m_slots[i].epoch.load(std::memory_order_seq_cst);
+            quiescent = pinned == kIdle || pinned == e;
+        }
+        if (quiescent && m_epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst)) ++e;
+
+        std::vector<std::function<void()>> ready;
+        auto keep = std::stable_partition(m_retired.begin(), m_retired.end(),
+                                          [e](const std::pair<uint64_t, std::function<void()>>& r) { return r.first + 2 > e; });
+        for (auto it = keep; it != m_retired.end(); ++it) ready.push_back(std::move(it->second));
+        m_retired.erase(keep, m_retired.end());
+        return ready;
+    }
+
+    const uint64_t m_id;
+    std::atomic<uint64_t> m_epoch{0};
+    std::shared_ptr<Slot[]> m_slots; // shared so thread registrations can watch it expire
+    std::atomic<size_t> m_slotsUsed{0};
+    mutable std::mutex m_retireMutex;
+    std::vector<std::pair<uint64_t, std::function<void()>>> m_retired; // retirement epoch, free
+};
+
+// Process-wide domain. Never destroyed, so pool threads that outlive
+// main() can still release their slots.
+inline EpochDomain& shared_epoch_domain()
+{
+    static EpochDomain* domain = new EpochDomain();
+    return *domain;
+}
+
+// A pointer readers follow under a guard while writers swap in new
+// versions. Writers must be serialized by the owner.
+template <typename T>
+class RcuPtr {
+public:
+    explicit RcuPtr(std::unique_ptr<T> initial = nullptr, EpochDomain& domain = shared_epoch_domain())
+        : m_domain(domain), m_ptr(initial.release()) {}
+
+    // No reader may still hold the current version
+    ~RcuPtr() { delete m_ptr.load(std::memory_order_relaxed); }
+
+    RcuPtr(const RcuPtr&) = delete;
+    RcuPtr& operator=(const RcuPtr&) = delete;
+
+    // Valid until `guard` is released
+    T* load(const EpochDomain::Guard&) const { return m_ptr.load(std::memory_order_acquire); }
+
+    // For the writer, which is the only one to replace the pointer
+    T* current() const { return m_ptr.load(std::memory_order_relaxed); }
+
+    // Publishes `next` and retires the previous version
+    void publish(std::unique_ptr<T> next) {
+        T* old = m_ptr.exchange(next.release(), std::memory_order_seq_cst);
+        if (old) m_domain.retire(old);
+    }
+
+    EpochDomain& domain() const { return m_domain; }
+
+private:
+    EpochDomain& m_domain;
+    std::atomic<T*> m_ptr;
+};
@@ -0,0 +1,285 @@
+// MiniGridMonitor - shared work-stealing executor for background jobs
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class TaskPriority { High = 0, Normal = 1, Low = 2 };
+
+// Cheap to copy; every copy observes the same cancel flag
+class CancellationToken {
+public:
+    CancellationToken() : m_flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { m_flag->store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_flag->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+// Fixed pool with one deque per worker and priority level. Owners push and
+// pop at the back (LIFO, cache warm), idle workers steal from the front of
+// other workers' deques. Higher priorities are drained pool-wide first.
+class Executor {
+public:
+    using Task = std::function<void()>;
+
+    explicit Executor(size_t threads = std::thread::hardware_concurrency())
+        : m_workers(std::max<size_t>(threads, 1)) {
+        for (size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i].thread = std::thread([this, i] { workerLoop(i); });
+    }
+
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& w : m_workers)
+        {
+            if (w.thread.joinable()) w.thread.join();
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    size_t threadCount() const { return m_workers.size(); }
+
+    void submit(Task task, TaskPriority priority = TaskPriority::Normal) {
+        size_t target;
+        if (tls().owner == this)
+            target = tls().index;
+        else
+            target = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+        {
+            // Taking the sleep lock orders this against a worker deciding to sleep
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_pending.fetch_add(1, std::memory_order_release);
+        }
+        {
+            Worker& w = m_workers[target];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.queues[static_cast<int>(priority)].push_back(std::move(task));
+        }
+        m_wake.notify_one();
+    }
+
+    template <class F>
+    auto async(F fn, TaskPriority priority = TaskPriority::Normal) -> std::future<std::invoke_result_t<F>> {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(fn));
+        std::future<R> fut = task->get_future();
+        submit([task] { (*task)(); }, priority);
+        return fut;
+    }
+
+    // Runs one pending task on the calling thread. Used by waits so that a
+    // worker blocked in TaskGroup::wait() keeps the pool moving.
+    bool runOne() {
+        Task task;
+        size_t self = tls().owner == this ? tls().index : 0;
+        if (!take(self, task)) return false;
+        task();
+        return true;
+    }
+
+private:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<Task> queues[3];
+        std::thread thread;
+    };
+
+    struct ThreadInfo {
+        Executor* owner = nullptr;
+        size_t index = 0;
+    };
+
+    static ThreadInfo& tls() {
+        thread_local ThreadInfo info;
+        return info;
+    }
+
+    bool take(size_t self, Task& out) {
+        const size_t n = m_workers.size();
+        for (int p = 0; p < 3; ++p)
+        {
+            {
+                Worker& own = m_workers[self];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.queues[p].empty())
+                {
+                    out = std::move(own.queues[p].back());
+                    own.queues[p].pop_back();
+                    m_pending.fetch_sub(1, std::memory_order_acq_rel);
+                    return true;
+                }
+            }
+            for (size_t k = 1; k < n; ++k)
+            {
+                Worker& victim = m_workers[(self + k) % n];
+                std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+                if (!lock.owns_lock() || victim.queues[p].empty()) continue;
+                out = std::move(victim.queues[p].front());
+                victim.queues[p].pop_front();
+                m_pending.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index) {
+        tls().owner = this;
+        tls().index = index;
+        Task task;
+        for (;;)
+        {
+            if (take(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            if (m_stopping && m_pending.load(std::memory_order_acquire) == 0) return;
+            // try_to_lock steals can miss a task; re-scan rather than sleep on it
+            if (m_pending.load(std::memory_order_acquire) > 0) continue;
+            m_wake.wait(lock, [this] { return m_stopping || m_pending.load(std::memory_order_acquire) > 0; });
+        }
+    }
+
+    std::vector<Worker> m_workers;
+    std::atomic<size_t> m_nextWorker{0};
+    std::atomic<size_t> m_pending{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
+
+// Process-wide pool sized to the hardware
+inline Executor& shared_executor()
+{
+    static Executor executor;
+    return executor;
+}
+
+// Lane for tasks that may wait (ingest backpressure, slow I/O), so they
+// never hold a shared_executor() worker that compute jobs are counting on
+inline Executor& blocking_executor()
+{
+    static Executor executor(2);
+    return executor;
+}
+
+// Fork-join scope: run() forks, wait() joins and rethrows the first error.
+// Tasks not yet started are skipped once the token is cancelled or a
+// sibling has thrown.
+class TaskGroup {
+public:
+    explicit TaskGroup(Executor& executor = shared_executor(), CancellationToken token = CancellationToken())
+        : m_executor(executor), m_state(std::make_shared<State>()), m_token(token) {}
+
+    ~TaskGroup() {
+        try { wait(); } catch (...) {}
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <class F>
+    void run(F fn, TaskPriority priority = TaskPriority::Normal) {
+        m_state->pending.fetch_add(1, std::memory_order_relaxed);
+        auto state = m_state;
+        CancellationToken token = m_token;
+        m_executor.submit([state, token, fn = std::move(fn)]() mutable {
+            if (!token.isCancelled() && !state->failed.load(std::memory_order_relaxed))
+            {
+                try {
+                    fn();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) state->error = std::current_exception();
+                    state->failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done.notify_all();
+            }
+        }, priority);
+    }
+
+    void wait() {
+        while (m_state->pending.load(std::memory_order_acquire) > 0)
+        {
+            if (m_executor.runOne()) continue;
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            m_state->done.wait_for(lock, std::chrono::milliseconds(1), [this] {
+                return m_state->pending.load(std::memory_order_acquire) == 0; });
+        }
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            std::swap(error, m_state->error);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    const CancellationToken& token() const { return m_token; }
+
+private:
+    struct State {
+        std::atomic<size_t> pending{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    Executor& m_executor;
+    std::shared_ptr<State> m_state;
+    CancellationToken m_token;
+};
+
+// Calls fn(lo, hi) over [begin, end) in chunks of at least `grain`.
+// Blocks until every chunk ran or was skipped by cancellation.
+template <class F>
+void parallel_for(size_t begin, size_t end, size_t grain, F fn,
+                  CancellationToken token = CancellationToken(), Executor& executor = shared_executor())
+{
+    if (end <= begin) return;
+    grain = std::max<size_t>(grain, 1);
+    const size_t total = end - begin;
+    // A few chunks per worker leaves room for stealing to even out skew
+    size_t chunks = std::min((total + grain - 1) / grain, executor.threadCount() * 4);
+    if (chunks <= 1)
+    {
+        if (!token.isCancelled()) fn(begin, end);
+        return;
+    }
+    const size_t step = (total + chunks - 1) / chunks;
+    TaskGroup group(executor, token);
+    for (size_t lo = begin; lo < end; lo += step)
+    {
+        size_t hi = std::min(end, lo + step);
+        group.run([&fn, lo, hi] { fn(lo, hi); });
+    }
+    group.wait();
+}
@@ -0,0 +1,214 @@
+// MiniGridMonitor - co-occurring Degraded/Offline transitions across devices
+//
+// Several transformers failing within minutes of each other usually points
+// at a shared upstream cause (feeder, substation). Failure events are chained
+// by single linkage in time: an event within `window` seconds of the previous
+// one joins its cluster. A cluster is reported once it spans minDevices
+// distinct devices.
+#pragma once
+
+#include "device_record.h"
+#include "executor.h"
+#include "string_interner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+inline bool is_failure_status(const std::string& status)
+{
+    return status == "Degraded" || status == "Offline";
+}
+
+struct FailureEvent {
+    int64_t time;      // epoch seconds
+    uint32_t device;   // interned device_id
+    bool offline;      // false = Degraded
+};
+
+struct FailureCluster {
+    int64_t start = 0;
+    int64_t end = 0;
+    size_t events = 0;
+    std::vector<uint32_t> devices; // sorted, distinct
+};
+
+// Turns each device's time-ordered readings into failure transitions:
+// an event whenever a device enters Degraded or Offline from any other status.
+class FailureEventExtractor {
+public:
+    explicit FailureEventExtractor(StringInterner& devices)
+        : m_devices(devices) {}
+
+    // true and `out` filled when `rec` is a transition into failure
+    bool observe(const DeviceRecord& rec, FailureEvent& out) {
+        int64_t ts;
+        if (!parse_timestamp(rec.createdAt, ts)) return false;
+        const uint32_t device = m_devices.intern(rec.deviceId);
+        std::string& last = m_lastStatus[device];
+        const bool entered = is_failure_status(rec.status) && rec.status != last;
+        last = rec.status;
+        if (!entered) return false;
+        out = FailureEvent{ts, device, rec.status == "Offline"};
+        return true;
+    }
+
+private:
+    StringInterner& m_devices;
+    std::unordered_map<uint32_t, std::string> m_lastStatus;
+};
+
+// K-way merge of segments that are each already sorted by time
+inline std::vector<FailureEvent> merge_time_ordered(const std::vector<std::vector<FailureEvent>>& segments)
+{
+    using Cursor = std::pair<size_t, size_t>; // segment, position
+    auto later = [&](const Cursor& a, const Cursor& b) {
+        return segments[a.first][a.second].time > segments[b.first][b.second].time;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+    size_t total = 0;
+    for (size_t s = 0; s < segments.size(); ++s)
+    {
+        total += segments[s].size();
+        if (!segments[s].empty()) heap.push({s, 0});
+    }
+    std::vector<FailureEvent> out;
+    out.reserve(total);
+    while (!heap.empty())
+    {
+        Cursor c = heap.top();
+        heap.pop();
+        out.push_back(segments[c.first][c.second]);
+        if (++c.second < segments[c.first].size()) heap.push(c);
+    }
+    return out;
+}
+
+namespace correlation_detail {
+
+inline void add_event(FailureCluster& c, const FailureEvent& e)
+{
+    if (c.events == 0) c.start = e.time;
+    c.end = e.time;
+    ++c.events;
+    c.devices.push_back(e.device);
+}
+
+inline void finish(FailureCluster& c)
+{
+    std::sort(c.devices.begin(), c.devices.end());
+    c.devices.erase(std::unique(c.devices.begin(), c.devices.end()), c.devices.end());
+}
+
+// Sweep one time-ordered run; every cluster is returned, even singletons,
+// so the caller can stitch runs together.
+inline std::vector<FailureCluster> sweep(const FailureEvent* begin, const FailureEvent* end, int64_t window)
+{
+    std::vector<FailureCluster> out;
+    for (const FailureEvent* e = begin; e != end; ++e)
+    {
+        if (out.empty() || e->time - out.back().end > window)
+        {
+            if (!out.empty()) finish(out.back());
+            out.emplace_back();
+        }
+        add_event(out.back(), *e);
+    }
+    if (!out.empty()) finish(out.back());
+    return out;
+}
+
+} // namespace correlation_detail
+
+// Batch job over time-ordered events. Chunks are swept in parallel; since
+// single linkage only breaks where consecutive events are more than
+// `window` apart, stitching chunk boundaries gives the same clusters as
+// one sequential sweep.
+inline std::vector<FailureCluster> correlate_failures(const std::vector<FailureEvent>& events, int64_t window,
+                                                      size_t minDevices, Executor& executor = shared_executor())
+{
+    const size_t chunkSize = 1 << 14;
+    const size_t chunks = (events.size() + chunkSize - 1) / chunkSize;
+    std::vector<std::vector<FailureCluster>> partial(chunks);
+    parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c)
+        {
+            const FailureEvent* b = events.data() + c * chunkSize;
+            const FailureEvent* e = events.data() + std::min(events.size(), (c + 1) * chunkSize);
+            partial[c] = correlation_detail::sweep(b, e, window);
+        }
+    }, CancellationToken(), executor);
+
+    std::vector<FailureCluster> out;
+    for (auto& clusters : partial)
+    {
+        for (auto& c : clusters)
+        {
+            if (!out.empty() && c.start - out.back().end <= window)
+            {
+                FailureCluster& prev = out.back();
+                prev.end = c.end;
+                prev.events += c.events;
+                prev.devices.insert(prev.devices.end(), c.devices.begin(), c.devices.end());
+                correlation_detail::finish(prev);
+            }
+            else
+            {
+                if (!out.empty() && out.back().devices.size() < minDevices) out.pop_back();
+                out.push_back(std::move(c));
+            }
+        }
+    }
+    if (!out.empty() && out.back().devices.size() < minDevices) out.pop_back();
+    return out;
+}
+
+// Live variant for the commit stream. Keeps only the open cluster; it is
+// reported when the next failure arrives more than `window` later or when
+// flush() sees the stream has been quiet that long.
+class FailureCorrelator {
+public:
+    using EmitFn = std::function<void(const FailureCluster&)>;
+
+    FailureCorrelator(int64_t window, size_t minDevices, StringInterner& devices, EmitFn emit)
+        : m_window(window), m_minDevices(minDevices), m_extractor(devices), m_emit(std::move(emit)) {}
+
+    void observe(const DeviceRecord& rec) {
+        FailureEvent e;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_extractor.observe(rec, e)) return;
+        // Readings are near time order on the commit path; a slightly
+        // older event still belongs to the open cluster.
+        if (m_open.events > 0 && e.time - m_open.end > m_window) close();
+        correlation_detail::add_event(m_open, e);
+        m_open.end = std::max(m_open.end, e.time);
+        m_open.start = std::min(m_open.start, e.time);
+    }
+
+    void observe(const std::vector<DeviceRecord>& batch) {
+        for (const auto& rec : batch) observe(rec);
+    }
+
+    void flush(int64_t now) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_open.events > 0 && now - m_open.end > m_window) close();
+    }
+
+private:
+    void close() {
+        correlation_detail::finish(m_open);
+        if (m_open.devices.size() >= m_minDevices && m_emit) m_emit(m_open);
+        m_open = FailureCluster();
+    }
+
+    int64_t m_window;
+    size_t m_minDevices;
+    FailureEventExtractor m_extractor;
+    EmitFn m_emit;
+    std::mutex m_mutex;
+    FailureCluster m_open;
+};
@@ -0,0 +1,51 @@
+// MiniGridMonitor - making written files durable
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// fsync (_commit on Windows) of a FILE* whose buffer is already flushed;
+// false on failure
+inline bool fsync_file(std::FILE* f)
+{
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Flushes the FILE* buffer and syncs the file. Throws std::runtime_error
+// naming `path`.
+inline void sync_file(std::FILE* f, const std::string& path)
+{
+    if (std::fflush(f) != 0)
+        throw std::runtime_error("unable to flush file: " + path);
+    if (!fsync_file(f))
+        throw std::runtime_error("unable to sync file: " + path);
+}
+
+// Makes a rename in the file's directory durable. POSIX only; the CRT
+// has no way to flush a directory on Windows.
+inline void sync_parent_directory(const std::string& path)
+{
+#ifndef _WIN32
+    const std::string dir = std::filesystem::path(path).parent_path().string();
+    const int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("unable to open directory: " + dir);
+    const int rc = ::fsync(fd);
+    ::close(fd);
+    if (rc != 0) throw std::runtime_error("unable to sync directory: " + dir);
+#else
+    (void)path;
+#endif
+}
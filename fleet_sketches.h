@@ -0,0 +1,290 @@
+// MiniGridMonitor - heavy-hitter and distinct-count sketches for overviews
+#pragma once
+
+#include "device_record.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// FNV-1a with a splitmix64 finalizer; sketches need well-mixed 64-bit hashes
+inline uint64_t sketch_hash(const std::string& s, uint64_t seed = 0)
+{
+    uint64_t h = 1469598103934665603ull ^ seed;
+    for (unsigned char c : s)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h += 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+// Point-frequency estimates that never undercount. Error is at most
+// e/width of the total with probability 1 - exp(-depth).
+class CountMinSketch {
+public:
+    CountMinSketch(size_t width = 2048, size_t depth = 4)
+        : m_width(width), m_depth(depth), m_counts(width * depth, 0) {}
+
+    void add(uint64_t hash, uint32_t n = 1) {
+        for (size_t d = 0; d < m_depth; ++d) m_counts[d * m_width + column(hash, d)] += n;
+    }
+
+    uint32_t estimate(uint64_t hash) const {
+        uint32_t best = UINT32_MAX;
+        for (size_t d = 0; d < m_depth; ++d) best = std::min(best, m_counts[d * m_width + column(hash, d)]);
+        return best;
+    }
+
+    // Both sketches must share width and depth
+    void merge(const CountMinSketch& o) {
+        if (o.m_width != m_width || o.m_depth != m_depth) return;
+        for (size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += o.m_counts[i];
+    }
+
+    // Halves every counter so old activity fades (frequency aging)
+    void halve() {
+        for (auto& c : m_counts) c >>= 1;
+    }
+
+private:
+    size_t column(uint64_t hash, size_t row) const {
+        // Kirsch-Mitzenmacher: derive every row from two halves of one hash
+        uint64_t h = (hash & 0xffffffffull) + row * (hash >> 32);
+        return static_cast<size_t>(h % m_width);
+    }
+
+    size_t m_width;
+    size_t m_depth;
+    std::vector<uint32_t> m_counts;
+};
+
+// Space-Saving top-K (Metwally et al.). Any key with true count above
+// total/capacity is guaranteed to be tracked; `error` bounds the overcount.
+class SpaceSaving {
+public:
+    struct Entry {
+        std::string key;
+        uint64_t count = 0;
+        uint64_t error = 0;
+    };
+
+    explicit SpaceSaving(size_t capacity = 64)
+        : m_capacity(std::max<size_t>(capacity, 1)) {}
+
+    void add(const std::string& key, uint64_t n = 1) {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            m_entries[it->second].count += n;
+            return;
+        }
+        if (m_entries.size() < m_capacity)
+        {
+            m_index.emplace(key, m_entries.size());
+            m_entries.push_back(Entry{key, n, 0});
+            return;
+        }
+        // Evict the minimum; the newcomer inherits its count as error
+        size_t victim = 0;
+        for (size_t i = 1; i < m_entries.size(); ++i)
+        {
+            if (m_entries[i].count < m_entries[victim].count) victim = i;
+        }
+        Entry& e = m_entries[victim];
+        m_index.erase(e.key);
+        e.error = e.count;
+        e.count += n;
+        e.key = key;
+        m_index.emplace(key, victim);
+    }
+
+    void merge(const SpaceSaving& o) {
+        for (const auto& e : o.m_entries)
+        {
+            auto it = m_index.find(e.key);
+            if (it != m_index.end())
+            {
+                m_entries[it->second].count += e.count;
+                m_entries[it->second].error += e.error;
+            }
+            else
+            {
+                m_index.emplace(e.key, m_entries.size());
+                m_entries.push_back(e);
+            }
+        }
+        if (m_entries.size() > m_capacity)
+        {
+            auto byCount = [](const Entry& a, const Entry& b) { return a.count > b.count; };
+            std::nth_element(m_entries.begin(), m_entries.begin() + m_capacity, m_entries.end(), byCount);
+            m_entries.resize(m_capacity);
+            m_index.clear();
+            for (size_t i = 0; i < m_entries.size(); ++i) m_index.emplace(m_entries[i].key, i);
+        }
+    }
+
+    std::vector<Entry> top(size_t k) const {
+        std::vector<Entry> out = m_entries;
+        std::sort(out.begin(), out.end(), [](const Entry& a, const Entry& b) { return a.count > b.count; });
+        if (out.size() > k) out.resize(k);
+        return out;
+    }
+
+private:
+    size_t m_capacity;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, size_t> m_index;
+};
+
+// HyperLogLog distinct counter, 2^precision one-byte registers
+// (4 KB at the default precision, ~1.6% standard error).
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned precision = 12)
+        : m_precision(precision), m_registers(size_t(1) << precision, 0) {}
+
+    void add(uint64_t hash) {
+        size_t idx = static_cast<size_t>(hash >> (64 - m_precision));
+        uint64_t rest = (hash << m_precision) | (uint64_t(1) << (m_precision - 1));
+        uint8_t rank = 1;
+        while (!(rest & (uint64_t(1) << 63))) { rest <<= 1; ++rank; }
+        if (rank > m_registers[idx]) m_registers[idx] = rank;
+    }
+
+    void merge(const HyperLogLog& o) {
+        if (o.m_precision != m_precision) return;
+        for (size_t i = 0; i < m_registers.size(); ++i)
+            m_registers[i] = std::max(m_registers[i], o.m_registers[i]);
+    }
+
+    double estimate() const {
+        const double m = double(m_registers.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : m_registers)
+        {
+            sum += std::ldexp(1.0, -r);
+            if (r == 0) ++zeros;
+        }
+        const double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        // Linear counting is far more accurate while registers are sparse
+        if (e <= 2.5 * m && zeros) e = m * std::log(m / double(zeros));
+        return e;
+    }
+
+private:
+    unsigned m_precision;
+    std::vector<uint8_t> m_registers;
+};
+
+// Fleet overview sketches maintained on the append path. Each day and each
+// calendar month bucket holds:
+//  - Critical readings per device_id (count-min + space-saving top-K)
+//  - distinct device_id per instance_id and fleet-wide (HyperLogLog)
+// Month tiles read one bucket; arbitrary day ranges merge day buckets.
+class FleetOverview {
+public:
+    struct Bucket {
+        CountMinSketch critical;
+        SpaceSaving topCritical{128};
+        HyperLogLog devices;
+        std::unordered_map<std::string, HyperLogLog> devicesByInstance;
+    };
+
+    // Month key as year * 12 + (month - 1)
+    static int64_t monthKey(int year, int month) { return int64_t(year) * 12 + (month - 1); }
+
+    void observe(const DeviceRecord& rec) {
+        int64_t ts;
+        int year, month;
+        if (!parse_timestamp(rec.createdAt, ts)) return;
+        if (std::sscanf(rec.createdAt.c_str(), "%4d-%2d", &year, &month) != 2) return;
+        const int64_t day = ts >= 0 ? ts / 86400 : (ts - 86399) / 86400;
+        const uint64_t deviceHash = sketch_hash(rec.deviceId);
+        const bool critical = rec.severity == "Critical";
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Bucket* b : {&m_days[day], &m_months[monthKey(year, month)]})
+        {
+            b->devices.add(deviceHash);
+            b->devicesByInstance[rec.instanceId].add(deviceHash);
+            if (critical)
+            {
+                b->critical.add(deviceHash);
+                b->topCritical.add(rec.deviceId);
+            }
+        }
+    }
+
+    void observe(const std::vector<DeviceRecord>& batch) {
+        for (const auto& rec : batch) observe(rec);
+    }
+
+    // Devices with the most Critical readings in a calendar month
+    std::vector<SpaceSaving::Entry> topCriticalDevices(int year, int month, size_t k) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_months.find(monthKey(year, month));
+        if (it == m_months.end()) return {};
+        return it->second.topCritical.top(k);
+    }
+
+    // Same, over epoch days [fromDay, toDay)
+    std::vector<SpaceSaving::Entry> topCriticalDevices(int64_t fromDay, int64_t toDay, size_t k) const {
+        SpaceSaving merged(128);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_days.lower_bound(fromDay); it != m_days.end() && it->first < toDay; ++it)
+            merged.merge(it->second.topCritical);
+        return merged.top(k);
+    }
+
+    uint32_t criticalCount(const std::string& deviceId, int year, int month) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_months.find(monthKey(year, month));
+        return it == m_months.end() ? 0 : it->second.critical.estimate(sketch_hash(deviceId));
+    }
+
+    // Distinct devices each instance touched on an epoch day
+    std::map<std::string, double> distinctDevicesByInstance(int64_t day) const {
+        std::map<std::string, double> out;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_days.find(day);
+        if (it == m_days.end()) return out;
+        for (const auto& kv : it->second.devicesByInstance) out[kv.first] = kv.second.estimate();
+        return out;
+    }
+
+    double distinctDevices(int64_t day) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_days.find(day);
+        return it == m_days.end() ? 0.0 : it->second.devices.estimate();
+    }
+
+    // Day buckets before `day` (days since the epoch) and month buckets
+    // before year/month are dropped to cap memory for long sessions
+    void pruneDaysBefore(int64_t day) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_days.erase(m_days.begin(), m_days.lower_bound(day));
+    }
+
+    void pruneMonthsBefore(int year, int month) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_months.erase(m_months.begin(), m_months.lower_bound(monthKey(year, month)));
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::map<int64_t, Bucket> m_days;
+    std::map<int64_t, Bucket> m_months;
+};
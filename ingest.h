@@ -0,0 +1,439 @@
+// MiniGridMonitor - bounded ingest pipeline with flow control
+#pragma once
+
+#include "device_record.h"
+#include "record_sink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// What submit() does when every ingest credit is in use
+enum class OverflowPolicy {
+    Block,      // wait up to blockTimeout for a credit, then reject
+    DropOldest, // evict the oldest queued record to make room
+    Reject      // refuse the new record immediately
+};
+
+enum class IngestStatus {
+    Queued,
+    Committed,
+    Dropped,
+    Rejected,
+    RateLimited,
+    Closed,
+    Failed
+};
+
+inline const char* ingest_status_name(IngestStatus s)
+{
+    switch (s)
+    {
+    case IngestStatus::Queued: return "queued";
+    case IngestStatus::Committed: return "committed";
+    case IngestStatus::Dropped: return "dropped";
+    case IngestStatus::Rejected: return "rejected";
+    case IngestStatus::RateLimited: return "rate limited";
+    case IngestStatus::Closed: return "closed";
+    case IngestStatus::Failed: return "failed";
+    }
+    return "unknown";
+}
+
+struct IngestLimits {
+    size_t maxInFlight = 4096;   // credits: records queued or being committed
+    size_t maxBatch = 256;       // records handed to one commit call
+    std::chrono::milliseconds batchWindow{20}; // how long a group commit waits to fill
+    size_t maxPriorityInFlight = 256; // credits reserved for the priority lane
+    OverflowPolicy policy = OverflowPolicy::Block;
+    std::chrono::milliseconds blockTimeout{2000};
+    double sourceRatePerSec = 50.0; // per instance_id/operator_id, 0 = unlimited
+    double sourceBurst = 500.0;
+    size_t maxSources = 1024;    // idle buckets are pruned past this
+};
+
+// Classic token bucket. Not thread safe; SourceRateLimiter guards it.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double ratePerSec, double burst, Clock::time_point now = Clock::now())
+        : m_rate(ratePerSec), m_burst(burst), m_tokens(burst), m_last(now) {}
+
+    bool tryTake(double n, Clock::time_point now) {
+        refill(now);
+        if (m_tokens < n) return false;
+        m_tokens -= n;
+        return true;
+    }
+
+    // How long until n tokens are available
+    Clock::duration waitTime(double n, Clock::time_point now) {
+        refill(now);
+        if (m_tokens >= n || m_rate <= 0) return Clock::duration::zero();
+        double secs = (n - m_tokens) / m_rate;
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(secs));
+    }
+
+    bool isFull(Clock::time_point now) {
+        refill(now);
+        return m_tokens >= m_burst;
+    }
+
+private:
+    void refill(Clock::time_point now) {
+        if (now <= m_last) return;
+        double secs = std::chrono::duration<double>(now - m_last).count();
+        m_tokens = std::min(m_burst, m_tokens + secs * m_rate);
+        m_last = now;
+    }
+
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    Clock::time_point m_last;
+};
+
+// One token bucket per source, keyed by instance_id/operator_id
+class SourceRateLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+
+    SourceRateLimiter(double ratePerSec, double burst, size_t maxSources)
+        : m_rate(ratePerSec), m_burst(burst), m_maxSources(maxSources) {}
+
+    static std::string sourceKey(const DeviceRecord& r) {
+        return r.instanceId + '/' + r.operatorId;
+    }
+
+    // Zero when a token was taken, otherwise the time to wait before retrying
+    Clock::duration acquire(const std::string& key) {
+        if (m_rate <= 0) return Clock::duration::zero();
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_buckets.find(key);
+        if (it == m_buckets.end())
+        {
+            if (m_buckets.size() >= m_maxSources) pruneIdle(now);
+            it = m_buckets.emplace(key, TokenBucket(m_rate, m_burst, now)).first;
+        }
+        if (it->second.tryTake(1.0, now)) return Clock::duration::zero();
+        return it->second.waitTime(1.0, now);
+    }
+
+private:
+    // A full bucket carries no state worth keeping
+    void pruneIdle(Clock::time_point now) {
+        for (auto it = m_buckets.begin(); it != m_buckets.end();)
+        {
+            if (it->second.isFull(now)) it = m_buckets.erase(it);
+            else ++it;
+        }
+    }
+
+    double m_rate;
+    double m_burst;
+    size_t m_maxSources;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, TokenBucket> m_buckets;
+};
+
+// Critical or Offline readings take the priority lane: they skip the group
+// commit window, get their own sync, and reach the alert handler first.
+inline bool is_priority_record(const DeviceRecord& r)
+{
+    return r.severity == "Critical" || r.status == "Offline";
+}
+
+// Bounded, credit-based ingest queue drained by a single commit thread.
+// A credit is taken per record on submit and returned only after the
+// record's batch is committed, so memory is bounded by maxInFlight (plus
+// maxPriorityInFlight for the priority lane, which bulk traffic cannot use).
+class IngestPipeline {
+public:
+    using AlertFn = std::function<void(const DeviceRecord&)>;
+    using CommitListener = std::function<void(const std::vector<DeviceRecord>&)>;
+    using DoneFn = std::function<void(IngestStatus)>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t accepted = 0;
+        uint64_t committed = 0;
+        uint64_t dropped = 0;
+        uint64_t rejected = 0;
+        uint64_t rateLimited = 0;
+        uint64_t failed = 0;
+        uint64_t priorityCommitted = 0;
+        uint64_t groupCommits = 0;
+        uint64_t priorityMaxLatencyUs = 0; // submit to synced, priority lane
+        size_t inFlight = 0;
+        size_t priorityInFlight = 0;
+    };
+
+    explicit IngestPipeline(RecordSink& sink, IngestLimits limits = IngestLimits())
+        : m_sink(sink),
+          m_limits(limits),
+          m_rateLimiter(limits.sourceRatePerSec, limits.sourceBurst, limits.maxSources) {
+        if (m_limits.maxInFlight == 0) m_limits.maxInFlight = 1;
+        if (m_limits.maxPriorityInFlight == 0) m_limits.maxPriorityInFlight = 1;
+        if (m_limits.maxBatch == 0) m_limits.maxBatch = 1;
+        m_thread = std::thread([this] { run(); });
+    }
+
+    ~IngestPipeline() {
+        close();
+    }
+
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    // Called on the commit thread for every committed record. Priority
+    // records are reported as soon as their own sync completes.
+    // Set before the first submit().
+    void setAlertHandler(AlertFn fn) {
+        m_alert = std::move(fn);
+    }
+
+    // Called on the commit thread with every successfully committed batch,
+    // after the alert handler. Register before the first submit().
+    void addCommitListener(CommitListener fn) {
+        m_listeners.push_back(std::move(fn));
+    }
+
+    // Returns Queued when admitted; `done` later fires with the final status
+    // (from the commit thread, or from the submitter that evicted it).
+    // Any other return value means `done` is never called.
+    IngestStatus submit(DeviceRecord record, DoneFn done = nullptr) {
+        const auto start = Clock::now();
+        const auto deadline = start + m_limits.blockTimeout;
+
+        if (is_priority_record(record))
+            return submitPriority(std::move(record), std::move(done), start, deadline);
+
+        const std::string source = SourceRateLimiter::sourceKey(record);
+        for (;;)
+        {
+            auto wait = m_rateLimiter.acquire(source);
+            if (wait == Clock::duration::zero()) break;
+            if (m_limits.policy != OverflowPolicy::Block || Clock::now() + wait > deadline)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_stats.rateLimited;
+                return IngestStatus::RateLimited;
+            }
+            std::this_thread::sleep_for(wait);
+        }
+
+        Item evicted;
+        bool hasEvicted = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_closed) return IngestStatus::Closed;
+
+            if (m_inFlight >= m_limits.maxInFlight)
+            {
+                switch (m_limits.policy)
+                {
+                case OverflowPolicy::Block:
+                    if (!m_creditFreed.wait_until(lock, deadline, [this] {
+                            return m_closed || m_inFlight < m_limits.maxInFlight; }))
+                    {
+                        ++m_stats.rejected;
+                        return IngestStatus::Rejected;
+                    }
+                    if (m_closed) return IngestStatus::Closed;
+                    break;
+                case OverflowPolicy::DropOldest:
+                    // Records already handed to the commit thread cannot be dropped
+                    if (m_queue.empty())
+                    {
+                        ++m_stats.rejected;
+                        return IngestStatus::Rejected;
+                    }
+                    evicted = std::move(m_queue.front());
+                    m_queue.pop_front();
+                    hasEvicted = true;
+                    --m_inFlight;
+                    ++m_stats.dropped;
+                    break;
+                case OverflowPolicy::Reject:
+                    ++m_stats.rejected;
+                    return IngestStatus::Rejected;
+                }
+            }
+
+            ++m_inFlight;
+            ++m_stats.accepted;
+            m_queue.push_back(Item{std::move(record), std::move(done), start});
+        }
+        m_hasWork.notify_one();
+
+        if (hasEvicted && evicted.done) evicted.done(IngestStatus::Dropped);
+        return IngestStatus::Queued;
+    }
+
+    // Stops admitting records, commits what is queued and joins the thread
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed && !m_thread.joinable()) return;
+            m_closed = true;
+        }
+        m_hasWork.notify_all();
+        m_creditFreed.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s = m_stats;
+        s.inFlight = m_inFlight;
+        s.priorityInFlight = m_priorityInFlight;
+        return s;
+    }
+
+private:
+    struct Item {
+        DeviceRecord record;
+        DoneFn done;
+        Clock::time_point enqueued;
+    };
+
+    // Priority records are never rate limited or dropped; they only wait
+    // for one of their own reserved credits.
+    IngestStatus submitPriority(DeviceRecord record, DoneFn done, Clock::time_point start, Clock::time_point deadline) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_closed) return IngestStatus::Closed;
+            if (!m_creditFreed.wait_until(lock, deadline, [this] {
+                    return m_closed || m_priorityInFlight < m_limits.maxPriorityInFlight; }))
+            {
+                ++m_stats.rejected;
+                return IngestStatus::Rejected;
+            }
+            if (m_closed) return IngestStatus::Closed;
+            ++m_priorityInFlight;
+            ++m_stats.accepted;
+            m_priority.push_back(Item{std::move(record), std::move(done), start});
+        }
+        m_hasWork.notify_one();
+        return IngestStatus::Queued;
+    }
+
+    void run() {
+        std::vector<Item> batch;
+        for (;;)
+        {
+            bool priority = false;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_hasWork.wait(lock, [this] { return m_closed || !m_priority.empty() || !m_queue.empty(); });
+                if (m_priority.empty() && m_queue.empty()) return; // closed and drained
+
+                // Hold a partial group commit open for the batch window, but
+                // cut it short the moment a priority record shows up.
+                if (m_priority.empty() && !m_closed && m_queue.size() < m_limits.maxBatch)
+                {
+                    auto flushAt = m_queue.front().enqueued + m_limits.batchWindow;
+                    m_hasWork.wait_until(lock, flushAt, [this] {
+                        return m_closed || !m_priority.empty() || m_queue.size() >= m_limits.maxBatch; });
+                }
+
+                std::deque<Item>& source = m_priority.empty() ? m_queue : m_priority;
+                priority = !m_priority.empty();
+                size_t n = std::min(source.size(), m_limits.maxBatch);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    batch.push_back(std::move(source.front()));
+                    source.pop_front();
+                }
+            }
+
+            commit(batch, priority);
+            batch.clear();
+        }
+    }
+
+    void commit(std::vector<Item>& batch, bool priority) {
+        m_records.clear();
+        m_records.reserve(batch.size());
+        for (auto& item : batch) m_records.push_back(std::move(item.record));
+
+        IngestStatus result = IngestStatus::Committed;
+        try {
+            m_sink.append(m_records);
+            m_sink.sync();
+        } catch (...) {
+            result = IngestStatus::Failed;
+        }
+        const auto synced = Clock::now();
+
+        if (result == IngestStatus::Committed)
+        {
+            if (m_alert)
+            {
+                for (const auto& rec : m_records) m_alert(rec);
+            }
+            for (const auto& listener : m_listeners) listener(m_records);
+        }
+        for (auto& item : batch)
+        {
+            if (item.done) item.done(result);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (priority)
+            {
+                m_priorityInFlight -= batch.size();
+                for (const auto& item : batch)
+                {
+                    auto us = std::chrono::duration_cast<std::chrono::microseconds>(synced - item.enqueued).count();
+                    m_stats.priorityMaxLatencyUs = std::max<uint64_t>(m_stats.priorityMaxLatencyUs, us);
+                }
+            }
+            else
+            {
+                m_inFlight -= batch.size();
+                ++m_stats.groupCommits;
+            }
+            if (result == IngestStatus::Committed)
+            {
+                m_stats.committed += batch.size();
+                if (priority) m_stats.priorityCommitted += batch.size();
+            }
+            else
+            {
+                m_stats.failed += batch.size();
+            }
+        }
+        m_creditFreed.notify_all();
+    }
+
+    RecordSink& m_sink;
+    IngestLimits m_limits;
+    SourceRateLimiter m_rateLimiter;
+    AlertFn m_alert;
+    std::vector<CommitListener> m_listeners;
+    std::vector<DeviceRecord> m_records;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_hasWork;
+    std::condition_variable m_creditFreed;
+    std::deque<Item> m_priority;
+    std::deque<Item> m_queue;
+    size_t m_inFlight = 0;
+    size_t m_priorityInFlight = 0;
+    bool m_closed = false;
+    Stats m_stats;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,262 @@
+// MiniGridMonitor - mergeable ui_latency_ms percentile sketches
+#pragma once
+
+#include "device_record.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Merging t-digest (Dunning). Accuracy is best at the tails, which is what
+// p95/p99 need. Memory is bounded by the compression parameter: roughly
+// compression centroids plus an insert buffer of the same order.
+class TDigest {
+public:
+    explicit TDigest(double compression = 100.0)
+        : m_compression(compression) {}
+
+    void add(double x, double weight = 1.0) {
+        if (std::isnan(x) || weight <= 0) return;
+        m_buffer.push_back({x, weight});
+        m_min = std::min(m_min, x);
+        m_max = std::max(m_max, x);
+        if (m_buffer.size() >= bufferLimit()) compress();
+    }
+
+    void merge(const TDigest& other) {
+        if (other.empty()) return;
+        m_buffer.insert(m_buffer.end(), other.m_centroids.begin(), other.m_centroids.end());
+        m_buffer.insert(m_buffer.end(), other.m_buffer.begin(), other.m_buffer.end());
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        compress();
+    }
+
+    bool empty() const { return m_centroids.empty() && m_buffer.empty(); }
+
+    double count() const {
+        double n = m_totalWeight;
+        for (const auto& c : m_buffer) n += c.weight;
+        return n;
+    }
+
+    // q in [0, 1]; NaN when empty
+    double quantile(double q) {
+        compress();
+        if (m_centroids.empty()) return NAN;
+        if (m_centroids.size() == 1) return m_centroids[0].mean;
+        q = std::min(1.0, std::max(0.0, q));
+
+        const double target = q * m_totalWeight;
+        const Centroid& first = m_centroids.front();
+        if (target < first.weight / 2)
+            return m_min + (first.mean - m_min) * (target / (first.weight / 2));
+
+        double cumulative = 0;
+        for (size_t i = 0; i + 1 < m_centroids.size(); ++i)
+        {
+            const Centroid& a = m_centroids[i];
+            const Centroid& b = m_centroids[i + 1];
+            double left = cumulative + a.weight / 2;
+            double right = cumulative + a.weight + b.weight / 2;
+            if (target <= right)
+            {
+                double t = (target - left) / (right - left);
+                return a.mean + (b.mean - a.mean) * t;
+            }
+            cumulative += a.weight;
+        }
+
+        const Centroid& last = m_centroids.back();
+        double tailStart = m_totalWeight - last.weight / 2;
+        double t = (target - tailStart) / (last.weight / 2);
+        return last.mean + (m_max - last.mean) * std::min(1.0, t);
+    }
+
+    size_t centroidCount() const { return m_centroids.size(); }
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    size_t bufferLimit() const { return static_cast<size_t>(m_compression * 5); }
+
+    // k1 scale function: centroids shrink towards q = 0 and q = 1
+    double scale(double q) const {
+        const double pi = 3.14159265358979323846;
+        return m_compression / (2 * pi) * std::asin(2 * q - 1);
+    }
+
+    void compress() {
+        if (m_buffer.empty()) return;
+        m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+        std::sort(m_buffer.begin(), m_buffer.end(),
+                  [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+        double total = 0;
+        for (const auto& c : m_buffer) total += c.weight;
+
+        m_centroids.clear();
+        Centroid cur = m_buffer[0];
+        double soFar = 0;
+        double kLeft = scale(0);
+        for (size_t i = 1; i < m_buffer.size(); ++i)
+        {
+            const Centroid& next = m_buffer[i];
+            double proposed = cur.weight + next.weight;
+            if (scale((soFar + proposed) / total) - kLeft <= 1.0)
+            {
+                cur.mean += (next.mean - cur.mean) * next.weight / proposed;
+                cur.weight = proposed;
+            }
+            else
+            {
+                soFar += cur.weight;
+                kLeft = scale(soFar / total);
+                m_centroids.push_back(cur);
+                cur = next;
+            }
+        }
+        m_centroids.push_back(cur);
+        m_totalWeight = total;
+        m_buffer.clear();
+    }
+
+    double m_compression;
+    std::vector<Centroid> m_centroids;
+    std::vector<Centroid> m_buffer;
+    double m_totalWeight = 0;
+    double m_min = std::numeric_limits<double>::infinity();
+    double m_max = -std::numeric_limits<double>::infinity();
+};
+
+// ui_latency_ms digests per (app_version, instance_id) slice, kept per hour
+// and per day. A window query merges whole days plus the hours at its
+// edges, so a month costs ~30 + 48 merges per slice, not a scan. Window
+// bounds resolve to whole hours.
+class LatencySketchIndex {
+public:
+    static constexpr int64_t kHour = 3600;
+    static constexpr int64_t kDay = 86400;
+
+    struct Query {
+        int64_t from = std::numeric_limits<int64_t>::min(); // epoch seconds, inclusive
+        int64_t to = std::numeric_limits<int64_t>::max();   // exclusive
+        std::string appVersion; // empty = any
+        std::string instanceId; // empty = any
+    };
+
+    explicit LatencySketchIndex(double compression = 100.0)
+        : m_compression(compression) {}
+
+    void observe(const DeviceRecord& rec) {
+        if (rec.uiLatencyMs < 0) return;
+        int64_t ts;
+        if (!parse_timestamp(rec.createdAt, ts)) return;
+        const std::string slice = sliceKey(rec.appVersion, rec.instanceId);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        digestFor(m_hours, floorTo(ts, kHour), slice).add(rec.uiLatencyMs);
+        digestFor(m_days, floorTo(ts, kDay), slice).add(rec.uiLatencyMs);
+    }
+
+    void observe(const std::vector<DeviceRecord>& batch) {
+        for (const auto& rec : batch) observe(rec);
+    }
+
+    // Merged digest for the window and slice filter
+    TDigest digest(const Query& q) const {
+        TDigest out(m_compression);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Whole days inside [from, to) come from the day level
+        int64_t dayFrom = q.from == std::numeric_limits<int64_t>::min() ? q.from : ceilTo(q.from, kDay);
+        int64_t dayTo = q.to == std::numeric_limits<int64_t>::max() ? q.to : floorTo(q.to, kDay);
+        if (dayFrom < dayTo)
+        {
+            mergeRange(m_days, dayFrom, dayTo, q, out);
+            mergeRange(m_hours, q.from, dayFrom, q, out);
+            mergeRange(m_hours, dayTo, q.to, q, out);
+        }
+        else
+        {
+            mergeRange(m_hours, q.from, q.to, q, out);
+        }
+        return out;
+    }
+
+    std::vector<double> percentiles(const Query& q, const std::vector<double>& ps) const {
+        TDigest d = digest(q);
+        std::vector<double> out;
+        out.reserve(ps.size());
+        for (double p : ps) out.push_back(d.quantile(p / 100.0));
+        return out;
+    }
+
+    // Drop buckets older than `ts` to cap memory for long-running sessions
+    void pruneBefore(int64_t ts) { pruneBefore(ts, ts); }
+
+    // Hour buckets only serve the partial days at a window's edges, so they
+    // can go sooner than the day buckets
+    void pruneBefore(int64_t hoursBefore, int64_t daysBefore) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_hours.erase(m_hours.begin(), m_hours.lower_bound(floorTo(hoursBefore, kHour)));
+        m_days.erase(m_days.begin(), m_days.lower_bound(floorTo(daysBefore, kDay)));
+    }
+
+private:
+    using SliceMap = std::unordered_map<std::string, TDigest>;
+    using Buckets = std::map<int64_t, SliceMap>;
+
+    static std::string sliceKey(const std::string& appVersion, const std::string& instanceId) {
+        return appVersion + '\x1f' + instanceId;
+    }
+
+    static bool sliceMatches(const std::string& key, const Query& q) {
+        size_t sep = key.find('\x1f');
+        if (!q.appVersion.empty() && key.compare(0, sep, q.appVersion) != 0) return false;
+        if (!q.instanceId.empty() && key.compare(sep + 1, std::string::npos, q.instanceId) != 0) return false;
+        return true;
+    }
+
+    static int64_t floorTo(int64_t ts, int64_t width) {
+        int64_t r = ts % width;
+        return r < 0 ? ts - r - width : ts - r;
+    }
+
+    static int64_t ceilTo(int64_t ts, int64_t width) {
+        int64_t f = floorTo(ts, width);
+        return f == ts ? ts : f + width;
+    }
+
+    TDigest& digestFor(Buckets& level, int64_t bucket, const std::string& slice) {
+        SliceMap& slices = level[bucket];
+        auto it = slices.find(slice);
+        if (it == slices.end()) it = slices.emplace(slice, TDigest(m_compression)).first;
+        return it->second;
+    }
+
+    static void mergeRange(const Buckets& level, int64_t from, int64_t to, const Query& q, TDigest& out) {
+        if (from >= to) return;
+        for (auto it = level.lower_bound(from); it != level.end() && it->first < to; ++it)
+        {
+            for (const auto& slice : it->second)
+            {
+                if (sliceMatches(slice.first, q)) out.merge(slice.second);
+            }
+        }
+    }
+
+    double m_compression;
+    mutable std::mutex m_mutex;
+    Buckets m_hours;
+    Buckets m_days;
+};
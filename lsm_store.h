@@ -0,0 +1,1223 @@
+// MiniGridMonitor - embedded LSM store keyed by (device_id, created_at)
+//
+// Writes go to a write-ahead log and a skiplist memtable. A full memtable
+// is frozen and written by a background thread as a sorted, immutable
+// SSTable in level 0; leveled compaction then merges tables down into
+// non-overlapping levels. Every file is written sequentially.
+//
+// Keys are device_id, a 0 byte, created_at as big-endian biased seconds,
+// then the uuid, so one device's readings are contiguous and time ordered:
+// "device X between T1 and T2" is one seek per table plus a short scan.
+// Each table carries a bloom filter over device ids so tables without the
+// device are skipped without touching disk.
+#pragma once
+
+#include "block_cache.h"
+#include "device_record.h"
+#include "file_sync.h"
+#include "record_sink.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lsm_detail {
+struct Entry;
+}
+
+// Decoded table blocks, shareable between stores
+using LsmBlockCache = BlockCache<std::vector<lsm_detail::Entry>>;
+
+struct LsmOptions {
+    size_t memtableBytes = 4 << 20;        // freeze and flush past this
+    size_t l0CompactionTrigger = 4;        // L0 tables before merging into L1
+    uint64_t levelBaseBytes = 16ull << 20; // L1 target; each level is 10x the previous
+    size_t targetFileBytes = 2 << 20;      // compaction output split size
+    size_t blockBytes = 4096;
+    int bloomBitsPerKey = 10;
+    int maxLevels = 6;
+    size_t blockCacheBytes = 32 << 20;     // used when blockCache is not set
+    std::shared_ptr<LsmBlockCache> blockCache;
+};
+
+inline std::string lsm_device_prefix(const std::string& deviceId)
+{
+    std::string key = deviceId;
+    key.push_back('\0');
+    return key;
+}
+
+inline std::string lsm_key(const std::string& deviceId, int64_t createdAt, const std::string& uuid)
+{
+    std::string key = lsm_device_prefix(deviceId);
+    const uint64_t biased = static_cast<uint64_t>(createdAt) ^ (uint64_t(1) << 63);
+    for (int shift = 56; shift >= 0; shift -= 8) key.push_back(static_cast<char>((biased >> shift) & 0xff));
+    key += uuid;
+    return key;
+}
+
+namespace lsm_detail {
+
+inline void put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+inline void put_u64(std::string& out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+inline uint32_t get_u32(const char* p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+inline uint64_t get_u64(const char* p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+inline uint64_t hash64(std::string_view s, uint64_t seed = 0)
+{
+    uint64_t h = 1469598103934665603ull ^ seed;
+    for (unsigned char c : s)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+inline uint32_t checksum(std::string_view s)
+{
+    return static_cast<uint32_t>(hash64(s, 0x5bd1e995));
+}
+
+// Distinct per open table, so stores can share one block cache
+inline uint64_t next_table_cache_id()
+{
+    static std::atomic<uint64_t> next{1};
+    return next++;
+}
+
+// Device id part of a key (up to and including the 0 byte)
+inline std::string_view key_device(std::string_view key)
+{
+    size_t zero = key.find('\0');
+    return zero == std::string_view::npos ? key : key.substr(0, zero + 1);
+}
+
+// Double-hashed bloom filter
+class BloomFilter {
+public:
+    BloomFilter() = default;
+
+    BloomFilter(size_t keys, int bitsPerKey) {
+        const size_t bits = std::max<size_t>(64, keys * size_t(bitsPerKey));
+        m_bits.assign((bits + 7) / 8, 0);
+        m_probes = std::max(1, std::min(30, int(bitsPerKey * 0.69)));
+    }
+
+    void add(std::string_view key) {
+        uint64_t h = hash64(key);
+        const uint64_t delta = (h >> 33) | (h << 31);
+        const size_t n = m_bits.size() * 8;
+        for (int i = 0; i < m_probes; ++i, h += delta) m_bits[(h % n) / 8] |= uint8_t(1u << ((h % n) % 8));
+    }
+
+    bool mayContain(std::string_view key) const {
+        if (m_bits.empty()) return true;
+        uint64_t h = hash64(key);
+        const uint64_t delta = (h >> 33) | (h << 31);
+        const size_t n = m_bits.size() * 8;
+        for (int i = 0; i < m_probes; ++i, h += delta)
+        {
+            if (!(m_bits[(h % n) / 8] & (1u << ((h % n) % 8)))) return false;
+        }
+        return true;
+    }
+
+    std::string serialize() const {
+        std::string out(1, static_cast<char>(m_probes));
+        out.append(reinterpret_cast<const char*>(m_bits.data()), m_bits.size());
+        return out;
+    }
+
+    static BloomFilter parse(std::string_view s) {
+        BloomFilter f;
+        if (s.empty()) return f;
+        f.m_probes = static_cast<unsigned char>(s[0]);
+        f.m_bits.assign(s.begin() + 1, s.end());
+        return f;
+    }
+
+private:
+    std::vector<uint8_t> m_bits;
+    int m_probes = 0;
+};
+
+struct Entry {
+    std::string key;
+    std::string value;
+    bool tombstone = false;
+};
+
+// Single-writer skiplist. The store's mutex guards the live memtable;
+// once frozen it is read without locks.
+class SkipList {
+    struct Node;
+
+public:
+    static constexpr int kMaxHeight = 12;
+
+    SkipList() : m_head(new Node(kMaxHeight)) {}
+
+    ~SkipList() {
+        Node* n = m_head;
+        while (n)
+        {
+            Node* next = n->next[0];
+            delete n;
+            n = next;
+        }
+    }
+
+    SkipList(const SkipList&) = delete;
+    SkipList& operator=(const SkipList&) = delete;
+
+    // Inserts or overwrites
+    void put(std::string key, std::string value, bool tombstone) {
+        Node* prev[kMaxHeight];
+        Node* x = m_head;
+        for (int level = m_height - 1; level >= 0; --level)
+        {
+            while (x->next[level] && x->next[level]->entry.key < key) x = x->next[level];
+            prev[level] = x;
+        }
+        Node* found = x->next[0];
+        if (found && found->entry.key == key)
+        {
+            m_bytes = m_bytes - found->entry.value.size() + value.size();
+            found->entry.value = std::move(value);
+            found->entry.tombstone = tombstone;
+            return;
+        }
+        const int height = randomHeight();
+        for (int level = m_height; level < height; ++level) prev[level] = m_head;
+        m_height = std::max(m_height, height);
+        Node* n = new Node(height);
+        m_bytes += key.size() + value.size() + sizeof(Node) + height * sizeof(Node*);
+        n->entry = Entry{std::move(key), std::move(value), tombstone};
+        for (int level = 0; level < height; ++level)
+        {
+            n->next[level] = prev[level]->next[level];
+            prev[level]->next[level] = n;
+        }
+        ++m_count;
+    }
+
+    size_t bytes() const { return m_bytes; }
+    size_t count() const { return m_count; }
+
+    class Iterator {
+    public:
+        explicit Iterator(const SkipList* list) : m_list(list) {}
+        bool valid() const { return m_node != nullptr; }
+        const Entry& entry() const { return m_node->entry; }
+        void next() { m_node = m_node->next[0]; }
+        void seekToFirst() { m_node = m_list->m_head->next[0]; }
+        void seek(std::string_view target) {
+            const Node* x = m_list->m_head;
+            for (int level = m_list->m_height - 1; level >= 0; --level)
+            {
+                while (x->next[level] && std::string_view(x->next[level]->entry.key) < target) x = x->next[level];
+            }
+            m_node = x->next[0];
+        }
+
+    private:
+        const SkipList* m_list;
+        const Node* m_node = nullptr;
+    };
+
+private:
+    struct Node {
+        explicit Node(int height) : next(height, nullptr) {}
+        Entry entry;
+        std::vector<Node*> next;
+    };
+
+    int randomHeight() {
+        int h = 1;
+        while (h < kMaxHeight && (m_rng() & 3) == 0) ++h; // p = 1/4
+        return h;
+    }
+
+    Node* m_head;
+    int m_height = 1;
+    size_t m_bytes = 0;
+    size_t m_count = 0;
+    std::minstd_rand m_rng{0x2545F491};
+};
+
+} // namespace lsm_detail
+
+// Immutable sorted run. Layout: data blocks (entries, then a 4-byte
+// checksum), an index of (last key, offset, size) per block, the bloom
+// filter, and a fixed 40-byte footer. The index and filter stay in memory.
+class SsTable {
+    struct BlockHandle {
+        std::string lastKey;
+        uint64_t offset = 0;
+        uint32_t size = 0;
+    };
+
+public:
+    static constexpr uint64_t kMagic = 0x4d47524c534d5401ull; // "MGRLSM" v1
+
+    SsTable(std::string path, uint64_t fileNumber, LsmBlockCache* cache = nullptr)
+        : m_path(std::move(path)), m_number(fileNumber), m_cache(cache), m_cacheId(lsm_detail::next_table_cache_id()) {
+        using namespace lsm_detail;
+        std::ifstream in(m_path, std::ios::in | std::ios::binary);
+        if (!in)
+            throw std::runtime_error("unable to open table: " + m_path);
+        in.seekg(0, std::ios::end);
+        m_fileBytes = static_cast<uint64_t>(in.tellg());
+        if (m_fileBytes < 40)
+            throw std::runtime_error("table too small: " + m_path);
+        char footer[40];
+        in.seekg(static_cast<std::streamoff>(m_fileBytes - 40));
+        in.read(footer, 40);
+        if (get_u64(footer + 32) != kMagic)
+            throw std::runtime_error("bad table footer: " + m_path);
+        const uint64_t indexOff = get_u64(footer), indexSize = get_u64(footer + 8);
+        const uint64_t bloomOff = get_u64(footer + 16), bloomSize = get_u64(footer + 24);
+        if (indexOff + indexSize > m_fileBytes || bloomOff + bloomSize > m_fileBytes)
+            throw std::runtime_error("bad table footer: " + m_path);
+
+        std::string index(indexSize, '\0'), bloom(bloomSize, '\0');
+        in.seekg(static_cast<std::streamoff>(indexOff));
+        in.read(&index[0], static_cast<std::streamsize>(indexSize));
+        in.seekg(static_cast<std::streamoff>(bloomOff));
+        in.read(&bloom[0], static_cast<std::streamsize>(bloomSize));
+        if (!in)
+            throw std::runtime_error("unable to read table: " + m_path);
+        m_bloom = BloomFilter::parse(bloom);
+
+        for (size_t p = 0; p + 4 <= index.size();)
+        {
+            const uint32_t klen = get_u32(&index[p]);
+            if (p + 4 + klen + 12 > index.size())
+                throw std::runtime_error("bad table index: " + m_path);
+            BlockHandle h;
+            h.lastKey.assign(&index[p + 4], klen);
+            h.offset = get_u64(&index[p + 4 + klen]);
+            h.size = get_u32(&index[p + 12 + klen]);
+            m_blocks.push_back(std::move(h));
+            p += 4 + klen + 12;
+        }
+        if (!m_blocks.empty())
+        {
+            Iterator it(this, false);
+            it.seekToFirst();
+            if (it.valid()) m_smallest = it.entry().key;
+            m_largest = m_blocks.back().lastKey;
+        }
+    }
+
+    ~SsTable() {
+        if (m_cache) m_cache->eraseFile(m_cacheId);
+        if (m_obsolete)
+        {
+            std::error_code ec;
+            std::filesystem::remove(m_path, ec);
+        }
+    }
+
+    SsTable(const SsTable&) = delete;
+    SsTable& operator=(const SsTable&) = delete;
+
+    const std::string& path() const { return m_path; }
+    uint64_t number() const { return m_number; }
+    uint64_t fileBytes() const { return m_fileBytes; }
+    const std::string& smallest() const { return m_smallest; }
+    const std::string& largest() const { return m_largest; }
+
+    bool overlaps(std::string_view lo, std::string_view hi) const {
+        return !m_blocks.empty() && std::string_view(m_largest) >= lo && std::string_view(m_smallest) <= hi;
+    }
+
+    bool mayContainDevice(std::string_view devicePrefix) const { return m_bloom.mayContain(devicePrefix); }
+
+    // Deleted from disk once the last reader lets go
+    void markObsolete() const { m_obsolete = true; }
+
+    // Blocks come from the table's cache when it has one. Compactions pass
+    // useCache = false so a one-off merge neither reads nor evicts there.
+    class Iterator {
+    public:
+        explicit Iterator(const SsTable* table, bool useCache = true)
+            : m_table(table), m_cache(useCache ? table->m_cache : nullptr) {}
+
+        bool valid() const { return m_entries && m_pos < m_entries->size(); }
+        const lsm_detail::Entry& entry() const { return (*m_entries)[m_pos]; }
+
+        void next() {
+            if (++m_pos >= m_entries->size() && m_block + 1 < m_table->m_blocks.size()) load(m_block + 1);
+        }
+
+        void seekToFirst() {
+            if (m_table->m_blocks.empty()) return;
+            load(0);
+        }
+
+        void seek(std::string_view target) {
+            const auto& blocks = m_table->m_blocks;
+            auto it = std::lower_bound(blocks.begin(), blocks.end(), target,
+                                       [](const BlockHandle& b, std::string_view t) { return std::string_view(b.lastKey) < t; });
+            if (it == blocks.end())
+            {
+                m_entries.reset();
+                m_pos = 0;
+                return;
+            }
+            load(static_cast<size_t>(it - blocks.begin()));
+            while (valid() && std::string_view(entry().key) < target) ++m_pos;
+        }
+
+    private:
+        void load(size_t block) {
+            const BlockHandle& h = m_table->m_blocks[block];
+            m_block = block;
+            m_pos = 0;
+            if (!m_cache)
+            {
+                m_entries = std::make_shared<const std::vector<lsm_detail::Entry>>(decode(h).first);
+                return;
+            }
+            m_entries = m_cache->getOrLoad(m_table->m_cacheId, h.offset, [&]() { return decode(h); });
+        }
+
+        // Reads and checks one block; returns its entries and their size
+        std::pair<std::vector<lsm_detail::Entry>, size_t> decode(const BlockHandle& h) {
+            using namespace lsm_detail;
+            if (!m_in.is_open()) m_in.open(m_table->m_path, std::ios::in | std::ios::binary);
+            m_buffer.resize(h.size + 4);
+            m_in.clear();
+            m_in.seekg(static_cast<std::streamoff>(h.offset));
+            m_in.read(&m_buffer[0], static_cast<std::streamsize>(m_buffer.size()));
+            if (!m_in || get_u32(&m_buffer[h.size]) != checksum(std::string_view(m_buffer.data(), h.size)))
+                throw std::runtime_error("corrupt block in table: " + m_table->m_path);
+            std::vector<Entry> entries;
+            size_t charge = 0;
+            for (size_t p = 0; p + 9 <= h.size;)
+            {
+                const bool tomb = m_buffer[p] != 0;
+                const uint32_t klen = get_u32(&m_buffer[p + 1]), vlen = get_u32(&m_buffer[p + 5]);
+                entries.push_back(Entry{std::string(&m_buffer[p + 9], klen), std::string(&m_buffer[p + 9 + klen], vlen), tomb});
+                charge += sizeof(Entry) + klen + vlen;
+                p += 9 + size_t(klen) + vlen;
+            }
+            return {std::move(entries), charge};
+        }
+
+        const SsTable* m_table;
+        LsmBlockCache* m_cache;
+        std::ifstream m_in;      // opened on the first cache miss
+        std::string m_buffer;
+        LsmBlockCache::Handle m_entries;
+        size_t m_block = 0;
+        size_t m_pos = 0;
+    };
+
+    // Writes a table from entries in ascending key order
+    class Writer {
+    public:
+        Writer(const std::string& path, size_t expectedKeys, const LsmOptions& options)
+            : m_path(path), m_blockBytes(options.blockBytes), m_bloom(expectedKeys, options.bloomBitsPerKey) {
+            m_file = std::fopen(path.c_str(), "wb");
+            if (!m_file)
+                throw std::runtime_error("unable to open file for writing: " + path);
+        }
+
+        ~Writer() {
+            if (m_file) std::fclose(m_file);
+        }
+
+        void add(const lsm_detail::Entry& e) {
+            using namespace lsm_detail;
+            const std::string_view device = key_device(e.key);
+            if (device != m_lastDevice)
+            {
+                m_bloom.add(device);
+                m_lastDevice.assign(device.data(), device.size());
+            }
+            m_block.push_back(e.tombstone ? 1 : 0);
+            put_u32(m_block, static_cast<uint32_t>(e.key.size()));
+            put_u32(m_block, static_cast<uint32_t>(e.value.size()));
+            m_block += e.key;
+            m_block += e.value;
+            m_lastKey = e.key;
+            if (m_block.size() >= m_blockBytes) flushBlock();
+        }
+
+        uint64_t bytesWritten() const { return m_offset + m_block.size(); }
+
+        // Writes index, filter and footer, then syncs
+        void finish() {
+            using namespace lsm_detail;
+            flushBlock();
+            const uint64_t indexOff = m_offset;
+            write(m_index);
+            const std::string bloom = m_bloom.serialize();
+            const uint64_t bloomOff = m_offset;
+            write(bloom);
+            std::string footer;
+            put_u64(footer, indexOff);
+            put_u64(footer, m_index.size());
+            put_u64(footer, bloomOff);
+            put_u64(footer, bloom.size());
+            put_u64(footer, kMagic);
+            write(footer);
+            sync_file(m_file, m_path);
+            std::fclose(m_file);
+            m_file = nullptr;
+        }
+
+    private:
+        void flushBlock() {
+            using namespace lsm_detail;
+            if (m_block.empty()) return;
+            put_u32(m_index, static_cast<uint32_t>(m_lastKey.size()));
+            m_index += m_lastKey;
+            put_u64(m_index, m_offset);
+            put_u32(m_index, static_cast<uint32_t>(m_block.size()));
+            put_u32(m_block, checksum(m_block));
+            write(m_block);
+            m_block.clear();
+        }
+
+        void write(const std::string& data) {
+            if (std::fwrite(data.data(), 1, data.size(), m_file) != data.size())
+                throw std::runtime_error("unable to write file: " + m_path);
+            m_offset += data.size();
+        }
+
+        std::string m_path;
+        size_t m_blockBytes;
+        std::FILE* m_file = nullptr;
+        uint64_t m_offset = 0;
+        std::string m_block;
+        std::string m_index;
+        std::string m_lastKey;
+        std::string m_lastDevice;
+        lsm_detail::BloomFilter m_bloom;
+    };
+
+private:
+    std::string m_path;
+    uint64_t m_number;
+    LsmBlockCache* m_cache;
+    uint64_t m_cacheId;
+    uint64_t m_fileBytes = 0;
+    std::vector<BlockHandle> m_blocks;
+    lsm_detail::BloomFilter m_bloom;
+    std::string m_smallest;
+    std::string m_largest;
+    mutable std::atomic<bool> m_obsolete{false};
+};
+
+namespace lsm_detail {
+
+// K-way merge over sources ordered newest first. For keys present in
+// several sources only the newest version is surfaced.
+class MergingIterator {
+public:
+    void addMemtable(const SkipList* list) { m_sources.push_back(Source{std::make_unique<SkipList::Iterator>(list), nullptr, nullptr}); }
+    void addEntries(const std::vector<Entry>* entries) { m_sources.push_back(Source{nullptr, nullptr, entries}); }
+    void addTable(const SsTable* table, bool useCache = true) {
+        m_sources.push_back(Source{nullptr, std::make_unique<SsTable::Iterator>(table, useCache), nullptr});
+    }
+
+    void seek(std::string_view target) {
+        for (auto& s : m_sources) s.seek(target);
+        rebuild();
+    }
+
+    void seekToFirst() {
+        for (auto& s : m_sources) s.seekToFirst();
+        rebuild();
+    }
+
+    bool valid() const { return !m_heap.empty(); }
+    const Entry& entry() const { return m_sources[m_heap.front()].entry(); }
+
+    void next() {
+        const std::string key = entry().key;
+        // Advance every source sitting on this key (older duplicates)
+        while (!m_heap.empty() && m_sources[m_heap.front()].entry().key == key)
+        {
+            std::pop_heap(m_heap.begin(), m_heap.end(), m_later);
+            const size_t s = m_heap.back();
+            m_heap.pop_back();
+            m_sources[s].next();
+            if (m_sources[s].valid())
+            {
+                m_heap.push_back(s);
+                std::push_heap(m_heap.begin(), m_heap.end(), m_later);
+            }
+        }
+    }
+
+private:
+    struct Source {
+        std::unique_ptr<SkipList::Iterator> mem;
+        std::unique_ptr<SsTable::Iterator> table;
+        const std::vector<Entry>* entries;
+        size_t pos = 0;
+
+        bool valid() const {
+            if (mem) return mem->valid();
+            if (table) return table->valid();
+            return pos < entries->size();
+        }
+        const Entry& entry() const {
+            if (mem) return mem->entry();
+            if (table) return table->entry();
+            return (*entries)[pos];
+        }
+        void next() {
+            if (mem) mem->next();
+            else if (table) table->next();
+            else ++pos;
+        }
+        void seek(std::string_view t) {
+            if (mem) mem->seek(t);
+            else if (table) table->seek(t);
+            else pos = static_cast<size_t>(std::lower_bound(entries->begin(), entries->end(), t,
+                [](const Entry& e, std::string_view k) { return std::string_view(e.key) < k; }) - entries->begin());
+        }
+        void seekToFirst() {
+            if (mem) mem->seekToFirst();
+            else if (table) table->seekToFirst();
+            else pos = 0;
+        }
+    };
+
+    void rebuild() {
+        m_heap.clear();
+        for (size_t s = 0; s < m_sources.size(); ++s)
+        {
+            if (m_sources[s].valid()) m_heap.push_back(s);
+        }
+        std::make_heap(m_heap.begin(), m_heap.end(), m_later);
+    }
+
+    std::vector<Source> m_sources;
+    std::vector<size_t> m_heap;
+    // Heap top = smallest key, ties to the newest (lowest index) source
+    std::function<bool(size_t, size_t)> m_later = [this](size_t a, size_t b) {
+        const std::string& ka = m_sources[a].entry().key;
+        const std::string& kb = m_sources[b].entry().key;
+        return ka != kb ? ka > kb : a > b;
+    };
+};
+
+} // namespace lsm_detail
+
+// The store. One directory holds MANIFEST, the live WAL files and the
+// tables. Safe for concurrent writers and readers; flushes and compactions
+// run on the store's own background thread.
+class LsmStore {
+public:
+    struct LevelStats {
+        size_t tables = 0;
+        uint64_t bytes = 0;
+    };
+
+    struct Stats {
+        std::vector<LevelStats> levels;
+        size_t memtableBytes = 0;
+        uint64_t flushes = 0;
+        uint64_t compactions = 0;
+        uint64_t compactionBytesWritten = 0;
+        LsmBlockCache::Stats blockCache;
+    };
+
+    explicit LsmStore(const std::string& dir, LsmOptions options = LsmOptions())
+        : m_dir(dir), m_options(options),
+          m_cache(options.blockCache ? options.blockCache : std::make_shared<LsmBlockCache>(options.blockCacheBytes)),
+          m_levels(static_cast<size_t>(std::max(2, options.maxLevels))), m_compactPointer(m_levels.size()) {
+        std::filesystem::create_directories(m_dir);
+        recover();
+        m_worker = std::thread([this]() { backgroundLoop(); });
+    }
+
+    ~LsmStore() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_workCv.notify_all();
+        m_worker.join();
+        if (m_wal) std::fclose(m_wal);
+    }
+
+    LsmStore(const LsmStore&) = delete;
+    LsmStore& operator=(const LsmStore&) = delete;
+
+    // Buffered in the WAL; durable after sync(). Records without a
+    // parseable created_at are rejected.
+    void write(const std::vector<DeviceRecord>& batch) {
+        std::vector<lsm_detail::Entry> entries;
+        entries.reserve(batch.size());
+        for (const auto& rec : batch)
+        {
+            int64_t ts;
+            if (!parse_timestamp(rec.createdAt, ts))
+                throw std::runtime_error("record " + rec.uuid + " has no valid created_at");
+            entries.push_back(lsm_detail::Entry{lsm_key(rec.deviceId, ts, rec.uuid), to_csv_row(rec), false});
+        }
+        apply(std::move(entries));
+    }
+
+    void put(const DeviceRecord& rec) { write({rec}); }
+
+    // Tombstone; the reading disappears from scans
+    void remove(const std::string& deviceId, int64_t createdAt, const std::string& uuid) {
+        std::vector<lsm_detail::Entry> entries;
+        entries.push_back(lsm_detail::Entry{lsm_key(deviceId, createdAt, uuid), std::string(), true});
+        apply(std::move(entries));
+    }
+
+    // Replaces the stored reading `before` with `after` (nullptr = removes
+    // it) in one write. When the key changes the new key goes first, so a
+    // torn WAL tail can leave both versions but never neither.
+    void replace(const DeviceRecord& before, const DeviceRecord* after) {
+        int64_t oldTs, newTs = 0;
+        if (!parse_timestamp(before.createdAt, oldTs))
+            throw std::runtime_error("record " + before.uuid + " has no valid created_at");
+        if (after && !parse_timestamp(after->createdAt, newTs))
+            throw std::runtime_error("record " + after->uuid + " has no valid created_at");
+        std::string oldKey = lsm_key(before.deviceId, oldTs, before.uuid);
+        std::vector<lsm_detail::Entry> entries;
+        if (after) entries.push_back(lsm_detail::Entry{lsm_key(after->deviceId, newTs, after->uuid), to_csv_row(*after), false});
+        if (entries.empty() || entries.front().key != oldKey)
+            entries.push_back(lsm_detail::Entry{std::move(oldKey), std::string(), true});
+        apply(std::move(entries));
+    }
+
+    void sync() {
+        std::lock_guard<std::mutex> lock(m_walMutex);
+        if (m_wal) sync_file(m_wal, m_walPath);
+    }
+
+    // Readings of `deviceId` with from <= created_at <= to, in time order
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) const {
+        const std::string prefix = lsm_device_prefix(deviceId);
+        const std::string hi = to == INT64_MAX ? prefix + std::string(9, '\xff') : lsm_key(deviceId, to + 1, std::string());
+        scanRange(lsm_key(deviceId, from, std::string()), hi, &prefix, fn);
+    }
+
+    // Every live reading, grouped by device and in time order within one
+    void scan(const std::function<void(DeviceRecord&&)>& fn) const {
+        scanRange(std::string(), std::string(1, '\xff'), nullptr, fn);
+    }
+
+    // Puts and removes applied since the store was opened; changes with
+    // every write that scans can see
+    uint64_t writeCount() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_writes;
+    }
+
+    // Freezes the memtable and waits until it is on disk as an L0 table
+    void flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait(lock, [this]() { return !m_imm; });
+        if (m_mem->count() == 0) return;
+        rotateMemtable(lock);
+        m_doneCv.wait(lock, [this]() { return !m_imm; });
+    }
+
+    // Blocks until no flush or compaction is pending
+    void waitForIdle() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait(lock, [this]() { return !m_imm && !m_busy && !compactionNeeded(); });
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s;
+        for (const auto& level : m_levels)
+        {
+            LevelStats ls;
+            ls.tables = level.size();
+            for (const auto& t : level) ls.bytes += t->fileBytes();
+            s.levels.push_back(ls);
+        }
+        s.memtableBytes = m_mem->bytes();
+        s.flushes = m_flushes;
+        s.compactions = m_compactions;
+        s.compactionBytesWritten = m_compactionBytes;
+        s.blockCache = m_cache->stats();
+        return s;
+    }
+
+private:
+    using TablePtr = std::shared_ptr<const SsTable>;
+
+    struct Version {
+        std::vector<lsm_detail::Entry> memEntries; // copied range of the live memtable
+        std::shared_ptr<const lsm_detail::SkipList> imm;
+        std::vector<TablePtr> tables;              // newest first
+    };
+
+    std::string tablePath(uint64_t n) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%06llu.sst", static_cast<unsigned long long>(n));
+        return (std::filesystem::path(m_dir) / name).string();
+    }
+
+    std::string walPath(uint64_t n) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%06llu.wal", static_cast<unsigned long long>(n));
+        return (std::filesystem::path(m_dir) / name).string();
+    }
+
+    void apply(std::vector<lsm_detail::Entry> entries) {
+        using namespace lsm_detail;
+        std::string frame;
+        for (const auto& e : entries)
+        {
+            std::string payload(1, e.tombstone ? '\1' : '\0');
+            put_u32(payload, static_cast<uint32_t>(e.key.size()));
+            put_u32(payload, static_cast<uint32_t>(e.value.size()));
+            payload += e.key;
+            payload += e.value;
+            put_u32(frame, checksum(payload));
+            put_u32(frame, static_cast<uint32_t>(payload.size()));
+            frame += payload;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Backpressure: only one frozen memtable may wait for its flush
+        m_doneCv.wait(lock, [this]() { return m_mem->bytes() < m_options.memtableBytes || !m_imm; });
+        if (m_mem->bytes() >= m_options.memtableBytes) rotateMemtable(lock);
+        {
+            std::lock_guard<std::mutex> walLock(m_walMutex);
+            if (std::fwrite(frame.data(), 1, frame.size(), m_wal) != frame.size())
+                throw std::runtime_error("unable to write file: " + m_walPath);
+        }
+        for (auto& e : entries) m_mem->put(std::move(e.key), std::move(e.value), e.tombstone);
+        m_writes += entries.size();
+    }
+
+    // Caller holds m_mutex and has checked m_imm is empty
+    void rotateMemtable(std::unique_lock<std::mutex>&) {
+        const uint64_t n = m_nextFile++;
+        std::FILE* wal = std::fopen(walPath(n).c_str(), "ab");
+        if (!wal)
+            throw std::runtime_error("unable to open file for append: " + walPath(n));
+        {
+            std::lock_guard<std::mutex> walLock(m_walMutex);
+            if (m_wal)
+            {
+                sync_file(m_wal, m_walPath);
+                std::fclose(m_wal);
+            }
+            m_wal = wal;
+            m_walPath = walPath(n);
+        }
+        m_immWal = m_walNumber;
+        m_walNumber = n;
+        m_imm = std::move(m_mem);
+        m_mem = std::make_shared<lsm_detail::SkipList>();
+        m_workCv.notify_all();
+    }
+
+    Version snapshot(const std::string& lo, const std::string& hi) const {
+        Version v;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        lsm_detail::SkipList::Iterator it(m_mem.get());
+        for (it.seek(lo); it.valid() && it.entry().key < hi; it.next()) v.memEntries.push_back(it.entry());
+        v.imm = m_imm;
+        for (const auto& level : m_levels)
+        {
+            for (const auto& t : level)
+            {
+                if (t->overlaps(lo, hi)) v.tables.push_back(t);
+            }
+        }
+        return v;
+    }
+
+    // Keys in [lo, hi); tables whose bloom filter rules out `devicePrefix` are skipped
+    void scanRange(const std::string& lo, const std::string& hi, const std::string* devicePrefix,
+                   const std::function<void(DeviceRecord&&)>& fn) const {
+        Version v = snapshot(lo, hi);
+        lsm_detail::MergingIterator it;
+        it.addEntries(&v.memEntries);
+        if (v.imm) it.addMemtable(v.imm.get());
+        for (const auto& t : v.tables)
+        {
+            if (!devicePrefix || t->mayContainDevice(*devicePrefix)) it.addTable(t.get());
+        }
+        for (it.seek(lo); it.valid() && it.entry().key < hi; it.next())
+        {
+            if (it.entry().tombstone) continue;
+            DeviceRecord rec;
+            if (from_csv_row(parse_csv_line(it.entry().value), rec)) fn(std::move(rec));
+        }
+    }
+
+    uint64_t levelTarget(size_t level) const {
+        uint64_t target = m_options.levelBaseBytes;
+        for (size_t l = 1; l < level; ++l) target *= 10;
+        return target;
+    }
+
+    // Caller holds m_mutex. Level with the highest score >= 1, or -1.
+    int pickCompactionLevel() const {
+        double best = 1.0;
+        int level = -1;
+        if (m_levels[0].size() >= m_options.l0CompactionTrigger)
+        {
+            best = double(m_levels[0].size()) / double(m_options.l0CompactionTrigger);
+            level = 0;
+        }
+        for (size_t l = 1; l + 1 < m_levels.size(); ++l)
+        {
+            uint64_t bytes = 0;
+            for (const auto& t : m_levels[l]) bytes += t->fileBytes();
+            const double score = double(bytes) / double(levelTarget(l));
+            if (score >= best) { best = score; level = static_cast<int>(l); }
+        }
+        return level;
+    }
+
+    bool compactionNeeded() const { return pickCompactionLevel() >= 0; }
+
+    void backgroundLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_workCv.wait(lock, [this]() { return m_stopping || m_imm || compactionNeeded(); });
+            if (m_stopping) return;
+            m_busy = true;
+            try {
+                if (m_imm) flushImmutable(lock);
+                else compactLevel(pickCompactionLevel(), lock);
+            }
+            catch (const std::exception&) {
+                // Leave the state as it was; the WAL still holds the data.
+                // Back off instead of spinning on a persistent I/O error.
+                // Table writes run unlocked, so the lock may be released.
+                if (!lock.owns_lock()) lock.lock();
+                m_busy = false;
+                m_doneCv.notify_all();
+                m_workCv.wait_for(lock, std::chrono::seconds(1), [this]() { return m_stopping; });
+                continue;
+            }
+            m_busy = false;
+            m_doneCv.notify_all();
+        }
+    }
+
+    void flushImmutable(std::unique_lock<std::mutex>& lock) {
+        std::shared_ptr<const lsm_detail::SkipList> imm = m_imm;
+        const uint64_t number = m_nextFile++;
+        const uint64_t oldWal = m_immWal;
+        lock.unlock();
+
+        TablePtr table;
+        try {
+            {
+                SsTable::Writer w(tablePath(number), imm->count(), m_options);
+                lsm_detail::SkipList::Iterator it(imm.get());
+                for (it.seekToFirst(); it.valid(); it.next()) w.add(it.entry());
+                w.finish();
+            }
+            table = std::make_shared<const SsTable>(tablePath(number), number, m_cache.get());
+        }
+        catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(tablePath(number), ec);
+            throw;
+        }
+
+        lock.lock();
+        m_levels[0].insert(m_levels[0].begin(), table);
+        m_imm.reset();
+        ++m_flushes;
+        writeManifest();
+        std::error_code ec;
+        std::filesystem::remove(walPath(oldWal), ec);
+    }
+
+    void compactLevel(int level, std::unique_lock<std::mutex>& lock) {
+        if (level < 0) return;
+        const size_t from = static_cast<size_t>(level);
+        const size_t to = from + 1;
+
+        std::vector<TablePtr> inputs;
+        if (from == 0)
+        {
+            inputs = m_levels[0];
+        }
+        else
+        {
+            // Round-robin through the level's key space
+            const auto& tables = m_levels[from];
+            size_t pick = 0;
+            for (size_t i = 0; i < tables.size(); ++i)
+            {
+                if (tables[i]->smallest() > m_compactPointer[from]) { pick = i; break; }
+            }
+            inputs.push_back(tables[pick]);
+            m_compactPointer[from] = tables[pick]->largest();
+        }
+        std::string lo = inputs.front()->smallest(), hi = inputs.front()->largest();
+        for (const auto& t : inputs)
+        {
+            lo = std::min(lo, t->smallest());
+            hi = std::max(hi, t->largest());
+        }
+        std::vector<TablePtr> overlapping;
+        for (const auto& t : m_levels[to])
+        {
+            if (t->overlaps(lo, hi)) overlapping.push_back(t);
+        }
+        // Tombstones can go once nothing older could still hold the key
+        bool bottom = true;
+        for (size_t l = to + 1; l < m_levels.size(); ++l) bottom = bottom && m_levels[l].empty();
+        lock.unlock();
+
+        std::vector<TablePtr> outputs;
+        std::vector<uint64_t> started; // every output file, removed if the merge fails
+        uint64_t written = 0;
+        std::unique_ptr<SsTable::Writer> w;
+        try {
+            lsm_detail::MergingIterator it;
+            for (const auto& t : inputs) it.addTable(t.get(), false);        // newest first
+            for (const auto& t : overlapping) it.addTable(t.get(), false);
+            uint64_t number = 0;
+            auto finishOutput = [&]() {
+                if (!w) return;
+                w->finish();
+                written += w->bytesWritten();
+                w.reset();
+                outputs.push_back(std::make_shared<const SsTable>(tablePath(number), number, m_cache.get()));
+            };
+            for (it.seekToFirst(); it.valid(); it.next())
+            {
+                const lsm_detail::Entry& e = it.entry();
+                if (e.tombstone && bottom) continue;
+                if (!w)
+                {
+                    {
+                        std::lock_guard<std::mutex> relock(m_mutex);
+                        number = m_nextFile++;
+                    }
+                    started.push_back(number);
+                    w = std::make_unique<SsTable::Writer>(tablePath(number), m_options.targetFileBytes / 64, m_options);
+                }
+                w->add(e);
+                if (w->bytesWritten() >= m_options.targetFileBytes) finishOutput();
+            }
+            finishOutput();
+        }
+        catch (...) {
+            // Nothing references the outputs yet; close and delete them
+            w.reset();
+            outputs.clear();
+            std::error_code ec;
+            for (uint64_t n : started) std::filesystem::remove(tablePath(n), ec);
+            throw;
+        }
+
+        lock.lock();
+        auto drop = [](std::vector<TablePtr>& level, const std::vector<TablePtr>& gone) {
+            level.erase(std::remove_if(level.begin(), level.end(), [&](const TablePtr& t) {
+                return std::find(gone.begin(), gone.end(), t) != gone.end();
+            }), level.end());
+        };
+        drop(m_levels[from], inputs);
+        drop(m_levels[to], overlapping);
+        m_levels[to].insert(m_levels[to].end(), outputs.begin(), outputs.end());
+        std::sort(m_levels[to].begin(), m_levels[to].end(),
+                  [](const TablePtr& a, const TablePtr& b) { return a->smallest() < b->smallest(); });
+        ++m_compactions;
+        m_compactionBytes += written;
+        writeManifest();
+        for (const auto& t : inputs) t->markObsolete();
+        for (const auto& t : overlapping) t->markObsolete();
+    }
+
+    // Caller holds m_mutex. Written to a temp file and renamed into place.
+    void writeManifest() {
+        std::string text = "next " + std::to_string(m_nextFile) + "\nwal " + std::to_string(m_imm ? m_immWal : m_walNumber) + "\n";
+        for (size_t l = 0; l < m_levels.size(); ++l)
+        {
+            for (const auto& t : m_levels[l]) text += "table " + std::to_string(l) + " " + std::to_string(t->number()) + "\n";
+        }
+        const std::string path = (std::filesystem::path(m_dir) / "MANIFEST").string();
+        const std::string tmp = path + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f)
+            throw std::runtime_error("unable to open file for writing: " + tmp);
+        const bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+        sync_file(f, tmp);
+        std::fclose(f);
+        if (!ok)
+            throw std::runtime_error("unable to write file: " + tmp);
+        std::filesystem::rename(tmp, path);
+    }
+
+    // Loads MANIFEST, opens its tables and replays every live WAL
+    void recover() {
+        namespace fs = std::filesystem;
+        uint64_t firstWal = 0;
+        std::ifstream manifest((fs::path(m_dir) / "MANIFEST").string());
+        std::string word;
+        while (manifest >> word)
+        {
+            if (word == "next") manifest >> m_nextFile;
+            else if (word == "wal") manifest >> firstWal;
+            else if (word == "table")
+            {
+                size_t level;
+                uint64_t number;
+                manifest >> level >> number;
+                if (level >= m_levels.size()) throw std::runtime_error("bad MANIFEST in " + m_dir);
+                m_levels[level].push_back(std::make_shared<const SsTable>(tablePath(number), number, m_cache.get()));
+            }
+        }
+
+        // Tables missing from MANIFEST are leftovers of an interrupted
+        // flush or compaction
+        std::vector<uint64_t> live;
+        for (const auto& level : m_levels)
+        {
+            for (const auto& t : level) live.push_back(t->number());
+        }
+        std::vector<uint64_t> wals;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(m_dir))
+        {
+            const std::string ext = entry.path().extension().string();
+            if (ext != ".wal" && ext != ".sst") continue;
+            const uint64_t n = std::strtoull(entry.path().stem().string().c_str(), nullptr, 10);
+            m_nextFile = std::max(m_nextFile, n + 1);
+            if (ext == ".wal" && n >= firstWal) wals.push_back(n);
+            else if (ext == ".sst" && std::find(live.begin(), live.end(), n) == live.end()) fs::remove(entry.path(), ec);
+        }
+        std::sort(wals.begin(), wals.end());
+        m_mem = std::make_shared<lsm_detail::SkipList>();
+        for (uint64_t n : wals) replayWal(walPath(n));
+
+        // Replayed data goes out as a fresh L0 table so the old logs can go
+        m_walNumber = m_nextFile++;
+        m_walPath = walPath(m_walNumber);
+        m_wal = std::fopen(m_walPath.c_str(), "ab");
+        if (!m_wal)
+            throw std::runtime_error("unable to open file for append: " + m_walPath);
+        if (m_mem->count() > 0)
+        {
+            const uint64_t number = m_nextFile++;
+            SsTable::Writer w(tablePath(number), m_mem->count(), m_options);
+            lsm_detail::SkipList::Iterator it(m_mem.get());
+            for (it.seekToFirst(); it.valid(); it.next()) w.add(it.entry());
+            w.finish();
+            m_levels[0].insert(m_levels[0].begin(), std::make_shared<const SsTable>(tablePath(number), number, m_cache.get()));
+            m_mem = std::make_shared<lsm_detail::SkipList>();
+        }
+        writeManifest();
+        for (uint64_t n : wals) fs::remove(walPath(n), ec);
+    }
+
+    // Stops at the first torn or corrupt frame (an interrupted last write)
+    void replayWal(const std::string& path) {
+        using namespace lsm_detail;
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        for (size_t p = 0; p + 8 <= data.size();)
+        {
+            const uint32_t sum = get_u32(&data[p]), len = get_u32(&data[p + 4]);
+            if (len < 9 || p + 8 + len > data.size()) break;
+            const std::string_view payload(&data[p + 8], len);
+            if (checksum(payload) != sum) break;
+            const uint32_t klen = get_u32(payload.data() + 1), vlen = get_u32(payload.data() + 5);
+            if (9 + size_t(klen) + vlen != len) break;
+            m_mem->put(std::string(payload.substr(9, klen)), std::string(payload.substr(9 + klen, vlen)), payload[0] != 0);
+            p += 8 + len;
+        }
+    }
+
+    std::string m_dir;
+    LsmOptions m_options;
+    std::shared_ptr<LsmBlockCache> m_cache; // outlives the tables that point at it
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workCv;
+    std::condition_variable m_doneCv;
+    std::shared_ptr<lsm_detail::SkipList> m_mem;
+    std::shared_ptr<const lsm_detail::SkipList> m_imm;
+    std::vector<std::vector<TablePtr>> m_levels; // L0 newest first; L1+ sorted by key
+    std::vector<std::string> m_compactPointer; // per level, last key compacted
+    uint64_t m_nextFile = 1;
+    uint64_t m_walNumber = 0;
+    uint64_t m_immWal = 0;
+    bool m_busy = false;
+    bool m_stopping = false;
+    uint64_t m_flushes = 0;
+    uint64_t m_compactions = 0;
+    uint64_t m_compactionBytes = 0;
+    uint64_t m_writes = 0; // puts and removes applied since open
+
+    std::mutex m_walMutex; // orders WAL writes against rotation and sync()
+    std::FILE* m_wal = nullptr;
+    std::string m_walPath;
+
+    std::thread m_worker;
+};
+
+// Commits ingest batches into an LsmStore; a drop-in for CsvRecordSink
+class LsmRecordSink : public RecordSink {
+public:
+    explicit LsmRecordSink(LsmStore& store)
+        : m_store(store) {}
+
+    using RecordSink::append;
+    void append(const std::vector<DeviceRecord>& batch) override { m_store.write(batch); }
+    void sync() override {
+        beforeSync();
+        m_store.sync();
+    }
+
+private:
+    LsmStore& m_store;
+};
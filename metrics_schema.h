@@ -0,0 +1,281 @@
+// MiniGridMonitor - user-defined metrics declared in a schema file
+//
+// Built-in readings (voltage, temperature, ui_latency_ms) are fixed columns.
+// Anything else a site wants to capture (load %, oil level, current,
+// humidity) is declared in metrics_schema.csv:
+//
+//     name,type,label,unit,min,max,required,values
+//     load_pct,number,Load,%,0,150,no,
+//     oil_level,enum,Oil Level,,,,no,Low|Normal|High
+//
+// Values travel with the record as name=value pairs in one trailing
+// "metrics" column, so adding or retiring a metric never rewrites existing
+// rows; rows that predate a metric simply have no value for it. Typed
+// columns are materialized from a batch on demand (MetricColumns).
+#pragma once
+
+#include "aggregate_kernels.h"
+#include "device_record.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class MetricType { Number, Integer, Enum };
+
+struct MetricDef {
+    std::string name;    // key in the metrics column, [a-z0-9_]
+    MetricType type = MetricType::Number;
+    std::string label;   // form caption, defaults to name
+    std::string unit;
+    double min = NAN;    // NaN = unbounded
+    double max = NAN;
+    bool required = false;
+    std::vector<std::string> values; // Enum only
+};
+
+// Declared metrics plus the validation rules generated from them
+class MetricsSchema {
+public:
+    // Returns an error message, empty when the value is acceptable
+    using Rule = std::function<std::string(const std::string& value)>;
+
+    // Throws std::runtime_error on unreadable files, unknown types, names
+    // the metrics column cannot hold, duplicate names and enums without
+    // values.
+    void load(const std::string& path) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in)
+            throw std::runtime_error("unable to open metrics schema: " + path);
+        if (in.peek() == 0xEF) in.ignore(3);
+
+        std::vector<MetricDef> defs;
+        std::string line;
+        bool header = true;
+        while (read_csv_record(in, line))
+        {
+            if (header) { header = false; continue; }
+            if (line.empty() || line[0] == '#') continue;
+            auto cols = parse_csv_line(line);
+            cols.resize(8);
+            MetricDef d;
+            d.name = cols[0];
+            if (d.name.empty()) continue;
+            // Names are written unescaped (see append_encoded_metrics)
+            if (d.name.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789_") != std::string::npos)
+                throw std::runtime_error("metric name '" + d.name + "' may only contain a-z, 0-9 and '_'");
+            if (cols[1] == "number") d.type = MetricType::Number;
+            else if (cols[1] == "integer") d.type = MetricType::Integer;
+            else if (cols[1] == "enum") d.type = MetricType::Enum;
+            else throw std::runtime_error("metric " + d.name + " has unknown type '" + cols[1] + "'");
+            d.label = cols[2].empty() ? d.name : cols[2];
+            d.unit = cols[3];
+            d.min = parse_number(cols[4]);
+            d.max = parse_number(cols[5]);
+            d.required = cols[6] == "yes" || cols[6] == "true" || cols[6] == "1";
+            size_t pos = 0;
+            while (d.type == MetricType::Enum && pos <= cols[7].size())
+            {
+                size_t bar = cols[7].find('|', pos);
+                if (bar == std::string::npos) bar = cols[7].size();
+                if (bar > pos) d.values.push_back(cols[7].substr(pos, bar - pos));
+                pos = bar + 1;
+            }
+            if (d.type == MetricType::Enum && d.values.empty())
+                throw std::runtime_error("enum metric " + d.name + " has no values");
+            if (d.type == MetricType::Enum && d.values.size() > 255)
+                throw std::runtime_error("enum metric " + d.name + " has more than 255 values");
+            for (const auto& prev : defs)
+            {
+                if (prev.name == d.name) throw std::runtime_error("metric " + d.name + " is declared twice");
+            }
+            defs.push_back(std::move(d));
+        }
+
+        m_defs = std::move(defs);
+        m_index.clear();
+        m_rules.clear();
+        for (size_t i = 0; i < m_defs.size(); ++i)
+        {
+            m_index[m_defs[i].name] = i;
+            m_rules.push_back(makeRules(m_defs[i]));
+        }
+    }
+
+    const std::vector<MetricDef>& metrics() const { return m_defs; }
+
+    // -1 when the metric is not declared
+    int indexOf(const std::string& name) const {
+        auto it = m_index.find(name);
+        return it == m_index.end() ? -1 : static_cast<int>(it->second);
+    }
+
+    // Runs the metric's rules in order; false and `message` set on the first failure
+    bool validate(size_t metric, const std::string& value, std::string& message) const {
+        for (const Rule& rule : m_rules.at(metric))
+        {
+            message = rule(value);
+            if (!message.empty()) return false;
+        }
+        return true;
+    }
+
+    // Every declared metric against a record; returns (metric, message) per failure
+    std::vector<std::pair<size_t, std::string>> validate(const DeviceRecord& rec) const {
+        std::vector<std::pair<size_t, std::string>> errors;
+        std::vector<const std::string*> values(m_defs.size(), nullptr);
+        for (const auto& kv : rec.metrics)
+        {
+            int i = indexOf(kv.first);
+            if (i >= 0) values[i] = &kv.second;
+        }
+        static const std::string empty;
+        std::string message;
+        for (size_t i = 0; i < m_defs.size(); ++i)
+        {
+            if (!validate(i, values[i] ? *values[i] : empty, message)) errors.emplace_back(i, message);
+        }
+        return errors;
+    }
+
+private:
+    // Same wording as the built-in form validators
+    static std::vector<Rule> makeRules(const MetricDef& d) {
+        std::vector<Rule> rules;
+        const std::string label = d.label;
+        if (d.required)
+        {
+            rules.push_back([label](const std::string& v) {
+                return v.empty() ? label + " is required" : std::string();
+            });
+        }
+        if (d.type == MetricType::Enum)
+        {
+            const std::vector<std::string> values = d.values;
+            rules.push_back([label, values](const std::string& v) {
+                if (v.empty() || std::find(values.begin(), values.end(), v) != values.end()) return std::string();
+                return label + " has an invalid value";
+            });
+            return rules;
+        }
+
+        const bool integer = d.type == MetricType::Integer;
+        rules.push_back([label, integer](const std::string& v) {
+            if (v.empty()) return std::string();
+            size_t used = 0;
+            try {
+                if (integer) (void)std::stoll(v, &used);
+                else if (!std::isfinite(std::stod(v, &used))) used = 0; // "nan", "inf"
+            } catch (...) {
+                used = 0;
+            }
+            if (used != v.size()) return label + (integer ? " must be a valid integer" : " must be a valid number");
+            return std::string();
+        });
+        if (!std::isnan(d.min) || !std::isnan(d.max))
+        {
+            const double lo = d.min, hi = d.max;
+            rules.push_back([label, lo, hi](const std::string& v) {
+                if (v.empty()) return std::string();
+                const double x = parse_number(v);
+                if ((!std::isnan(lo) && x < lo) || (!std::isnan(hi) && x > hi))
+                {
+                    if (std::isnan(lo)) return label + " must be at most " + format_number(hi);
+                    if (std::isnan(hi)) return label + " must be at least " + format_number(lo);
+                    return label + " must be between " + format_number(lo) + " and " + format_number(hi);
+                }
+                return std::string();
+            });
+        }
+        return rules;
+    }
+
+    std::vector<MetricDef> m_defs;
+    std::unordered_map<std::string, size_t> m_index;
+    std::vector<std::vector<Rule>> m_rules;
+};
+
+// Typed columns for a batch of records, one per declared metric. Numeric
+// metrics become float columns with a validity bitmap (feed them to the
+// aggregate kernels via view()); enums become uint8 codes where 0 = missing
+// and k = values[k - 1].
+class MetricColumns {
+public:
+    explicit MetricColumns(const MetricsSchema& schema)
+        : m_schema(schema), m_columns(schema.metrics().size()) {}
+
+    void append(const DeviceRecord& rec) {
+        const size_t row = m_rows++;
+        for (size_t i = 0; i < m_columns.size(); ++i)
+        {
+            Column& c = m_columns[i];
+            if (m_schema.metrics()[i].type == MetricType::Enum)
+            {
+                c.codes.push_back(0);
+                continue;
+            }
+            c.values.push_back(NAN);
+            if (row % 64 == 0) c.validity.push_back(0);
+        }
+        for (const auto& kv : rec.metrics)
+        {
+            int i = m_schema.indexOf(kv.first);
+            if (i < 0) continue; // retired or unknown metric
+            const MetricDef& d = m_schema.metrics()[i];
+            Column& c = m_columns[i];
+            if (d.type == MetricType::Enum)
+            {
+                auto it = std::find(d.values.begin(), d.values.end(), kv.second);
+                if (it != d.values.end()) c.codes[row] = static_cast<uint8_t>(it - d.values.begin() + 1);
+            }
+            else
+            {
+                const double x = parse_number(kv.second);
+                if (std::isnan(x)) continue;
+                c.values[row] = float(x);
+                c.validity[row / 64] |= uint64_t(1) << (row % 64);
+            }
+        }
+    }
+
+    void append(const std::vector<DeviceRecord>& batch) {
+        for (const auto& rec : batch) append(rec);
+    }
+
+    size_t rows() const { return m_rows; }
+
+    // Drops the rows but keeps the column buffers for the next batch
+    void clear() {
+        for (Column& c : m_columns)
+        {
+            c.values.clear();
+            c.validity.clear();
+            c.codes.clear();
+        }
+        m_rows = 0;
+    }
+
+    FloatColumnView view(size_t metric) const {
+        const Column& c = m_columns.at(metric);
+        return FloatColumnView{c.values.data(), c.validity.data(), m_rows};
+    }
+
+    const std::vector<uint8_t>& codes(size_t metric) const { return m_columns.at(metric).codes; }
+
+private:
+    struct Column {
+        std::vector<float> values;      // numeric metrics
+        std::vector<uint64_t> validity;
+        std::vector<uint8_t> codes;     // enum metrics
+    };
+
+    const MetricsSchema& m_schema;
+    std::vector<Column> m_columns;
+    size_t m_rows = 0;
+};
@@ -0,0 +1,85 @@
+// MiniGridMonitor - bounded pool of reusable heap objects
+//
+// acquire() hands out a Lease, a unique_ptr whose deleter resets the
+// object with Reset and keeps it for the next acquire(); beyond `maxIdle`
+// idle objects a returned one is freed instead. Leases may be returned
+// from any thread; the pool must outlive them.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+template <typename T, typename Reset>
+class ObjectPool {
+public:
+    struct Stats {
+        uint64_t created = 0;
+        uint64_t reused = 0;
+        size_t idle = 0;
+    };
+
+    class Return {
+    public:
+        Return(ObjectPool* pool = nullptr) : m_pool(pool) {}
+        void operator()(T* object) const {
+            if (m_pool) m_pool->release(object);
+            else delete object;
+        }
+
+    private:
+        ObjectPool* m_pool;
+    };
+
+    using Lease = std::unique_ptr<T, Return>;
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    ObjectPool(size_t maxIdle, Factory make, Reset reset = Reset())
+        : m_maxIdle(maxIdle), m_make(std::move(make)), m_reset(std::move(reset)) {
+        m_idle.reserve(maxIdle);
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    Lease acquire() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_idle.empty())
+            {
+                T* object = m_idle.back().release();
+                m_idle.pop_back();
+                ++m_stats.reused;
+                return Lease(object, Return(this));
+            }
+            ++m_stats.created;
+        }
+        return Lease(m_make().release(), Return(this));
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s = m_stats;
+        s.idle = m_idle.size();
+        return s;
+    }
+
+private:
+    void release(T* object) {
+        m_reset(*object);
+        std::unique_ptr<T> owned(object);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle.size() < m_maxIdle) m_idle.push_back(std::move(owned));
+    }
+
+    size_t m_maxIdle;
+    Factory m_make;
+    Reset m_reset;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_idle;
+    Stats m_stats;
+};
@@ -0,0 +1,257 @@
+// MiniGridMonitor - dashboard query results cached against append watermarks
+//
+// Dashboard tiles ask the same questions on every refresh. A result is
+// cached under its normalized query together with the store's append
+// watermark at the time it was computed. A later request at the same
+// watermark is answered from the cache; one at a later position of the
+// same generation reads only the readings appended in between and merges
+// them in, since the summary is a plain sum. A new generation (a
+// correction, a compaction, any LSM write) or a backend that cannot read
+// by position means a full recompute.
+#pragma once
+
+#include "aggregate_kernels.h"
+#include "record_batch.h"
+#include "storage_backend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// One tile's question. Empty strings match everything; status and
+// severity compare case-insensitively. Tiles over a sliding window should
+// round `from` to their refresh granularity so refreshes share an entry.
+struct ReadingQuery {
+    std::string deviceId;
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    std::string status;
+    std::string severity;
+
+    // Cache key: trimmed fields, folded case, and every empty range alike
+    std::string normalized() const {
+        const bool empty = from > to;
+        return trim(deviceId) + '\x1f' + std::to_string(empty ? 1 : from) + '\x1f' + std::to_string(empty ? 0 : to) +
+               '\x1f' + fold(status) + '\x1f' + fold(severity);
+    }
+
+    bool matches(const DeviceRecord& rec) const {
+        return (status.empty() || fold(rec.status) == fold(status)) &&
+               (severity.empty() || fold(rec.severity) == fold(severity));
+    }
+
+    static std::string trim(const std::string& s) {
+        size_t b = 0, e = s.size();
+        while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+        while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+        return s.substr(b, e - b);
+    }
+
+    static std::string fold(const std::string& s) {
+        std::string out = trim(s);
+        for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return out;
+    }
+};
+
+// What a tile shows. Every field is a sum, count or extreme, so summaries
+// of disjoint sets of readings merge exactly.
+struct ReadingSummary {
+    uint64_t readings = 0;
+    ColumnStats voltage;
+    ColumnStats temperature;
+    uint64_t byStatus[4] = {};   // status_index() order
+    uint64_t bySeverity[5] = {}; // unknown, then severity_rank() 0..3
+    int64_t first = INT64_MAX;
+    int64_t last = INT64_MIN;
+
+    void add(const DeviceRecord& rec) {
+        ++readings;
+        voltage.add(rec.voltage);
+        temperature.add(rec.temperature);
+        ++byStatus[status_index(rec.status)];
+        ++bySeverity[severity_rank(rec.severity) + 1];
+        int64_t ts;
+        if (parse_timestamp(rec.createdAt, ts))
+        {
+            first = std::min(first, ts);
+            last = std::max(last, ts);
+        }
+    }
+
+    // Same totals as add() for every row, with the value columns summarized
+    // by the SIMD kernels and status/severity counted per dictionary code.
+    // For scans that already produce batches; copying DeviceRecords into
+    // one just to call this costs more than add() saves. Needs the
+    // CreatedAt, Status, Severity, Voltage and Temperature columns.
+    void add(const RecordBatch& batch) {
+        const size_t n = batch.size();
+        readings += n;
+        voltage.merge(column_stats(batch.voltage()));
+        temperature.merge(column_stats(batch.temperature()));
+        countCodes(batch.status(), byStatus, [](std::string_view s) { return status_index(s); });
+        countCodes(batch.severity(), bySeverity, [](std::string_view s) { return severity_rank(s) + 1; });
+        const int64_t* ts = batch.createdTs();
+        const ValidityBitmap& valid = batch.createdValid();
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!valid.test(i)) continue;
+            first = std::min(first, ts[i]);
+            last = std::max(last, ts[i]);
+        }
+    }
+
+    void merge(const ReadingSummary& o) {
+        readings += o.readings;
+        voltage.merge(o.voltage);
+        temperature.merge(o.temperature);
+        for (size_t i = 0; i < 4; ++i) byStatus[i] += o.byStatus[i];
+        for (size_t i = 0; i < 5; ++i) bySeverity[i] += o.bySeverity[i];
+        first = std::min(first, o.first);
+        last = std::max(last, o.last);
+    }
+
+private:
+    // Per-code counts, then one bucket lookup per distinct value
+    template <typename Bucket>
+    static void countCodes(const DictionaryColumn& column, uint64_t* buckets, Bucket bucket) {
+        uint64_t local[64] = {};
+        std::vector<uint64_t> spill;
+        const size_t distinct = column.cardinality();
+        uint64_t* counts = local;
+        if (distinct > 64)
+        {
+            spill.assign(distinct, 0);
+            counts = spill.data();
+        }
+        const uint32_t* codes = column.codes();
+        for (size_t i = 0, n = column.size(); i < n; ++i) ++counts[codes[i]];
+        for (uint32_t c = 0; c < distinct; ++c) buckets[bucket(column.value(c))] += counts[c];
+    }
+};
+
+class QueryResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;       // answered at an unchanged watermark
+        uint64_t deltas = 0;     // cached result plus newly appended readings
+        uint64_t recomputes = 0; // full reads (first request, new generation)
+        size_t entries = 0;
+    };
+
+    explicit QueryResultCache(RecordStore& store, size_t maxEntries = 64)
+        : m_store(store), m_maxEntries(std::max<size_t>(maxEntries, 1)) {}
+
+    QueryResultCache(const QueryResultCache&) = delete;
+    QueryResultCache& operator=(const QueryResultCache&) = delete;
+
+    // Safe to call from several threads; store reads run without the
+    // cache lock held
+    ReadingSummary query(const ReadingQuery& q) {
+        const std::string key = q.normalized();
+        const AppendWatermark now = m_store.watermark();
+        Entry cached;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(key);
+            if (it != m_entries.end())
+            {
+                it->second.lastUsed = ++m_tick;
+                if (it->second.watermark == now)
+                {
+                    ++m_stats.hits;
+                    return it->second.summary;
+                }
+                cached = it->second;
+                found = true;
+            }
+        }
+
+        const std::string device = ReadingQuery::trim(q.deviceId);
+        ReadingSummary result;
+        auto fold = [&](DeviceRecord&& rec) {
+            if (q.matches(rec)) result.add(rec);
+        };
+        bool delta = false;
+        if (q.from > q.to)
+        {
+            // Nothing can match
+        }
+        else if (found && cached.watermark.generation == now.generation && cached.watermark.position < now.position &&
+                 m_store.scanAppended(device, q.from, q.to, cached.watermark.position, now.position, fold))
+        {
+            result.merge(cached.summary);
+            delta = true;
+        }
+        else if (!m_store.scanAppended(device, q.from, q.to, 0, now.position, fold))
+        {
+            // Unbounded read: anything it sees beyond `now` belongs to a
+            // later generation, which will not match this entry again
+            result = ReadingSummary();
+            if (device.empty())
+            {
+                m_store.scan([&](DeviceRecord&& rec) {
+                    int64_t ts;
+                    if (parse_timestamp(rec.createdAt, ts) && ts >= q.from && ts <= q.to) fold(std::move(rec));
+                });
+            }
+            else
+            {
+                m_store.scan(device, q.from, q.to, fold);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++(delta ? m_stats.deltas : m_stats.recomputes);
+        Entry& e = m_entries[key];
+        // Keep whichever of two racing refreshes saw more
+        if (e.watermark.generation != now.generation || e.watermark.position <= now.position)
+        {
+            e.watermark = now;
+            e.summary = result;
+        }
+        e.lastUsed = ++m_tick;
+        if (m_entries.size() > m_maxEntries) evictOldest();
+        return result;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stats s = m_stats;
+        s.entries = m_entries.size();
+        return s;
+    }
+
+private:
+    struct Entry {
+        AppendWatermark watermark;
+        ReadingSummary summary;
+        uint64_t lastUsed = 0;
+    };
+
+    void evictOldest() {
+        auto oldest = m_entries.begin();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+        }
+        m_entries.erase(oldest);
+    }
+
+    RecordStore& m_store;
+    size_t m_maxEntries;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    uint64_t m_tick = 0;
+    Stats m_stats;
+};
@@ -0,0 +1,185 @@
+// MiniGridMonitor - batches of readings whose text lives in one arena
+//
+// Bulk import handles millions of rows that only live until their batch
+// is committed. A RecordArenaBatch keeps each row as a RecordRef (string
+// views plus numbers) allocated, with all of its field bytes, in a pooled
+// MonotonicArena, so building, writing and dropping a batch costs no
+// per-field allocations.
+#pragma once
+
+#include "arena.h"
+#include "device_record.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// DeviceRecord with its text in an arena. `metrics` stays in its encoded
+// "name=value;..." form.
+struct RecordRef {
+    std::string_view uuid;
+    std::string_view createdAt;
+    std::string_view operatorId;
+    std::string_view instanceId;
+    std::string_view appVersion;
+    std::string_view deviceId;
+    std::string_view deviceName;
+    std::string_view status;
+    std::string_view actionType;
+    double voltage = NAN;
+    double temperature = NAN;
+    std::string_view severity;
+    int uiLatencyMs = -1;
+    std::string_view notes;
+    WaveformRef waveform;
+    std::string_view metrics;
+
+    DeviceRecord toRecord() const {
+        DeviceRecord r;
+        r.uuid = std::string(uuid);
+        r.createdAt = std::string(createdAt);
+        r.operatorId = std::string(operatorId);
+        r.instanceId = std::string(instanceId);
+        r.appVersion = std::string(appVersion);
+        r.deviceId = std::string(deviceId);
+        r.deviceName = std::string(deviceName);
+        r.status = std::string(status);
+        r.actionType = std::string(actionType);
+        r.voltage = voltage;
+        r.temperature = temperature;
+        r.severity = std::string(severity);
+        r.uiLatencyMs = uiLatencyMs;
+        r.notes = std::string(notes);
+        r.waveform = waveform;
+        r.metrics = decode_metrics(std::string(metrics));
+        return r;
+    }
+};
+
+// Rows of one batch, plus the rows rejected while building it. clear()
+// hands the arena back to the pool and leases a reset one, keeping the
+// index vectors' capacity.
+class RecordArenaBatch {
+public:
+    struct Rejection {
+        size_t line;
+        std::string_view message; // in the batch's arena
+    };
+
+    explicit RecordArenaBatch(ArenaPool& pool)
+        : m_pool(pool), m_arena(pool.acquire()) {}
+
+    RecordRef& add() {
+        RecordRef* r = m_arena->make<RecordRef>();
+        m_rows.push_back(r);
+        return *r;
+    }
+
+    void reject(size_t line, std::string_view message) { m_rejections.push_back(Rejection{line, message}); }
+
+    void clear() {
+        m_rows.clear();
+        m_rejections.clear();
+        m_arena = m_pool.acquire();
+    }
+
+    size_t size() const { return m_rows.size(); }
+    bool empty() const { return m_rows.empty(); }
+    const RecordRef& operator[](size_t i) const { return *m_rows[i]; }
+    RecordRef& operator[](size_t i) { return *m_rows[i]; }
+
+    const std::vector<Rejection>& rejections() const { return m_rejections; }
+
+    MonotonicArena& arena() { return *m_arena; }
+
+    std::vector<DeviceRecord> toRecords() const {
+        std::vector<DeviceRecord> out;
+        out.reserve(m_rows.size());
+        for (const RecordRef* r : m_rows) out.push_back(r->toRecord());
+        return out;
+    }
+
+private:
+    ArenaPool& m_pool;
+    ArenaPool::Lease m_arena;
+    std::vector<RecordRef*> m_rows;
+    std::vector<Rejection> m_rejections;
+};
+
+// from_csv_row() into the batch's arena. `cols` is in header order.
+inline bool from_csv_row(const std::vector<std::string>& cols, MonotonicArena& arena, RecordRef& r)
+{
+    if (cols.size() < 14) return false;
+    r.uuid = arena.copy(cols[0]);
+    r.createdAt = arena.copy(cols[1]);
+    r.operatorId = arena.copy(cols[2]);
+    r.instanceId = arena.copy(cols[3]);
+    r.appVersion = arena.copy(cols[4]);
+    r.deviceId = arena.copy(cols[5]);
+    r.deviceName = arena.copy(cols[6]);
+    r.status = arena.copy(cols[7]);
+    r.actionType = arena.copy(cols[8]);
+    r.voltage = parse_number(cols[9]);
+    r.temperature = parse_number(cols[10]);
+    r.severity = arena.copy(cols[11]);
+    const double lat = parse_number(cols[12]);
+    r.uiLatencyMs = std::isnan(lat) ? -1 : static_cast<int>(lat);
+    r.notes = arena.copy(cols[13]);
+    r.waveform = WaveformRef();
+    if (cols.size() > 14) parse_waveform_ref(cols[14], r.waveform);
+    r.metrics = cols.size() > 15 ? arena.copy(cols[15]) : std::string_view();
+    return true;
+}
+
+// csv_escape() appended straight onto `out`
+inline void append_csv_field(std::string& out, std::string_view s)
+{
+    if (s.find_first_of("\",\n\r") == std::string_view::npos)
+    {
+        out.append(s.data(), s.size());
+        return;
+    }
+    out.push_back('"');
+    for (char c : s)
+    {
+        if (c == '"') out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+// to_csv_row() appended onto `out`, without temporaries
+inline void append_csv_row(std::string& out, const RecordRef& r)
+{
+    char num[64];
+    auto number = [&](double v) {
+        if (!std::isnan(v)) out.append(num, static_cast<size_t>(std::snprintf(num, sizeof(num), "%.10g", v)));
+        out.push_back(',');
+    };
+    const std::string_view text[] = {r.uuid, r.createdAt, r.operatorId, r.instanceId, r.appVersion,
+                                     r.deviceId, r.deviceName, r.status, r.actionType};
+    for (std::string_view s : text)
+    {
+        append_csv_field(out, s);
+        out.push_back(',');
+    }
+    number(r.voltage);
+    number(r.temperature);
+    append_csv_field(out, r.severity);
+    out.push_back(',');
+    if (r.uiLatencyMs >= 0) out.append(num, static_cast<size_t>(std::snprintf(num, sizeof(num), "%d", r.uiLatencyMs)));
+    out.push_back(',');
+    append_csv_field(out, r.notes);
+    out.push_back(',');
+    if (!r.waveform.empty())
+    {
+        out.append(num, static_cast<size_t>(std::snprintf(num, sizeof(num), "%lld:%u:%.9g",
+                                                          static_cast<long long>(r.waveform.offset), r.waveform.samples,
+                                                          r.waveform.sampleRate)));
+    }
+    out.push_back(',');
+    append_csv_field(out, r.metrics);
+}
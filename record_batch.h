@@ -0,0 +1,388 @@
+// MiniGridMonitor - reusable columnar batches of readings
+//
+// Aggregation stages work on columns: voltage and temperature as float
+// columns with validity bitmaps (the aggregate kernels' FloatColumnView),
+// low-cardinality text as per-batch dictionary codes, free text as one
+// offsets array plus one byte buffer. A RecordBatch keeps all of its
+// buffers across clear(), and RecordBatchPool hands cleared batches to the
+// next user, so a stage allocates nothing per batch once warm.
+//
+// Batches hold record_batch_rows() rows by default: enough that the
+// columns a scan loop touches together fill about half of L2.
+#pragma once
+
+#include "aggregate_kernels.h"
+#include "device_record.h"
+#include "object_pool.h"
+#include "record_arena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+// Per-core L2 size in bytes, 256 KiB when it cannot be determined
+inline size_t l2_cache_bytes()
+{
+    static const size_t bytes = [] {
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+        const long n = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (n > 0) return static_cast<size_t>(n);
+#endif
+#if defined(GRID_X86)
+        // Extended leaf 0x80000006: ECX[31:16] is the L2 size in KiB
+        unsigned regs[4] = {};
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0x80000000);
+        if (static_cast<unsigned>(info[0]) >= 0x80000006)
+        {
+            __cpuid(info, 0x80000006);
+            regs[2] = static_cast<unsigned>(info[2]);
+        }
+#else
+        unsigned maxLeaf;
+        __asm__("cpuid" : "=a"(maxLeaf), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(0x80000000u));
+        regs[2] = 0;
+        if (maxLeaf >= 0x80000006u)
+            __asm__("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(0x80000006u));
+#endif
+        if (regs[2] >> 16) return static_cast<size_t>(regs[2] >> 16) << 10;
+#endif
+        return static_cast<size_t>(256) << 10;
+    }();
+    return bytes;
+}
+
+// Null bitmap in FloatColumnView layout: bit i set = row i has a value
+class ValidityBitmap {
+public:
+    void push(bool valid) {
+        if (m_size % 64 == 0) m_words.push_back(0);
+        m_words.back() |= uint64_t(valid) << (m_size % 64);
+        ++m_size;
+    }
+
+    bool test(size_t i) const { return (m_words[i / 64] >> (i % 64)) & 1; }
+    const uint64_t* data() const { return m_words.data(); }
+    size_t size() const { return m_size; }
+
+    void reserve(size_t rows) { m_words.reserve((rows + 63) / 64); }
+    void clear() {
+        m_words.clear();
+        m_size = 0;
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_size = 0;
+};
+
+// Variable-length text: row i is bytes[offsets[i], offsets[i + 1])
+class StringColumn {
+public:
+    StringColumn() { m_offsets.push_back(0); }
+
+    uint32_t append(std::string_view s) {
+        m_bytes.append(s.data(), s.size());
+        m_offsets.push_back(static_cast<uint32_t>(m_bytes.size()));
+        return static_cast<uint32_t>(m_offsets.size() - 2);
+    }
+
+    // fn(std::string& bytes) appends the row's text
+    template <typename F>
+    uint32_t appendWith(F&& fn) {
+        fn(m_bytes);
+        m_offsets.push_back(static_cast<uint32_t>(m_bytes.size()));
+        return static_cast<uint32_t>(m_offsets.size() - 2);
+    }
+
+    std::string_view operator[](size_t i) const {
+        return std::string_view(m_bytes.data() + m_offsets[i], m_offsets[i + 1] - m_offsets[i]);
+    }
+
+    size_t size() const { return m_offsets.size() - 1; }
+    const std::vector<uint32_t>& offsets() const { return m_offsets; }
+    const std::string& bytes() const { return m_bytes; }
+
+    void reserve(size_t rows, size_t bytes) {
+        m_offsets.reserve(rows + 1);
+        m_bytes.reserve(bytes);
+    }
+    void clear() {
+        m_offsets.resize(1);
+        m_bytes.clear();
+    }
+
+private:
+    std::vector<uint32_t> m_offsets;
+    std::string m_bytes;
+};
+
+// Text replaced by dense codes into a per-batch dictionary, in first-seen
+// order. Codes are only meaningful within one batch.
+class DictionaryColumn {
+public:
+    void append(std::string_view s) {
+        if ((m_values.size() + 1) * 2 > m_slots.size()) rehash(std::max<size_t>(16, m_slots.size() * 2));
+        const size_t mask = m_slots.size() - 1;
+        for (size_t i = std::hash<std::string_view>()(s) & mask;; i = (i + 1) & mask)
+        {
+            const uint32_t code = m_slots[i];
+            if (code == kEmpty)
+            {
+                m_slots[i] = m_values.append(s);
+                m_codes.push_back(m_slots[i]);
+                return;
+            }
+            if (m_values[code] == s)
+            {
+                m_codes.push_back(code);
+                return;
+            }
+        }
+    }
+
+    size_t size() const { return m_codes.size(); }
+    uint32_t code(size_t row) const { return m_codes[row]; }
+    std::string_view operator[](size_t row) const { return m_values[m_codes[row]]; }
+    const uint32_t* codes() const { return m_codes.data(); }
+
+    // Distinct values; value(c) for c < cardinality()
+    size_t cardinality() const { return m_values.size(); }
+    std::string_view value(uint32_t code) const { return m_values[code]; }
+
+    void reserve(size_t rows) { m_codes.reserve(rows); }
+    void clear() {
+        m_codes.clear();
+        m_values.clear();
+        std::fill(m_slots.begin(), m_slots.end(), kEmpty);
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    void rehash(size_t n) {
+        m_slots.assign(n, kEmpty);
+        for (uint32_t c = 0; c < m_values.size(); ++c)
+        {
+            size_t i = std::hash<std::string_view>()(m_values[c]) & (n - 1);
+            while (m_slots[i] != kEmpty) i = (i + 1) & (n - 1);
+            m_slots[i] = c;
+        }
+    }
+
+    std::vector<uint32_t> m_codes;
+    StringColumn m_values;
+    std::vector<uint32_t> m_slots; // open addressing over m_values
+};
+
+// Rows a batch holds by default. A scan over a batch reads about
+// kScanBytesPerRow bytes per row (the numeric columns and the
+// device/status/severity codes); size the batch so that stays within half
+// of L2, leaving room for the aggregation state.
+inline size_t record_batch_rows()
+{
+    constexpr size_t kScanBytesPerRow = 4 + 4 + 4 + 8 + 4 + 4 + 4 + 1;
+    const size_t rows = l2_cache_bytes() / 2 / kScanBytesPerRow;
+    return std::min<size_t>(std::max<size_t>(rows / 64 * 64, 1024), 64 * 1024);
+}
+
+// Columnar readings. A batch fills only the columns it was created with;
+// the others stay empty. `metrics` stays encoded; materialize it with
+// MetricColumns when a stage needs metric values.
+class RecordBatch {
+public:
+    enum Column : uint32_t {
+        Uuid = 1u << 0,
+        CreatedAt = 1u << 1,
+        OperatorId = 1u << 2,
+        InstanceId = 1u << 3,
+        AppVersion = 1u << 4,
+        DeviceId = 1u << 5,
+        DeviceName = 1u << 6,
+        Status = 1u << 7,
+        ActionType = 1u << 8,
+        Voltage = 1u << 9,
+        Temperature = 1u << 10,
+        Severity = 1u << 11,
+        UiLatency = 1u << 12,
+        Notes = 1u << 13,
+        Waveform = 1u << 14,
+        Metrics = 1u << 15,
+        AllColumns = (1u << 16) - 1
+    };
+
+    explicit RecordBatch(size_t capacity = record_batch_rows(), uint32_t columns = AllColumns)
+        : m_capacity(std::max<size_t>(capacity, 1)), m_columns(columns) {
+        const size_t n = m_capacity;
+        // Text bytes grow to their working size on first use and stay
+        if (has(Uuid)) m_uuid.reserve(n, 0);
+        if (has(DeviceName)) m_deviceName.reserve(n, 0);
+        if (has(Notes)) m_notes.reserve(n, 0);
+        if (has(Metrics)) m_metrics.reserve(n, 0);
+        if (has(OperatorId)) m_operatorId.reserve(n);
+        if (has(InstanceId)) m_instanceId.reserve(n);
+        if (has(AppVersion)) m_appVersion.reserve(n);
+        if (has(DeviceId)) m_deviceId.reserve(n);
+        if (has(Status)) m_status.reserve(n);
+        if (has(ActionType)) m_actionType.reserve(n);
+        if (has(Severity)) m_severity.reserve(n);
+        if (has(CreatedAt))
+        {
+            m_createdTs.reserve(n);
+            m_createdValid.reserve(n);
+        }
+        if (has(Voltage))
+        {
+            m_voltage.reserve(n);
+            m_voltageValid.reserve(n);
+        }
+        if (has(Temperature))
+        {
+            m_temperature.reserve(n);
+            m_temperatureValid.reserve(n);
+        }
+        if (has(UiLatency))
+        {
+            m_uiLatencyMs.reserve(n);
+            m_latencyValid.reserve(n);
+        }
+        if (has(Waveform)) m_waveform.reserve(n);
+    }
+
+    RecordBatch(const RecordBatch&) = delete;
+    RecordBatch& operator=(const RecordBatch&) = delete;
+
+    void append(const DeviceRecord& r) { appendRow(r); }
+    void append(const RecordRef& r) { appendRow(r); }
+
+    // Rows may exceed capacity(); it is the size the buffers are kept at
+    size_t size() const { return m_rows; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_rows == 0; }
+    bool full() const { return m_rows >= m_capacity; }
+    uint32_t columns() const { return m_columns; }
+    bool has(Column c) const { return (m_columns & c) != 0; }
+
+    void clear() {
+        for (StringColumn* s : {&m_uuid, &m_deviceName, &m_notes, &m_metrics}) s->clear();
+        for (DictionaryColumn* d : {&m_deviceId, &m_operatorId, &m_instanceId, &m_appVersion, &m_status, &m_actionType, &m_severity})
+            d->clear();
+        m_createdTs.clear();
+        m_voltage.clear();
+        m_temperature.clear();
+        m_uiLatencyMs.clear();
+        m_waveform.clear();
+        for (ValidityBitmap* b : {&m_createdValid, &m_voltageValid, &m_temperatureValid, &m_latencyValid}) b->clear();
+        m_rows = 0;
+    }
+
+    FloatColumnView voltage() const { return FloatColumnView{m_voltage.data(), m_voltageValid.data(), m_voltage.size()}; }
+    FloatColumnView temperature() const {
+        return FloatColumnView{m_temperature.data(), m_temperatureValid.data(), m_temperature.size()};
+    }
+
+    // created_at in seconds since the epoch; null where it did not parse
+    const int64_t* createdTs() const { return m_createdTs.data(); }
+    const ValidityBitmap& createdValid() const { return m_createdValid; }
+    const int32_t* uiLatencyMs() const { return m_uiLatencyMs.data(); }
+    const ValidityBitmap& uiLatencyValid() const { return m_latencyValid; }
+    const std::vector<WaveformRef>& waveform() const { return m_waveform; }
+
+    const DictionaryColumn& deviceId() const { return m_deviceId; }
+    const DictionaryColumn& operatorId() const { return m_operatorId; }
+    const DictionaryColumn& instanceId() const { return m_instanceId; }
+    const DictionaryColumn& appVersion() const { return m_appVersion; }
+    const DictionaryColumn& status() const { return m_status; }
+    const DictionaryColumn& actionType() const { return m_actionType; }
+    const DictionaryColumn& severity() const { return m_severity; }
+
+    const StringColumn& uuid() const { return m_uuid; }
+    const StringColumn& deviceName() const { return m_deviceName; }
+    const StringColumn& notes() const { return m_notes; }
+    const StringColumn& metrics() const { return m_metrics; }
+
+private:
+    // DeviceRecord and RecordRef share field names
+    template <typename Row>
+    void appendRow(const Row& r) {
+        if (has(Uuid)) m_uuid.append(r.uuid);
+        if (has(CreatedAt))
+        {
+            int64_t ts = 0;
+            m_createdValid.push(parse_timestamp(r.createdAt, ts));
+            m_createdTs.push_back(ts);
+        }
+        if (has(OperatorId)) m_operatorId.append(r.operatorId);
+        if (has(InstanceId)) m_instanceId.append(r.instanceId);
+        if (has(AppVersion)) m_appVersion.append(r.appVersion);
+        if (has(DeviceId)) m_deviceId.append(r.deviceId);
+        if (has(DeviceName)) m_deviceName.append(r.deviceName);
+        if (has(Status)) m_status.append(r.status);
+        if (has(ActionType)) m_actionType.append(r.actionType);
+        if (has(Voltage))
+        {
+            m_voltageValid.push(!std::isnan(r.voltage));
+            m_voltage.push_back(static_cast<float>(r.voltage));
+        }
+        if (has(Temperature))
+        {
+            m_temperatureValid.push(!std::isnan(r.temperature));
+            m_temperature.push_back(static_cast<float>(r.temperature));
+        }
+        if (has(Severity)) m_severity.append(r.severity);
+        if (has(UiLatency))
+        {
+            m_latencyValid.push(r.uiLatencyMs >= 0);
+            m_uiLatencyMs.push_back(r.uiLatencyMs);
+        }
+        if (has(Notes)) m_notes.append(r.notes);
+        if (has(Waveform)) m_waveform.push_back(r.waveform);
+        if (has(Metrics)) appendMetrics(r.metrics);
+        ++m_rows;
+    }
+
+    void appendMetrics(std::string_view encoded) { m_metrics.append(encoded); }
+    void appendMetrics(const std::vector<std::pair<std::string, std::string>>& metrics) {
+        m_metrics.appendWith([&](std::string& bytes) { append_encoded_metrics(bytes, metrics); });
+    }
+
+    size_t m_capacity;
+    uint32_t m_columns;
+    size_t m_rows = 0;
+    StringColumn m_uuid, m_deviceName, m_notes, m_metrics;
+    DictionaryColumn m_deviceId, m_operatorId, m_instanceId, m_appVersion, m_status, m_actionType, m_severity;
+    std::vector<int64_t> m_createdTs;
+    std::vector<float> m_voltage, m_temperature;
+    std::vector<int32_t> m_uiLatencyMs;
+    std::vector<WaveformRef> m_waveform;
+    ValidityBitmap m_createdValid, m_voltageValid, m_temperatureValid, m_latencyValid;
+};
+
+struct RecordBatchReset {
+    void operator()(RecordBatch& batch) const { batch.clear(); }
+};
+
+// Recycles cleared batches (see object_pool.h)
+class RecordBatchPool : public ObjectPool<RecordBatch, RecordBatchReset> {
+public:
+    // Keeps at most `maxIdle` cleared batches around; `columns` as for RecordBatch
+    explicit RecordBatchPool(uint32_t columns = RecordBatch::AllColumns, size_t maxIdle = 4,
+                             size_t capacity = record_batch_rows())
+        : ObjectPool(maxIdle, [columns, capacity]() { return std::make_unique<RecordBatch>(capacity, columns); }),
+          m_capacity(capacity) {}
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    size_t m_capacity;
+};
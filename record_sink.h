@@ -0,0 +1,139 @@
+// MiniGridMonitor - durable destinations for committed readings
+#pragma once
+
+#include "device_record.h"
+#include "file_sync.h"
+#include "record_arena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Where the ingest pipeline commits batches. append() buffers, sync()
+// makes everything appended so far durable. Both throw on failure.
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+    virtual void append(const std::vector<DeviceRecord>& batch) = 0;
+    virtual void sync() = 0;
+
+    // Arena-backed rows (bulk import). Converts by default; sinks that can
+    // write RecordRefs directly override it.
+    virtual void append(const RecordArenaBatch& batch) { append(batch.toRecords()); }
+
+    // Runs before every sync, e.g. to make waveform samples durable
+    // before the rows that point at them
+    void setBeforeSync(std::function<void()> fn) { m_beforeSync = std::move(fn); }
+
+protected:
+    void beforeSync() {
+        if (m_beforeSync) m_beforeSync();
+    }
+
+private:
+    std::function<void()> m_beforeSync;
+};
+
+// Appends rows to devices.csv, writing the header when the file is new.
+// The file stays open so a group commit costs one write and one fsync.
+class CsvRecordSink : public RecordSink {
+public:
+    explicit CsvRecordSink(const std::string& path)
+        : m_path(path) {
+        std::error_code ec;
+        const uintmax_t size = std::filesystem::exists(m_path, ec) ? std::filesystem::file_size(m_path, ec) : 0;
+        m_syncedBytes = ec ? 0 : static_cast<uint64_t>(size);
+    }
+
+    ~CsvRecordSink() override {
+        if (m_file) std::fclose(m_file);
+    }
+
+    CsvRecordSink(const CsvRecordSink&) = delete;
+    CsvRecordSink& operator=(const CsvRecordSink&) = delete;
+
+    void append(const std::vector<DeviceRecord>& batch) override {
+        open();
+        m_buffer.clear();
+        for (const auto& rec : batch)
+        {
+            m_buffer += to_csv_row(rec);
+            m_buffer += '\n';
+        }
+        if (std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+            throw std::runtime_error("unable to write file: " + m_path);
+        m_pendingBytes += m_buffer.size();
+    }
+
+    // Rows go straight from the arena into the reused write buffer
+    void append(const RecordArenaBatch& batch) override {
+        open();
+        m_buffer.clear();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            append_csv_row(m_buffer, batch[i]);
+            m_buffer += '\n';
+        }
+        if (std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+            throw std::runtime_error("unable to write file: " + m_path);
+        m_pendingBytes += m_buffer.size();
+    }
+
+    void sync() override {
+        beforeSync();
+        if (!m_file) return;
+        sync_file(m_file, m_path);
+        m_syncedBytes += m_pendingBytes;
+        m_pendingBytes = 0;
+    }
+
+    const std::string& path() const { return m_path; }
+
+    // File size up to the end of the last synced row; always on a row
+    // boundary. Safe to read from any thread.
+    uint64_t syncedBytes() const { return m_syncedBytes; }
+
+private:
+    void open() {
+        if (m_file) return;
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        bool exists = fs::exists(m_path, ec) && fs::file_size(m_path, ec) > 0;
+        fs::path dir = fs::path(m_path).parent_path();
+        if (!dir.empty()) fs::create_directories(dir, ec);
+
+        if (exists)
+        {
+            // Older versions are a prefix of the current header, so new rows
+            // stay readable by position; a reordered header is not.
+            std::ifstream in(m_path, std::ios::in | std::ios::binary);
+            std::string header;
+            if (in.peek() == 0xEF) in.ignore(3);
+            if (read_csv_record(in, header) && device_schema_version(parse_csv_line(header)) == 0)
+                throw std::runtime_error("unrecognized devices.csv header, not appending: " + m_path);
+        }
+
+        m_file = std::fopen(m_path.c_str(), "ab");
+        if (!m_file)
+            throw std::runtime_error("unable to open file for append: " + m_path);
+        if (!exists)
+        {
+            std::fputs(kDeviceCsvHeader, m_file);
+            std::fputc('\n', m_file);
+            m_pendingBytes += std::strlen(kDeviceCsvHeader) + 1;
+        }
+    }
+
+    std::string m_path;
+    std::FILE* m_file = nullptr;
+    std::string m_buffer;
+    uint64_t m_pendingBytes = 0;           // appended since the last sync
+    std::atomic<uint64_t> m_syncedBytes{0};
+};
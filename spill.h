@@ -0,0 +1,390 @@
+// MiniGridMonitor - memory-budgeted sort and group-by that spill to disk
+//
+// Reports over years of readings can hold more rows or groups than a field
+// laptop has RAM. ExternalSorter and SpillingAggregator charge what they
+// hold to a MemoryBudget. Once the budget is exceeded they write their
+// in-memory state to a temp file as one key-sorted run and start over.
+// finish() merges the runs and whatever is still in memory with a k-way
+// heap, so the merge holds one entry per run. Output comes out in key
+// order.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bytes held by budgeted operators (an estimate: payload plus container
+// overhead). Operators may share a budget; whichever sees it exceeded
+// spills its own state, unless that state is too small to be worth a run.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limitBytes)
+        : m_limit(limitBytes) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    void charge(size_t bytes) { m_used.fetch_add(bytes, std::memory_order_relaxed); }
+    void release(size_t bytes) { m_used.fetch_sub(bytes, std::memory_order_relaxed); }
+    bool exceeded() const { return m_used.load(std::memory_order_relaxed) > m_limit; }
+
+    // For an operator holding `held` bytes of the total
+    bool shouldSpill(size_t held) const { return exceeded() && held >= m_limit / 16; }
+
+    size_t used() const { return m_used.load(std::memory_order_relaxed); }
+    size_t limit() const { return m_limit; }
+
+private:
+    size_t m_limit;
+    std::atomic<size_t> m_used{0};
+};
+
+namespace spill_detail {
+
+// A temp file deleted on destruction. Records are (u32 key length, u32
+// value length, key, value) in host byte order; the files never outlive
+// the process that wrote them.
+class SpillFile {
+public:
+    explicit SpillFile(const std::filesystem::path& dir) {
+        static std::atomic<uint64_t> next{0};
+        const auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+        m_path = (dir / ("mgm-spill-" + std::to_string(ticks) + "-" + std::to_string(next++) + ".tmp")).string();
+        m_file = std::fopen(m_path.c_str(), "w+b");
+        if (!m_file) throw std::runtime_error("unable to create spill file: " + m_path);
+        std::setvbuf(m_file, nullptr, _IOFBF, kBufferBytes);
+    }
+
+    ~SpillFile() {
+        std::fclose(m_file);
+        std::error_code ec;
+        std::filesystem::remove(m_path, ec);
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    void write(std::string_view key, std::string_view value) {
+        const uint32_t lengths[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+        if (std::fwrite(lengths, sizeof(lengths), 1, m_file) != 1 ||
+            std::fwrite(key.data(), 1, key.size(), m_file) != key.size() ||
+            std::fwrite(value.data(), 1, value.size(), m_file) != value.size())
+            throw std::runtime_error("unable to write spill file (disk full?): " + m_path);
+        m_bytes += sizeof(lengths) + key.size() + value.size();
+    }
+
+    // Switches from writing to reading from the start
+    void rewind() {
+        if (std::fflush(m_file) != 0 || std::fseek(m_file, 0, SEEK_SET) != 0)
+            throw std::runtime_error("unable to rewind spill file: " + m_path);
+    }
+
+    bool read(std::string& key, std::string& value) {
+        uint32_t lengths[2];
+        if (std::fread(lengths, sizeof(lengths), 1, m_file) != 1) return false;
+        key.resize(lengths[0]);
+        value.resize(lengths[1]);
+        if (std::fread(&key[0], 1, key.size(), m_file) != key.size() ||
+            std::fread(&value[0], 1, value.size(), m_file) != value.size())
+            throw std::runtime_error("truncated spill file: " + m_path);
+        return true;
+    }
+
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    static constexpr size_t kBufferBytes = 256 << 10;
+
+    std::string m_path;
+    std::FILE* m_file = nullptr;
+    uint64_t m_bytes = 0;
+};
+
+using Entries = std::vector<std::pair<std::string, std::string>>;
+
+// Runs merged at once; more are first merged down into one run so the
+// number of open files stays bounded
+constexpr size_t kMaxFanIn = 64;
+
+// Calls fn(key, value) for every record of `runs` and then `memory` (both
+// key-sorted) in key order; equal keys come out in source order
+inline void merge_sorted(const std::vector<std::unique_ptr<SpillFile>>& runs, const Entries* memory,
+                         const std::function<void(std::string_view, std::string_view)>& fn)
+{
+    struct Source {
+        SpillFile* file;
+        std::string key, value;
+        size_t pos = 0;
+    };
+    std::vector<Source> sources;
+    sources.reserve(runs.size() + 1);
+    for (const auto& run : runs)
+    {
+        run->rewind();
+        sources.push_back(Source{run.get(), std::string(), std::string()});
+    }
+    const size_t memorySource = sources.size();
+    if (memory) sources.push_back(Source{nullptr, std::string(), std::string()});
+
+    auto key = [&](size_t s) -> std::string_view {
+        return sources[s].file ? std::string_view(sources[s].key) : std::string_view((*memory)[sources[s].pos].first);
+    };
+    auto advance = [&](size_t s) {
+        Source& src = sources[s];
+        if (src.file) return src.file->read(src.key, src.value);
+        return ++src.pos < memory->size();
+    };
+    // Heap top = smallest key, ties to the earlier source
+    auto later = [&](size_t a, size_t b) {
+        const std::string_view ka = key(a), kb = key(b);
+        return ka != kb ? ka > kb : a > b;
+    };
+
+    std::vector<size_t> heap;
+    for (size_t s = 0; s < sources.size(); ++s)
+    {
+        const bool valid = s == memorySource ? !memory->empty() : sources[s].file->read(sources[s].key, sources[s].value);
+        if (valid) heap.push_back(s);
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        const size_t s = heap.back();
+        const Source& src = sources[s];
+        if (src.file) fn(src.key, src.value);
+        else fn((*memory)[src.pos].first, (*memory)[src.pos].second);
+        if (advance(s)) std::push_heap(heap.begin(), heap.end(), later);
+        else heap.pop_back();
+    }
+}
+
+inline void sort_entries(Entries& entries)
+{
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entries::value_type& a, const Entries::value_type& b) { return a.first < b.first; });
+}
+
+} // namespace spill_detail
+
+// Sorts (key, value) byte strings by key within a memory budget. Equal
+// keys keep their add() order.
+class ExternalSorter {
+public:
+    struct Stats {
+        uint64_t rows = 0;
+        uint64_t runs = 0;         // spills to disk
+        uint64_t spilledBytes = 0;
+    };
+
+    explicit ExternalSorter(MemoryBudget& budget, std::filesystem::path spillDir = std::filesystem::temp_directory_path())
+        : m_budget(budget), m_spillDir(std::move(spillDir)) {}
+
+    ~ExternalSorter() { m_budget.release(m_charged); }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(std::string_view key, std::string_view value) {
+        m_entries.emplace_back(std::string(key), std::string(value));
+        const size_t bytes = key.size() + value.size() + sizeof(spill_detail::Entries::value_type);
+        m_budget.charge(bytes);
+        m_charged += bytes;
+        ++m_stats.rows;
+        if (m_budget.shouldSpill(m_charged)) spill();
+    }
+
+    // fn(key, value) for every row in key order; the sorter is empty
+    // afterwards
+    void finish(const std::function<void(std::string_view, std::string_view)>& fn) {
+        spill_detail::sort_entries(m_entries);
+        if (m_runs.empty())
+        {
+            for (const auto& e : m_entries) fn(e.first, e.second);
+        }
+        else
+        {
+            spill_detail::merge_sorted(m_runs, &m_entries, fn);
+        }
+        m_entries.clear();
+        m_runs.clear();
+        m_budget.release(m_charged);
+        m_charged = 0;
+    }
+
+    Stats stats() const { return m_stats; }
+
+private:
+    void spill() {
+        if (m_entries.empty()) return;
+        spill_detail::sort_entries(m_entries);
+        auto run = std::make_unique<spill_detail::SpillFile>(m_spillDir);
+        for (const auto& e : m_entries) run->write(e.first, e.second);
+        m_stats.spilledBytes += run->bytes();
+        ++m_stats.runs;
+        m_runs.push_back(std::move(run));
+        m_entries.clear();
+        m_budget.release(m_charged);
+        m_charged = 0;
+        if (m_runs.size() >= spill_detail::kMaxFanIn)
+        {
+            auto merged = std::make_unique<spill_detail::SpillFile>(m_spillDir);
+            spill_detail::merge_sorted(m_runs, nullptr, [&](std::string_view k, std::string_view v) { merged->write(k, v); });
+            m_runs.clear();
+            m_runs.push_back(std::move(merged));
+        }
+    }
+
+    MemoryBudget& m_budget;
+    std::filesystem::path m_spillDir;
+    spill_detail::Entries m_entries;
+    std::vector<std::unique_ptr<spill_detail::SpillFile>> m_runs;
+    size_t m_charged = 0;
+    Stats m_stats;
+};
+
+// Group-by on byte-string keys within a memory budget. State must be
+// default-constructible and provide
+//     void merge(const State&);
+//     void encode(std::string& out) const;  // appends
+//     bool decode(std::string_view in);     // replaces; false if malformed
+// Spilled runs hold each group once per run; finish() merges equal keys.
+template <typename State>
+class SpillingAggregator {
+public:
+    struct Stats {
+        uint64_t rows = 0;
+        uint64_t runs = 0;         // spills to disk
+        uint64_t spilledBytes = 0;
+        size_t groups = 0;         // held in memory right now
+    };
+
+    explicit SpillingAggregator(MemoryBudget& budget, std::filesystem::path spillDir = std::filesystem::temp_directory_path())
+        : m_budget(budget), m_spillDir(std::move(spillDir)) {}
+
+    ~SpillingAggregator() { m_budget.release(m_charged); }
+
+    SpillingAggregator(const SpillingAggregator&) = delete;
+    SpillingAggregator& operator=(const SpillingAggregator&) = delete;
+
+    // Runs fn(State&) on the group for `key`, creating it first if needed
+    template <typename F>
+    void update(std::string_view key, F&& fn) {
+        m_key.assign(key.data(), key.size());
+        auto it = m_groups.find(m_key);
+        if (it == m_groups.end())
+        {
+            it = m_groups.emplace(m_key, State()).first;
+            // Key, state, and roughly a hash node plus bucket
+            const size_t bytes = key.size() + sizeof(std::string) + sizeof(State) + 4 * sizeof(void*);
+            m_budget.charge(bytes);
+            m_charged += bytes;
+        }
+        fn(it->second);
+        ++m_stats.rows;
+        if (m_budget.shouldSpill(m_charged)) spill();
+    }
+
+    // fn(key, state) once per group in key order; the aggregator is empty
+    // afterwards
+    void finish(const std::function<void(std::string_view, const State&)>& fn) {
+        if (m_runs.empty())
+        {
+            std::vector<const typename Groups::value_type*> sorted;
+            sorted.reserve(m_groups.size());
+            for (const auto& g : m_groups) sorted.push_back(&g);
+            std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+            for (const auto* g : sorted) fn(g->first, g->second);
+        }
+        else
+        {
+            spill();
+            combine(fn);
+            m_runs.clear();
+        }
+        m_groups.clear();
+        m_budget.release(m_charged);
+        m_charged = 0;
+    }
+
+    Stats stats() const {
+        Stats s = m_stats;
+        s.groups = m_groups.size();
+        return s;
+    }
+
+private:
+    using Groups = std::unordered_map<std::string, State>;
+
+    // Merges every run, folding equal keys into one state
+    void combine(const std::function<void(std::string_view, const State&)>& fn) {
+        std::string current;
+        State acc, next;
+        bool have = false;
+        spill_detail::merge_sorted(m_runs, nullptr, [&](std::string_view key, std::string_view value) {
+            if (!next.decode(value)) throw std::runtime_error("corrupt spill record");
+            if (have && key == current)
+            {
+                acc.merge(next);
+                return;
+            }
+            if (have) fn(current, acc);
+            current.assign(key.data(), key.size());
+            acc = next;
+            have = true;
+        });
+        if (have) fn(current, acc);
+    }
+
+    void spill() {
+        if (m_groups.empty()) return;
+        std::vector<const typename Groups::value_type*> sorted;
+        sorted.reserve(m_groups.size());
+        for (const auto& g : m_groups) sorted.push_back(&g);
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+        auto run = std::make_unique<spill_detail::SpillFile>(m_spillDir);
+        for (const auto* g : sorted)
+        {
+            m_value.clear();
+            g->second.encode(m_value);
+            run->write(g->first, m_value);
+        }
+        m_stats.spilledBytes += run->bytes();
+        ++m_stats.runs;
+        m_runs.push_back(std::move(run));
+        sorted = {};
+        m_groups = Groups(); // give the buckets back too
+        m_budget.release(m_charged);
+        m_charged = 0;
+        if (m_runs.size() >= spill_detail::kMaxFanIn)
+        {
+            auto merged = std::make_unique<spill_detail::SpillFile>(m_spillDir);
+            combine([&](std::string_view key, const State& state) {
+                m_value.clear();
+                state.encode(m_value);
+                merged->write(key, m_value);
+            });
+            m_runs.clear();
+            m_runs.push_back(std::move(merged));
+        }
+    }
+
+    MemoryBudget& m_budget;
+    std::filesystem::path m_spillDir;
+    Groups m_groups;
+    std::vector<std::unique_ptr<spill_detail::SpillFile>> m_runs;
+    std::string m_key, m_value;
+    size_t m_charged = 0;
+    Stats m_stats;
+};
@@ -0,0 +1,399 @@
+// MiniGridMonitor - readings in an SQLite database (optional backend)
+//
+// For sites that want SQL access without running a database server. The
+// database runs in WAL mode; append() adds rows through one prepared
+// INSERT inside an open transaction and sync() commits it, so a group
+// commit from the ingest pipeline is one transaction and one fsync.
+// Device/time and severity/time indexes find the rows; queries return
+// whole readings, so the rows themselves are still read from the table.
+//
+// Only built with MGM_HAVE_SQLITE (CMake option MGM_WITH_SQLITE).
+#pragma once
+
+#include "amendments.h"
+#include "device_record.h"
+#include "record_sink.h"
+
+#include <sqlite3.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace sqlite_detail {
+
+inline void check(sqlite3* db, int rc, const char* what)
+{
+    if (rc != SQLITE_OK && rc != SQLITE_DONE && rc != SQLITE_ROW)
+        throw std::runtime_error(std::string(what) + ": " + (db ? sqlite3_errmsg(db) : sqlite3_errstr(rc)));
+}
+
+inline void exec(sqlite3* db, const char* sql)
+{
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK)
+    {
+        std::string message = error ? error : "unknown error";
+        sqlite3_free(error);
+        throw std::runtime_error(std::string("sqlite: ") + message + " in: " + sql);
+    }
+}
+
+// Owns one prepared statement; reset after every use
+class Statement {
+public:
+    Statement(sqlite3* db, const char* sql)
+        : m_db(db) {
+        check(db, sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &m_stmt, nullptr), "sqlite prepare");
+    }
+
+    ~Statement() { sqlite3_finalize(m_stmt); }
+
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    void text(int i, const std::string& s) { sqlite3_bind_text(m_stmt, i, s.data(), static_cast<int>(s.size()), SQLITE_TRANSIENT); }
+    void integer(int i, int64_t v) { sqlite3_bind_int64(m_stmt, i, v); }
+    void real(int i, double v) {
+        if (std::isnan(v)) sqlite3_bind_null(m_stmt, i);
+        else sqlite3_bind_double(m_stmt, i, v);
+    }
+
+    // True while a row is available
+    bool step() {
+        const int rc = sqlite3_step(m_stmt);
+        check(m_db, rc, "sqlite step");
+        return rc == SQLITE_ROW;
+    }
+
+    void reset() {
+        sqlite3_reset(m_stmt);
+        sqlite3_clear_bindings(m_stmt);
+    }
+
+    std::string columnText(int i) const {
+        const unsigned char* s = sqlite3_column_text(m_stmt, i);
+        return s ? std::string(reinterpret_cast<const char*>(s), static_cast<size_t>(sqlite3_column_bytes(m_stmt, i))) : std::string();
+    }
+    double columnReal(int i) const { return sqlite3_column_type(m_stmt, i) == SQLITE_NULL ? NAN : sqlite3_column_double(m_stmt, i); }
+    int64_t columnInt(int i, int64_t null) const { return sqlite3_column_type(m_stmt, i) == SQLITE_NULL ? null : sqlite3_column_int64(m_stmt, i); }
+
+private:
+    sqlite3* m_db;
+    sqlite3_stmt* m_stmt = nullptr;
+};
+
+// Column list shared by INSERT and SELECT; created_ts is created_at in
+// seconds since the epoch for range predicates
+static const char* const kReadingColumns =
+    "uuid,created_at,operator_id,instance_id,app_version,device_id,device_name,status,action_type,"
+    "voltage,temperature,severity,ui_latency_ms,notes,waveform,metrics,created_ts";
+
+} // namespace sqlite_detail
+
+class SqliteRecordSink : public RecordSink {
+public:
+    explicit SqliteRecordSink(const std::string& path) : m_path(path) {
+        using namespace sqlite_detail;
+        check(nullptr, sqlite3_open_v2(path.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr),
+              ("unable to open database " + path).c_str());
+        try {
+            // FULL makes every commit durable, matching CsvRecordSink::sync
+            exec(m_db, "PRAGMA journal_mode=WAL");
+            exec(m_db, "PRAGMA synchronous=FULL");
+            exec(m_db,
+                 "CREATE TABLE IF NOT EXISTS readings("
+                 "uuid TEXT NOT NULL, created_at TEXT, operator_id TEXT, instance_id TEXT, app_version TEXT,"
+                 "device_id TEXT NOT NULL, device_name TEXT, status TEXT, action_type TEXT,"
+                 "voltage REAL, temperature REAL, severity TEXT, ui_latency_ms INTEGER, notes TEXT,"
+                 "waveform TEXT, metrics TEXT, created_ts INTEGER NOT NULL)");
+            // Seek paths for device history and severity triage. The trailing
+            // columns only help queries that select nothing else.
+            exec(m_db,
+                 "CREATE INDEX IF NOT EXISTS readings_device_time ON readings"
+                 "(device_id, created_ts, status, severity, voltage, temperature)");
+            exec(m_db,
+                 "CREATE INDEX IF NOT EXISTS readings_severity_time ON readings"
+                 "(severity, created_ts, device_id, status)");
+            m_insert = std::make_unique<Statement>(m_db,
+                (std::string("INSERT INTO readings(") + kReadingColumns + ") VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)").c_str());
+            m_byDevice = std::make_unique<Statement>(m_db,
+                (std::string("SELECT ") + kReadingColumns +
+                 " FROM readings WHERE device_id = ? AND created_ts BETWEEN ? AND ? ORDER BY created_ts").c_str());
+            m_appendedByDevice = std::make_unique<Statement>(m_db,
+                (std::string("SELECT ") + kReadingColumns +
+                 " FROM readings WHERE device_id = ? AND created_ts BETWEEN ? AND ? AND rowid > ? AND rowid <= ?").c_str());
+            m_appended = std::make_unique<Statement>(m_db,
+                (std::string("SELECT ") + kReadingColumns +
+                 " FROM readings WHERE rowid > ? AND rowid <= ? AND created_ts BETWEEN ? AND ?").c_str());
+            m_update = std::make_unique<Statement>(m_db,
+                "UPDATE readings SET uuid=?,created_at=?,operator_id=?,instance_id=?,app_version=?,device_id=?,device_name=?,"
+                "status=?,action_type=?,voltage=?,temperature=?,severity=?,ui_latency_ms=?,notes=?,waveform=?,metrics=?,"
+                "created_ts=? WHERE rowid=? AND uuid=?");
+            m_delete = std::make_unique<Statement>(m_db, "DELETE FROM readings WHERE rowid=? AND uuid=?");
+            Statement last(m_db, "SELECT coalesce(max(rowid), 0) FROM readings");
+            last.step();
+            m_committedRowid = static_cast<uint64_t>(last.columnInt(0, 0));
+        }
+        catch (...) {
+            m_insert.reset();
+            m_byDevice.reset();
+            m_appendedByDevice.reset();
+            m_appended.reset();
+            m_update.reset();
+            m_delete.reset();
+        m_update.reset();
+        m_delete.reset();
+            sqlite3_close(m_db);
+            throw;
+        }
+    }
+
+    ~SqliteRecordSink() override {
+        if (m_inTransaction) sqlite3_exec(m_db, "ROLLBACK", nullptr, nullptr, nullptr);
+        m_insert.reset();
+        m_byDevice.reset();
+        m_appendedByDevice.reset();
+        m_appended.reset();
+        m_update.reset();
+        m_delete.reset();
+        sqlite3_close(m_db);
+    }
+
+    SqliteRecordSink(const SqliteRecordSink&) = delete;
+    SqliteRecordSink& operator=(const SqliteRecordSink&) = delete;
+
+    using RecordSink::append;
+
+    // Records without a parseable created_at are rejected. A batch goes in
+    // whole or not at all: on error it is rolled back to its savepoint, so
+    // the next sync() cannot commit part of it.
+    void append(const std::vector<DeviceRecord>& batch) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_inTransaction)
+        {
+            sqlite_detail::exec(m_db, "BEGIN");
+            m_inTransaction = true;
+        }
+        sqlite_detail::exec(m_db, "SAVEPOINT append_batch");
+        try {
+            insert(batch);
+        }
+        catch (...) {
+            m_insert->reset();
+            sqlite3_exec(m_db, "ROLLBACK TO append_batch", nullptr, nullptr, nullptr);
+            sqlite3_exec(m_db, "RELEASE append_batch", nullptr, nullptr, nullptr);
+            // Some errors (e.g. a full disk) end the whole transaction
+            if (sqlite3_get_autocommit(m_db)) m_inTransaction = false;
+            throw;
+        }
+        sqlite_detail::exec(m_db, "RELEASE append_batch");
+    }
+
+    void sync() override {
+        beforeSync();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_inTransaction) return;
+        sqlite_detail::exec(m_db, "COMMIT");
+        m_inTransaction = false;
+        // Only this connection inserts, so the last insert is the highest
+        // rowid; it stays put across a commit that only held amendments
+        const uint64_t last = static_cast<uint64_t>(sqlite3_last_insert_rowid(m_db));
+        if (last > m_committedRowid) m_committedRowid = last;
+    }
+
+    // Rewrites or deletes the reading `a` targets and commits. The row is
+    // found on a read-only connection (there is no uuid index; amendments
+    // are rare), so ingest only waits for the write itself. Throws
+    // std::runtime_error for an invalid amendment or an unknown uuid.
+    void amend(const Amendment& a) {
+        check_amendment(a);
+        int64_t rowid = 0;
+        DeviceRecord rec;
+        {
+            sqlite3* raw = nullptr;
+            const int rc = sqlite3_open_v2(m_path.c_str(), &raw, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+            std::unique_ptr<sqlite3, int (*)(sqlite3*)> reader(raw, sqlite3_close);
+            sqlite_detail::check(nullptr, rc, ("unable to open database " + m_path).c_str());
+            sqlite_detail::Statement s(reader.get(), (std::string("SELECT ") + sqlite_detail::kReadingColumns +
+                                                      ",rowid FROM readings WHERE uuid = ?").c_str());
+            s.text(1, a.targetUuid);
+            if (!s.step()) throw std::runtime_error("no reading with uuid " + a.targetUuid);
+            rec = read(s);
+            rowid = s.columnInt(17, 0);
+        }
+        const bool keep = apply_amendment(a, rec);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_inTransaction)
+            {
+                sqlite_detail::exec(m_db, "BEGIN");
+                m_inTransaction = true;
+            }
+            sqlite_detail::Statement& s = keep ? *m_update : *m_delete;
+            try {
+                int i = 1;
+                if (keep) i = bind(s, rec);
+                s.integer(i++, rowid);
+                s.text(i, a.targetUuid);
+                s.step();
+            }
+            catch (...) {
+                s.reset();
+                throw;
+            }
+            s.reset();
+        }
+        sync();
+        ++m_amendments;
+    }
+
+    // Readings of `deviceId` with from <= created_at <= to, in time order
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) {
+        std::vector<DeviceRecord> rows;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            sqlite_detail::Statement& s = *m_byDevice;
+            s.text(1, deviceId);
+            s.integer(2, from);
+            s.integer(3, to);
+            while (s.step()) rows.push_back(read(s));
+            s.reset();
+        }
+        for (auto& rec : rows) fn(std::move(rec));
+    }
+
+    // Every committed reading in insertion order. Runs on a read-only
+    // connection of its own, so appends and commits go on meanwhile (WAL
+    // readers see the snapshot taken when the scan started).
+    void scan(const std::function<void(DeviceRecord&&)>& fn) {
+        sqlite3* raw = nullptr;
+        const int rc = sqlite3_open_v2(m_path.c_str(), &raw, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+        std::unique_ptr<sqlite3, int (*)(sqlite3*)> reader(raw, sqlite3_close);
+        sqlite_detail::check(nullptr, rc, ("unable to open database " + m_path).c_str());
+        sqlite_detail::Statement s(reader.get(), (std::string("SELECT ") + sqlite_detail::kReadingColumns +
+                                                  " FROM readings ORDER BY rowid").c_str());
+        while (s.step()) fn(read(s));
+    }
+
+    // Rows with rowid in (after, upTo] (empty `deviceId` = every device)
+    // and from <= created_at <= to, in no particular order
+    void scanAppended(const std::string& deviceId, int64_t from, int64_t to, uint64_t after, uint64_t upTo,
+                      const std::function<void(DeviceRecord&&)>& fn) {
+        std::vector<DeviceRecord> rows;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            sqlite_detail::Statement& s = deviceId.empty() ? *m_appended : *m_appendedByDevice;
+            int i = 1;
+            if (!deviceId.empty())
+            {
+                s.text(i++, deviceId);
+                s.integer(i++, from);
+                s.integer(i++, to);
+            }
+            s.integer(i++, static_cast<int64_t>(after));
+            s.integer(i++, static_cast<int64_t>(upTo));
+            if (deviceId.empty())
+            {
+                s.integer(i++, from);
+                s.integer(i++, to);
+            }
+            try {
+                while (s.step()) rows.push_back(read(s));
+            }
+            catch (...) {
+                s.reset();
+                throw;
+            }
+            s.reset();
+        }
+        for (auto& rec : rows) fn(std::move(rec));
+    }
+
+    // rowid of the last committed reading; safe to read from any thread
+    uint64_t committedRowid() const { return m_committedRowid; }
+
+    // Committed amend() calls since open; safe to read from any thread
+    uint64_t amendments() const { return m_amendments; }
+
+    const std::string& path() const { return m_path; }
+    sqlite3* handle() { return m_db; }
+
+private:
+    // Caller holds m_mutex inside the batch savepoint
+    void insert(const std::vector<DeviceRecord>& batch) {
+        sqlite_detail::Statement& s = *m_insert;
+        for (const auto& rec : batch)
+        {
+            bind(s, rec);
+            s.step();
+            s.reset();
+        }
+    }
+
+    // Binds kReadingColumns to parameters 1..17; returns the next one.
+    // Throws for a record without a parseable created_at.
+    static int bind(sqlite_detail::Statement& s, const DeviceRecord& rec) {
+        int64_t ts;
+        if (!parse_timestamp(rec.createdAt, ts))
+            throw std::runtime_error("record " + rec.uuid + " has no valid created_at");
+        s.text(1, rec.uuid);
+        s.text(2, rec.createdAt);
+        s.text(3, rec.operatorId);
+        s.text(4, rec.instanceId);
+        s.text(5, rec.appVersion);
+        s.text(6, rec.deviceId);
+        s.text(7, rec.deviceName);
+        s.text(8, rec.status);
+        s.text(9, rec.actionType);
+        s.real(10, rec.voltage);
+        s.real(11, rec.temperature);
+        s.text(12, rec.severity);
+            if (rec.uiLatencyMs >= 0) s.integer(13, rec.uiLatencyMs);
+        s.text(14, rec.notes);
+        s.text(15, format_waveform_ref(rec.waveform));
+        s.text(16, encode_metrics(rec.metrics));
+        s.integer(17, ts);
+        return 18;
+    }
+
+    static DeviceRecord read(const sqlite_detail::Statement& s) {
+        DeviceRecord r;
+        r.uuid = s.columnText(0);
+        r.createdAt = s.columnText(1);
+        r.operatorId = s.columnText(2);
+        r.instanceId = s.columnText(3);
+        r.appVersion = s.columnText(4);
+        r.deviceId = s.columnText(5);
+        r.deviceName = s.columnText(6);
+        r.status = s.columnText(7);
+        r.actionType = s.columnText(8);
+        r.voltage = s.columnReal(9);
+        r.temperature = s.columnReal(10);
+        r.severity = s.columnText(11);
+        r.uiLatencyMs = static_cast<int>(s.columnInt(12, -1));
+        r.notes = s.columnText(13);
+        parse_waveform_ref(s.columnText(14), r.waveform);
+        r.metrics = decode_metrics(s.columnText(15));
+        return r;
+    }
+
+    std::string m_path;
+    sqlite3* m_db = nullptr;
+    std::mutex m_mutex; // one connection, opened without SQLite's own locking
+    std::unique_ptr<sqlite_detail::Statement> m_insert;
+    std::unique_ptr<sqlite_detail::Statement> m_byDevice;
+    std::unique_ptr<sqlite_detail::Statement> m_appendedByDevice;
+    std::unique_ptr<sqlite_detail::Statement> m_appended;
+    std::unique_ptr<sqlite_detail::Statement> m_update;
+    std::unique_ptr<sqlite_detail::Statement> m_delete;
+    bool m_inTransaction = false;
+    std::atomic<uint64_t> m_committedRowid{0};
+    std::atomic<uint64_t> m_amendments{0};
+};
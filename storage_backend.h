@@ -0,0 +1,248 @@
+// MiniGridMonitor - choice of where committed readings are stored
+//
+//   csv     devices.csv (default), range queries through its B+tree index
+//   lsm     LSM tree in devices.lsm/
+//   sqlite  devices.db, when built with MGM_HAVE_SQLITE
+//
+// Every backend is a RecordStore: a sink for the ingest pipeline plus the
+// two reads the application needs (full history, one device's range),
+// corrections to committed readings, and an append watermark so cached
+// query results know what they cover.
+#pragma once
+
+#include "amendments.h"
+#include "btree_index.h"
+#include "lsm_store.h"
+#include "record_sink.h"
+
+#ifdef MGM_HAVE_SQLITE
+#include "sqlite_store.h"
+#endif
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+enum class StorageBackend { Csv, Lsm, Sqlite };
+
+// How far committed appends have got. `position` only grows while
+// `generation` stays the same; a new generation means rows below
+// `position` may have changed (a correction, a rewrite, an LSM write).
+struct AppendWatermark {
+    uint64_t generation = 0;
+    uint64_t position = 0;
+
+    bool operator==(const AppendWatermark& o) const { return generation == o.generation && position == o.position; }
+    bool operator!=(const AppendWatermark& o) const { return !(*this == o); }
+};
+
+inline const char* storage_backend_name(StorageBackend b)
+{
+    switch (b)
+    {
+    case StorageBackend::Lsm: return "lsm";
+    case StorageBackend::Sqlite: return "sqlite";
+    default: return "csv";
+    }
+}
+
+inline bool parse_storage_backend(const std::string& name, StorageBackend& out)
+{
+    if (name == "csv") out = StorageBackend::Csv;
+    else if (name == "lsm") out = StorageBackend::Lsm;
+    else if (name == "sqlite") out = StorageBackend::Sqlite;
+    else return false;
+    return true;
+}
+
+inline bool storage_backend_available(StorageBackend b)
+{
+#ifdef MGM_HAVE_SQLITE
+    (void)b;
+    return true;
+#else
+    return b != StorageBackend::Sqlite;
+#endif
+}
+
+class RecordStore {
+public:
+    virtual ~RecordStore() = default;
+
+    virtual RecordSink& sink() = 0;
+
+    // Every current reading (corrections applied where the backend has them)
+    virtual void scan(const std::function<void(DeviceRecord&&)>& fn) = 0;
+
+    // Readings of `deviceId` with from <= created_at <= to, in time order
+    virtual void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) = 0;
+
+    // Durably records a correction to a committed reading; later reads see
+    // it and the watermark moves to a new generation. Throws
+    // std::runtime_error for an unknown or read-only field, and for a
+    // uuid the backend cannot find (the CSV sidecar accepts any uuid).
+    virtual void amend(const Amendment& a) = 0;
+
+    virtual AppendWatermark watermark() = 0;
+
+    // Readings covered by watermark position `upTo` but not by `since`
+    // (same generation), for `deviceId` (empty = every device) with
+    // from <= created_at <= to, in no particular order. since = 0 reads
+    // everything up to `upTo`. False when the backend cannot bound a read
+    // by position.
+    virtual bool scanAppended(const std::string& deviceId, int64_t from, int64_t to, uint64_t since, uint64_t upTo,
+                              const std::function<void(DeviceRecord&&)>& fn) {
+        (void)deviceId; (void)from; (void)to; (void)since; (void)upTo; (void)fn;
+        return false;
+    }
+};
+
+class CsvRecordStore : public RecordStore {
+public:
+    explicit CsvRecordStore(const std::string& path)
+        : m_sink(path), m_index(path), m_amendments(path) {}
+
+    RecordSink& sink() override { return m_sink; }
+
+    void scan(const std::function<void(DeviceRecord&&)>& fn) override { for_each_current_record(m_sink.path(), fn); }
+
+    // Brings the index up to date with rows synced since the last query
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) override {
+        std::lock_guard<std::mutex> lock(m_indexMutex);
+        m_index.catchUp();
+        m_index.query(deviceId, from, to, fn);
+    }
+
+    void amend(const Amendment& a) override { m_amendments.append(a); }
+
+    // Position = synced bytes of devices.csv; generation = size of its
+    // corrections sidecar, which only grows until the next compaction
+    AppendWatermark watermark() override {
+        std::error_code ec;
+        const uintmax_t sidecar = std::filesystem::file_size(amendment_path(m_sink.path()), ec);
+        return AppendWatermark{ec ? 0 : static_cast<uint64_t>(sidecar), m_sink.syncedBytes()};
+    }
+
+    // A device's whole history comes from the index; anything else is a
+    // sequential read of the byte range
+    bool scanAppended(const std::string& deviceId, int64_t from, int64_t to, uint64_t since, uint64_t upTo,
+                      const std::function<void(DeviceRecord&&)>& fn) override {
+        std::lock_guard<std::mutex> lock(m_indexMutex);
+        if (since == 0 && !deviceId.empty())
+        {
+            m_index.catchUp();
+            m_index.query(deviceId, from, to, fn, upTo);
+        }
+        else
+        {
+            m_index.scanBytes(deviceId, from, to, since, upTo, fn);
+        }
+        return true;
+    }
+
+private:
+    CsvRecordSink m_sink;
+    std::mutex m_indexMutex;
+    SegmentIndex m_index;
+    AmendmentLog m_amendments;
+};
+
+class LsmRecordStore : public RecordStore {
+public:
+    explicit LsmRecordStore(const std::string& dir, LsmOptions options = LsmOptions())
+        : m_store(dir, options), m_sink(m_store) {}
+
+    RecordSink& sink() override { return m_sink; }
+
+    void scan(const std::function<void(DeviceRecord&&)>& fn) override { m_store.scan(fn); }
+
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) override {
+        m_store.scan(deviceId, from, to, fn);
+    }
+
+    // Finds the reading with a full scan (keys lead with the device, not
+    // the uuid), then replaces or tombstones it
+    void amend(const Amendment& a) override {
+        check_amendment(a);
+        std::lock_guard<std::mutex> lock(m_amendMutex);
+        DeviceRecord before;
+        bool found = false;
+        m_store.scan([&](DeviceRecord&& rec) {
+            if (!found && rec.uuid == a.targetUuid)
+            {
+                before = std::move(rec);
+                found = true;
+            }
+        });
+        if (!found) throw std::runtime_error("no reading with uuid " + a.targetUuid);
+        DeviceRecord after = before;
+        const bool keep = apply_amendment(a, after);
+        m_store.replace(before, keep ? &after : nullptr);
+        m_sink.sync();
+    }
+
+    // Keys do not follow append order, so every write starts a generation
+    AppendWatermark watermark() override { return AppendWatermark{m_store.writeCount(), 0}; }
+
+    LsmStore& store() { return m_store; }
+
+private:
+    LsmStore m_store;
+    LsmRecordSink m_sink;
+    std::mutex m_amendMutex; // one read-modify-write at a time
+};
+
+#ifdef MGM_HAVE_SQLITE
+class SqliteRecordStore : public RecordStore {
+public:
+    explicit SqliteRecordStore(const std::string& path)
+        : m_sink(path) {}
+
+    RecordSink& sink() override { return m_sink; }
+
+    void scan(const std::function<void(DeviceRecord&&)>& fn) override { m_sink.scan(fn); }
+
+    void scan(const std::string& deviceId, int64_t from, int64_t to, const std::function<void(DeviceRecord&&)>& fn) override {
+        m_sink.scan(deviceId, from, to, fn);
+    }
+
+    void amend(const Amendment& a) override { m_sink.amend(a); }
+
+    // Position = rowid of the last committed reading; generation = amend()
+    // calls, which rewrite or delete rows below it
+    AppendWatermark watermark() override { return AppendWatermark{m_sink.amendments(), m_sink.committedRowid()}; }
+
+    bool scanAppended(const std::string& deviceId, int64_t from, int64_t to, uint64_t since, uint64_t upTo,
+                      const std::function<void(DeviceRecord&&)>& fn) override {
+        m_sink.scanAppended(deviceId, from, to, since, upTo, fn);
+        return true;
+    }
+
+private:
+    SqliteRecordSink m_sink;
+};
+#endif
+
+// Opens the backend next to `devicesPath` (the devices.csv location).
+// Throws std::runtime_error when the backend was not compiled in.
+inline std::unique_ptr<RecordStore> open_record_store(StorageBackend backend, const std::string& devicesPath)
+{
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::path(devicesPath).parent_path();
+    switch (backend)
+    {
+    case StorageBackend::Lsm:
+        return std::make_unique<LsmRecordStore>((dir / "devices.lsm").string());
+    case StorageBackend::Sqlite:
+#ifdef MGM_HAVE_SQLITE
+        return std::make_unique<SqliteRecordStore>((dir / "devices.db").string());
+#else
+        throw std::runtime_error("sqlite storage is not available in this build");
+#endif
+    default:
+        return std::make_unique<CsvRecordStore>(devicesPath);
+    }
+}
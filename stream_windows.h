@@ -0,0 +1,316 @@
+// MiniGridMonitor - event-time windows over created_at with watermarks
+#pragma once
+
+#include "device_record.h"
+#include "string_interner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+enum class WindowKind { Tumbling, Sliding, Session };
+
+// All times are epoch seconds of created_at
+struct WindowSpec {
+    WindowKind kind = WindowKind::Tumbling;
+    int64_t size = 900;              // tumbling/sliding window length
+    int64_t slide = 900;             // sliding step; tumbling uses size
+    int64_t gap = 1800;              // session closes after this much silence
+    int64_t maxOutOfOrder = 300;     // watermark trails the newest event by this
+    int64_t allowedLateness = 3600;  // fired windows still accept updates this long
+};
+
+// Per-window state, 36 bytes. Missing voltage/temperature are not counted.
+struct WindowAggregate {
+    uint32_t count = 0;
+    uint32_t voltageCount = 0;
+    uint32_t temperatureCount = 0;
+    float voltageSum = 0;
+    float voltageMin = std::numeric_limits<float>::infinity();
+    float voltageMax = -std::numeric_limits<float>::infinity();
+    float temperatureSum = 0;
+    float temperatureMax = -std::numeric_limits<float>::infinity();
+    int8_t worstSeverity = -1; // severity_rank()
+
+    void add(double voltage, double temperature, int severity) {
+        ++count;
+        if (!std::isnan(voltage))
+        {
+            ++voltageCount;
+            voltageSum += float(voltage);
+            voltageMin = std::min(voltageMin, float(voltage));
+            voltageMax = std::max(voltageMax, float(voltage));
+        }
+        if (!std::isnan(temperature))
+        {
+            ++temperatureCount;
+            temperatureSum += float(temperature);
+            temperatureMax = std::max(temperatureMax, float(temperature));
+        }
+        worstSeverity = std::max<int8_t>(worstSeverity, static_cast<int8_t>(severity));
+    }
+
+    void merge(const WindowAggregate& o) {
+        count += o.count;
+        voltageCount += o.voltageCount;
+        temperatureCount += o.temperatureCount;
+        voltageSum += o.voltageSum;
+        voltageMin = std::min(voltageMin, o.voltageMin);
+        voltageMax = std::max(voltageMax, o.voltageMax);
+        temperatureSum += o.temperatureSum;
+        temperatureMax = std::max(temperatureMax, o.temperatureMax);
+        worstSeverity = std::max(worstSeverity, o.worstSeverity);
+    }
+};
+
+static_assert(sizeof(WindowAggregate) == 36, "keep per-window state small");
+
+struct WindowResult {
+    uint32_t key; // interned device_id
+    int64_t start;
+    int64_t end;
+    WindowAggregate agg;
+    bool lateUpdate; // re-emission of an already fired window
+};
+
+// Keyed event-time window operator. A window fires once the watermark
+// (newest event time minus maxOutOfOrder) passes its end, keeps accepting
+// late readings for allowedLateness (each re-emits the window with
+// lateUpdate set), and is then purged. Readings later than that are
+// counted and dropped. Not thread safe; drive it from one thread.
+class WindowedAggregator {
+public:
+    using EmitFn = std::function<void(const WindowResult&)>;
+
+    struct Stats {
+        size_t openWindows = 0;
+        uint64_t fired = 0;
+        uint64_t lateUpdates = 0;
+        uint64_t droppedLate = 0;
+    };
+
+    WindowedAggregator(WindowSpec spec, EmitFn emit, StringInterner& keys)
+        : m_spec(spec), m_emit(std::move(emit)), m_keys(keys) {
+        if (m_spec.kind == WindowKind::Tumbling) m_spec.slide = m_spec.size;
+        m_spec.size = std::max<int64_t>(m_spec.size, 1);
+        m_spec.slide = std::max<int64_t>(m_spec.slide, 1);
+        m_spec.gap = std::max<int64_t>(m_spec.gap, 1);
+        m_spec.allowedLateness = std::max<int64_t>(m_spec.allowedLateness, 0);
+    }
+
+    void observe(const DeviceRecord& rec) {
+        int64_t ts;
+        if (!parse_timestamp(rec.createdAt, ts)) return;
+        add(m_keys.intern(rec.deviceId), ts, rec.voltage, rec.temperature, severity_rank(rec.severity));
+    }
+
+    void add(uint32_t key, int64_t eventTime, double voltage, double temperature, int severity) {
+        bool accepted = m_spec.kind == WindowKind::Session
+            ? addToSession(key, eventTime, voltage, temperature, severity)
+            : addToFixed(key, eventTime, voltage, temperature, severity);
+        if (!accepted) ++m_stats.droppedLate;
+
+        if (eventTime > m_maxEventTime)
+        {
+            m_maxEventTime = eventTime;
+            advanceWatermark(eventTime - m_spec.maxOutOfOrder);
+        }
+    }
+
+    // Watermarks only move forward. Call this for idle streams too, or
+    // their last windows never close.
+    void advanceWatermark(int64_t watermark) {
+        if (watermark <= m_watermark) return;
+        m_watermark = watermark;
+        fireTimers();
+    }
+
+    // End of input: fire everything that is still open
+    void flush() {
+        advanceWatermark(std::numeric_limits<int64_t>::max() - m_spec.allowedLateness - 1);
+    }
+
+    int64_t watermark() const { return m_watermark; }
+
+    Stats stats() const {
+        Stats s = m_stats;
+        s.openWindows = m_windows.size();
+        return s;
+    }
+
+private:
+    struct WindowKey {
+        uint32_t key;
+        int64_t start;
+        bool operator==(const WindowKey& o) const { return key == o.key && start == o.start; }
+    };
+
+    struct WindowKeyHash {
+        size_t operator()(const WindowKey& k) const {
+            uint64_t h = uint64_t(k.start) * 0x9e3779b97f4a7c15ull ^ k.key;
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    struct WindowState {
+        int64_t end;
+        WindowAggregate agg;
+        bool fired = false;
+    };
+
+    // Timers are validated lazily when popped, so window growth and
+    // session merges never have to search the heap.
+    struct Timer {
+        int64_t time;
+        WindowKey window;
+        bool purge;
+        bool operator>(const Timer& o) const { return time > o.time; }
+    };
+
+    static int64_t floorTo(int64_t t, int64_t width) {
+        int64_t r = t % width;
+        return r < 0 ? t - r - width : t - r;
+    }
+
+    bool tooLate(int64_t end) const {
+        return m_watermark != std::numeric_limits<int64_t>::min() &&
+               end <= m_watermark - m_spec.allowedLateness;
+    }
+
+    bool addToFixed(uint32_t key, int64_t t, double voltage, double temperature, int severity) {
+        bool accepted = false;
+        for (int64_t start = floorTo(t, m_spec.slide); start > t - m_spec.size; start -= m_spec.slide)
+        {
+            const int64_t end = start + m_spec.size;
+            if (tooLate(end)) continue;
+            accepted = true;
+            WindowKey wk{key, start};
+            auto it = m_windows.find(wk);
+            if (it == m_windows.end())
+            {
+                it = m_windows.emplace(wk, WindowState{end, WindowAggregate(), false}).first;
+                m_timers.push(Timer{end, wk, false});
+            }
+            it->second.agg.add(voltage, temperature, severity);
+            if (it->second.fired) emitUpdate(wk, it->second);
+        }
+        // Late windows that were created already past the watermark
+        if (accepted) fireTimers();
+        return accepted;
+    }
+
+    bool addToSession(uint32_t key, int64_t t, double voltage, double temperature, int severity) {
+        std::vector<int64_t>& starts = m_sessions[key];
+        WindowAggregate agg;
+        agg.add(voltage, temperature, severity);
+        int64_t start = t;
+        int64_t end = t + m_spec.gap;
+        bool fired = false;
+
+        // Absorb every live session this reading touches
+        for (size_t i = 0; i < starts.size();)
+        {
+            WindowKey wk{key, starts[i]};
+            auto it = m_windows.find(wk);
+            const WindowState& s = it->second;
+            if (t >= wk.start - m_spec.gap && t < s.end)
+            {
+                start = std::min(start, wk.start);
+                end = std::max(end, s.end);
+                agg.merge(s.agg);
+                fired = fired || s.fired;
+                m_windows.erase(it);
+                starts[i] = starts.back();
+                starts.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if (tooLate(end))
+        {
+            if (starts.empty()) m_sessions.erase(key);
+            return false;
+        }
+
+        WindowKey wk{key, start};
+        WindowState& state = m_windows[wk];
+        state = WindowState{end, agg, fired};
+        starts.push_back(start);
+        m_timers.push(Timer{fired ? end + m_spec.allowedLateness : end, wk, fired});
+        if (fired) emitUpdate(wk, state);
+        fireTimers();
+        return true;
+    }
+
+    void emitUpdate(const WindowKey& wk, const WindowState& s) {
+        ++m_stats.lateUpdates;
+        if (m_emit) m_emit(WindowResult{wk.key, wk.start, s.end, s.agg, true});
+    }
+
+    void fireTimers() {
+        while (!m_timers.empty() && m_timers.top().time <= m_watermark)
+        {
+            Timer t = m_timers.top();
+            m_timers.pop();
+            auto it = m_windows.find(t.window);
+            if (it == m_windows.end()) continue; // merged away or purged
+            WindowState& s = it->second;
+
+            if (!t.purge)
+            {
+                if (s.fired) continue;
+                if (s.end > t.time)
+                {
+                    // Session grew since this timer was set
+                    m_timers.push(Timer{s.end, t.window, false});
+                    continue;
+                }
+                s.fired = true;
+                ++m_stats.fired;
+                if (m_emit) m_emit(WindowResult{t.window.key, t.window.start, s.end, s.agg, false});
+                m_timers.push(Timer{s.end + m_spec.allowedLateness, t.window, true});
+            }
+            else
+            {
+                if (s.end + m_spec.allowedLateness > t.time)
+                {
+                    m_timers.push(Timer{s.end + m_spec.allowedLateness, t.window, true});
+                    continue;
+                }
+                erase(it);
+            }
+        }
+    }
+
+    void erase(std::unordered_map<WindowKey, WindowState, WindowKeyHash>::iterator it) {
+        if (m_spec.kind == WindowKind::Session)
+        {
+            auto sit = m_sessions.find(it->first.key);
+            if (sit != m_sessions.end())
+            {
+                auto& starts = sit->second;
+                starts.erase(std::remove(starts.begin(), starts.end(), it->first.start), starts.end());
+                if (starts.empty()) m_sessions.erase(sit);
+            }
+        }
+        m_windows.erase(it);
+    }
+
+    WindowSpec m_spec;
+    EmitFn m_emit;
+    StringInterner& m_keys;
+    int64_t m_maxEventTime = std::numeric_limits<int64_t>::min();
+    int64_t m_watermark = std::numeric_limits<int64_t>::min();
+    std::unordered_map<WindowKey, WindowState, WindowKeyHash> m_windows;
+    std::unordered_map<uint32_t, std::vector<int64_t>> m_sessions; // live session starts per key
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+    Stats m_stats;
+};
@@ -0,0 +1,54 @@
+// MiniGridMonitor - string to dense code dictionary (device_id, instance_id, ...)
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Assigns dense uint32 codes in first-seen order. Codes are never reused,
+// and name() references stay valid for the interner's lifetime.
+class StringInterner {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    uint32_t intern(std::string_view s) {
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_codes.find(s);
+            if (it != m_codes.end()) return it->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_codes.find(s);
+        if (it != m_codes.end()) return it->second;
+        uint32_t code = static_cast<uint32_t>(m_names.size());
+        m_names.emplace_back(s);
+        m_codes.emplace(std::string_view(m_names.back()), code);
+        return code;
+    }
+
+    // kNone when the string has never been interned
+    uint32_t find(std::string_view s) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_codes.find(s);
+        return it == m_codes.end() ? kNone : it->second;
+    }
+
+    const std::string& name(uint32_t code) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_names.at(code);
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_names.size();
+    }
+
+private:
+    mutable std::shared_mutex m_mutex;
+    std::deque<std::string> m_names; // deque keeps element addresses stable
+    std::unordered_map<std::string_view, uint32_t> m_codes;
+};
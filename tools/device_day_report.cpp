@@ -0,0 +1,69 @@
+// Readings per device, day and severity from a devices.csv export, within
+// a memory budget
+//
+//   device_day_report <devices.csv> <report.csv> [budget MiB] [busiest]
+#include "device_day_report.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "usage: %s <devices.csv> <report.csv> [budget MiB] [busiest]\n", argv[0]);
+        return 2;
+    }
+    const size_t budgetMiB = argc > 3 ? std::stoul(argv[3]) : 256;
+    const bool busiest = argc > 4 && std::string(argv[4]) == "busiest";
+
+    try {
+        MemoryBudget budget(budgetMiB << 20);
+        DeviceDayReport report(budget);
+        const auto start = std::chrono::steady_clock::now();
+        size_t readings = 0;
+        if (!for_each_device_record(argv[1], [&](DeviceRecord&& rec) {
+                report.add(rec);
+                ++readings;
+            }))
+        {
+            std::fprintf(stderr, "unable to open %s\n", argv[1]);
+            return 1;
+        }
+        const auto stats = report.stats();
+
+        std::FILE* out = std::fopen(argv[2], "wb");
+        if (!out)
+        {
+            std::fprintf(stderr, "unable to create %s\n", argv[2]);
+            return 1;
+        }
+        std::fprintf(out, "device_id,day,severity,readings,voltage_min,voltage_mean,voltage_max,temperature_min,"
+                          "temperature_mean,temperature_max\n");
+        size_t groups = 0;
+        report.finish(busiest ? DeviceDayReport::Order::Busiest : DeviceDayReport::Order::Device, [&](const DeviceDayRow& r) {
+            const DeviceDayStats& s = *r.stats;
+            auto stat = [](float v, const ColumnStats& c) { return c.count ? format_number(v) : std::string(); };
+            const std::string line = csv_escape(std::string(r.deviceId)) + ',' + std::string(r.day) + ',' +
+                                     csv_escape(std::string(r.severity)) + ',' + std::to_string(s.readings) + ',' +
+                                     stat(s.voltage.min, s.voltage) + ',' + stat(float(s.voltage.mean()), s.voltage) + ',' +
+                                     stat(s.voltage.max, s.voltage) + ',' + stat(s.temperature.min, s.temperature) + ',' +
+                                     stat(float(s.temperature.mean()), s.temperature) + ',' +
+                                     stat(s.temperature.max, s.temperature) + '\n';
+            if (std::fwrite(line.data(), 1, line.size(), out) != line.size())
+                throw std::runtime_error(std::string("unable to write ") + argv[2]);
+            ++groups;
+        });
+        if (std::fclose(out) != 0) throw std::runtime_error(std::string("unable to write ") + argv[2]);
+
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%zu readings, %zu groups in %.2fs; budget %zu MiB, %llu spills, %.1f MiB spilled\n", readings, groups,
+                    secs, budgetMiB, static_cast<unsigned long long>(stats.runs), double(stats.spilledBytes) / (1 << 20));
+    }
+    catch (const std::exception& ex) {
+        std::fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Bulk import of a devices.csv export: arena-backed batches against the
+// DeviceRecord path, with heap allocations counted per phase
+#include "bulk_import.h"
+#include "record_sink.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t n)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Sink that formats rows like CsvRecordSink but keeps nothing, so the
+// numbers show the import path rather than the disk
+class NullCsvSink : public RecordSink {
+public:
+    void append(const std::vector<DeviceRecord>& batch) override {
+        m_buffer.clear();
+        for (const auto& rec : batch)
+        {
+            m_buffer += to_csv_row(rec);
+            m_buffer += '\n';
+        }
+        m_bytes += m_buffer.size();
+    }
+
+    void append(const RecordArenaBatch& batch) override {
+        m_buffer.clear();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            append_csv_row(m_buffer, batch[i]);
+            m_buffer += '\n';
+        }
+        m_bytes += m_buffer.size();
+    }
+
+    void sync() override {}
+
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    std::string m_buffer;
+    uint64_t m_bytes = 0;
+};
+
+static void write_sample(const std::string& path, size_t rows)
+{
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) throw std::runtime_error("unable to create " + path);
+    std::fprintf(f, "%s\n", kDeviceCsvHeader);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        std::fprintf(f,
+                     "%08zx-0000-4000-8000-%012zx,2026-03-%02zu %02zu:%02zu:%02zu,op%zu,inst-1,1.4.2,DEV-%05zu,"
+                     "Inverter %zu,%s,poll,%.2f,%.1f,%s,%zu,\"site visit, panel %zu cleaned\",,load=%.1f;phase=%zu\n",
+                     i, i, 1 + i % 28, i % 24, i % 60, (i * 7) % 60, i % 9, i % 5000, i % 5000,
+                     i % 3 ? "OK" : "WARN", 220.0 + double(i % 200) / 10, 35.0 + double(i % 30), i % 7 ? "Low" : "High",
+                     i % 400, i % 12, double(i % 100), i % 3);
+    }
+    std::fclose(f);
+}
+
+int main(int argc, char** argv)
+{
+    const size_t rows = argc > 1 ? std::stoul(argv[1]) : 500000;
+    const size_t batchRows = argc > 2 ? std::stoul(argv[2]) : 4096;
+    const std::string path = (std::filesystem::temp_directory_path() / "mgm_import_bench.csv").string();
+    write_sample(path, rows);
+
+    std::printf("rows=%zu batch=%zu\n", rows, batchRows);
+    std::printf("%-14s %10s %14s %14s %12s\n", "path", "ms", "allocs", "allocs/row", "bytes out");
+
+    {
+        NullCsvSink sink;
+        std::vector<DeviceRecord> batch;
+        const uint64_t before = g_allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        for_each_device_record(path, [&](DeviceRecord&& rec) {
+            batch.push_back(std::move(rec));
+            if (batch.size() >= batchRows)
+            {
+                sink.append(batch);
+                batch.clear();
+            }
+        });
+        sink.append(batch);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t n = g_allocations.load() - before;
+        std::printf("%-14s %10.1f %14llu %14.2f %12llu\n", "DeviceRecord", ms, static_cast<unsigned long long>(n),
+                    double(n) / double(rows), static_cast<unsigned long long>(sink.bytes()));
+    }
+
+    {
+        NullCsvSink sink;
+        ArenaPool pool;
+        const uint64_t before = g_allocations.load();
+        uint64_t warm = 0;
+        size_t batches = 0;
+        // Count what the second half of the file costs, once the pool is warm
+        class CountingSink : public RecordSink {
+        public:
+            CountingSink(NullCsvSink& inner, size_t& batches, uint64_t& warm, size_t warmAfter)
+                : m_inner(inner), m_batches(batches), m_warm(warm), m_warmAfter(warmAfter) {}
+            void append(const std::vector<DeviceRecord>& batch) override { m_inner.append(batch); }
+            void append(const RecordArenaBatch& batch) override {
+                m_inner.append(batch);
+                if (++m_batches == m_warmAfter) m_warm = g_allocations.load();
+            }
+            void sync() override {}
+
+        private:
+            NullCsvSink& m_inner;
+            size_t& m_batches;
+            uint64_t& m_warm;
+            size_t m_warmAfter;
+        } counting(sink, batches, warm, std::max<size_t>(1, rows / batchRows / 2));
+
+        const auto start = std::chrono::steady_clock::now();
+        const ImportResult r = import_csv(path, counting, pool, batchRows);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t n = g_allocations.load() - before;
+        const uint64_t steady = g_allocations.load() - warm;
+        std::printf("%-14s %10.1f %14llu %14.2f %12llu\n", "arena batch", ms, static_cast<unsigned long long>(n),
+                    double(n) / double(rows), static_cast<unsigned long long>(sink.bytes()));
+        const ArenaPool::Stats s = pool.stats();
+        std::printf("imported=%zu rejected=%zu batches=%zu, second half allocations=%llu, arenas created=%llu reused=%llu\n",
+                    r.rows, r.rejected, r.batches, static_cast<unsigned long long>(steady),
+                    static_cast<unsigned long long>(s.created), static_cast<unsigned long long>(s.reused));
+    }
+
+    std::filesystem::remove(path);
+    return 0;
+}
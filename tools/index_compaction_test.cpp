@@ -0,0 +1,110 @@
+// Regression test: device queries through the segment index after
+// compact_segment rewrote the segment to a larger size. Exits non-zero on
+// a wrong row.
+#include "storage_backend.h"
+
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static int g_failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (ok) return;
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    ++g_failures;
+}
+
+static std::string uuid_of(size_t i)
+{
+    char buf[40];
+    std::snprintf(buf, sizeof(buf), "%08zx-0000-4000-8000-000000000000", i);
+    return buf;
+}
+
+// Every row of device A, in order, with its expected notes
+static void expect_device_a(RecordStore& store, size_t rows, const std::string& amendedNotes, const std::string& label)
+{
+    std::vector<DeviceRecord> found;
+    store.scan("A", INT64_MIN, INT64_MAX, [&](DeviceRecord&& rec) { found.push_back(std::move(rec)); });
+    check(found.size() == rows / 2, label + ": " + std::to_string(found.size()) + " rows for device A");
+    for (size_t k = 0; k < found.size(); ++k)
+    {
+        const DeviceRecord& rec = found[k];
+        const std::string notes = k == 0 ? amendedNotes : "n" + std::to_string(2 * k);
+        check(rec.deviceId == "A", label + ": row " + std::to_string(k) + " is device '" + rec.deviceId + "'");
+        check(rec.uuid == uuid_of(2 * k), label + ": row " + std::to_string(k) + " has uuid " + rec.uuid);
+        check(rec.notes == notes, label + ": row " + std::to_string(k) + " has notes '" + rec.notes + "'");
+    }
+}
+
+int main()
+{
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "mgm_index_compaction_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const std::string path = (dir / "devices.csv").string();
+    const size_t rows = 200;
+
+    try {
+        {
+            CsvRecordSink sink(path);
+            std::vector<DeviceRecord> batch;
+            for (size_t i = 0; i < rows; ++i)
+            {
+                DeviceRecord rec;
+                rec.uuid = uuid_of(i);
+                char created[32];
+                std::snprintf(created, sizeof(created), "2026-03-01 %02zu:%02zu:00", i / 60, i % 60);
+                rec.createdAt = created;
+                rec.deviceId = i % 2 ? "B" : "A";
+                rec.status = "OK";
+                rec.voltage = 230;
+                rec.notes = "n" + std::to_string(i);
+                batch.push_back(std::move(rec));
+            }
+            sink.append(batch);
+            sink.sync();
+        }
+
+        const std::string amendedNotes(200, 'x');
+        {
+            CsvRecordStore open(path);
+            expect_device_a(open, rows, "n0", "before compaction");
+
+            // Lengthens the first row, so every later offset moves and the
+            // compacted segment is larger than the indexed watermark
+            {
+                AmendmentLog log(path);
+                Amendment a;
+                a.targetUuid = uuid_of(0);
+                a.createdAt = "2026-03-02 00:00:00";
+                a.operatorId = "test";
+                a.changes = {{"notes", amendedNotes}};
+                a.reason = "regression test";
+                log.append(a);
+            }
+            const uintmax_t before = fs::file_size(path);
+            check(compact_segment(path), "compact_segment folded the correction");
+            check(fs::file_size(path) > before, "compacted segment grew");
+
+            expect_device_a(open, rows, amendedNotes, "index open across compaction");
+        }
+        CsvRecordStore reopened(path);
+        expect_device_a(reopened, rows, amendedNotes, "index reopened after compaction");
+    }
+    catch (const std::exception& ex) {
+        std::fprintf(stderr, "FAIL: %s\n", ex.what());
+        ++g_failures;
+    }
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    if (g_failures) return 1;
+    std::printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Throughput of the aggregation kernels at each SIMD level this CPU supports
+#include "aggregate_kernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+static double measure_gbps(size_t bytes, int reps, const std::function<void()>& fn)
+{
+    fn(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i) fn();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return double(bytes) * reps / secs / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    size_t rows = argc > 1 ? std::stoul(argv[1]) : (size_t(1) << 24);
+    const int reps = 10;
+
+    std::mt19937 gen(42);
+    std::normal_distribution<float> voltage(230.0f, 8.0f);
+    std::bernoulli_distribution present(0.97);
+    std::uniform_int_distribution<uint32_t> device(0, 999);
+
+    std::vector<float> values(rows);
+    std::vector<uint64_t> validity((rows + 63) / 64, 0);
+    std::vector<uint32_t> codes(rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        values[i] = voltage(gen);
+        if (present(gen)) validity[i / 64] |= uint64_t(1) << (i % 64);
+        codes[i] = device(gen);
+    }
+
+    FloatColumnView dense{values.data(), nullptr, rows};
+    FloatColumnView nullable{values.data(), validity.data(), rows};
+    const size_t bytes = rows * sizeof(float);
+
+    std::printf("rows=%zu detected=%s\n", rows, simd_level_name(detect_simd_level()));
+    std::vector<SimdLevel> levels{SimdLevel::Scalar};
+    if (detect_simd_level() >= SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+    if (detect_simd_level() >= SimdLevel::Avx512) levels.push_back(SimdLevel::Avx512);
+
+    volatile double sink = 0;
+    for (SimdLevel level : levels)
+    {
+        double statsDense = measure_gbps(bytes, reps, [&] { sink = sink + column_stats(dense, level).sum; });
+        double statsNull = measure_gbps(bytes, reps, [&] { sink = sink + column_stats(nullable, level).sum; });
+        double above = measure_gbps(bytes, reps, [&] { sink = sink + double(count_above(nullable, 245.0f, level)); });
+        std::vector<uint64_t> bins(64);
+        double hist = measure_gbps(bytes, reps, [&] { column_histogram(nullable, 180.0f, 280.0f, bins.data(), bins.size(), level); });
+        std::printf("%-7s stats(dense) %6.2f GB/s  stats(nullable) %6.2f GB/s  count_above %6.2f GB/s  histogram %6.2f GB/s\n",
+                    simd_level_name(level), statsDense, statsNull, above, hist);
+    }
+
+    std::vector<ColumnStats> groups(1000);
+    double grouped = measure_gbps(bytes + rows * sizeof(uint32_t), reps, [&] {
+        grouped_column_stats(nullable, codes.data(), groups.data(), groups.size()); });
+    std::printf("grouped_stats (1000 groups) %6.2f GB/s\n", grouped);
+
+    ColumnStats s = column_stats(nullable);
+    std::printf("check: count=%llu mean=%.3f var=%.3f min=%.2f max=%.2f\n",
+                (unsigned long long)s.count, s.mean(), s.variance(), s.min, s.max);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Ingest and query throughput of each storage backend on the same readings
+#include "storage_backend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string format_epoch(int64_t t)
+{
+    const time_t tt = static_cast<time_t>(t);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::gmtime(&tt));
+    return buf;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t records = argc > 1 ? std::stoul(argv[1]) : 200000;
+    const size_t devices = 500;
+    const size_t batchSize = 256;     // one group commit
+    const size_t queries = 2000;
+    const int64_t start = 1700000000;
+    const std::string root = (std::filesystem::temp_directory_path() / "storage_bench").string();
+
+    // One reading per device every `devices` seconds
+    std::mt19937 gen(11);
+    std::normal_distribution<double> volts(230.0, 4.0);
+    std::vector<DeviceRecord> readings(records);
+    for (size_t i = 0; i < records; ++i)
+    {
+        DeviceRecord& r = readings[i];
+        r.uuid = "bench-" + std::to_string(i);
+        r.createdAt = format_epoch(start + int64_t(i));
+        r.operatorId = "op1";
+        r.deviceId = "dev-" + std::to_string(i % devices);
+        r.deviceName = "Feeder " + std::to_string(i % devices);
+        r.status = i % 97 == 0 ? "Degraded" : "Online";
+        r.actionType = "reading";
+        r.voltage = volts(gen);
+        r.temperature = 40.0 + double(i % 30);
+        r.severity = i % 97 == 0 ? "High" : "Low";
+        r.uiLatencyMs = int(i % 50);
+    }
+
+    std::vector<StorageBackend> backends{StorageBackend::Csv, StorageBackend::Lsm};
+    if (storage_backend_available(StorageBackend::Sqlite)) backends.push_back(StorageBackend::Sqlite);
+
+    std::printf("records=%zu devices=%zu batch=%zu\n", records, devices, batchSize);
+    for (StorageBackend backend : backends)
+    {
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+        const std::string devicesPath = (std::filesystem::path(root) / "devices.csv").string();
+        std::unique_ptr<RecordStore> store = open_record_store(backend, devicesPath);
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<DeviceRecord> batch;
+        for (size_t i = 0; i < records; i += batchSize)
+        {
+            batch.assign(readings.begin() + i, readings.begin() + std::min(records, i + batchSize));
+            store->sink().append(batch);
+            store->sink().sync();
+        }
+        const double ingestSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        // First query pays for index catch-up where the backend has one
+        size_t rows = 0;
+        store->scan("dev-0", start, start, [&](DeviceRecord&&) { ++rows; });
+
+        // One hour of one device: about 7 rows at 500 devices
+        std::uniform_int_distribution<size_t> pickDevice(0, devices - 1);
+        std::uniform_int_distribution<int64_t> pickTime(start, start + int64_t(records) - 3600);
+        rows = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < queries; ++q)
+        {
+            const int64_t from = pickTime(gen);
+            store->scan("dev-" + std::to_string(pickDevice(gen)), from, from + 3599, [&](DeviceRecord&&) { ++rows; });
+        }
+        const double querySecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        t0 = std::chrono::steady_clock::now();
+        size_t all = 0;
+        store->scan([&](DeviceRecord&&) { ++all; });
+        const double scanSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        std::printf("%-7s ingest %9.0f rec/s  range query %8.1f us (%.1f rows)  full scan %9.0f rec/s (%zu)\n",
+                    storage_backend_name(backend), double(records) / ingestSecs, 1e6 * querySecs / double(queries),
+                    double(rows) / double(queries), double(all) / scanSecs, all);
+    }
+    std::filesystem::remove_all(root);
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Regression test: WindowedAggregator fires windows once the watermark
+// passes them, re-emits late readings within the allowed lateness, purges
+// windows after it and drops anything later. Exits non-zero on a wrong
+// emission or count.
+#include "stream_windows.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int g_failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (ok) return;
+    std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+    ++g_failures;
+}
+
+static void tumbling()
+{
+    StringInterner keys;
+    std::vector<WindowResult> out;
+    WindowSpec spec;
+    spec.kind = WindowKind::Tumbling;
+    spec.size = 60;
+    spec.maxOutOfOrder = 10;
+    spec.allowedLateness = 30;
+    WindowedAggregator w(spec, [&](const WindowResult& r) { out.push_back(r); }, keys);
+    const uint32_t a = keys.intern("A");
+
+    w.add(a, 0, 230, 20, 0);
+    w.add(a, 30, 231, 21, 1);
+    w.add(a, 59, 229, 22, 0);
+    check(out.empty(), "tumbling: nothing fires before the watermark passes the window");
+
+    w.add(a, 70, 232, 23, 0); // watermark 60
+    check(w.watermark() == 60, "tumbling: watermark trails the newest event by maxOutOfOrder");
+    check(out.size() == 1, "tumbling: [0,60) fired at watermark 60");
+    if (out.size() == 1)
+    {
+        const WindowResult& r = out[0];
+        check(r.start == 0 && r.end == 60 && !r.lateUpdate, "tumbling: first emission is [0,60), not late");
+        check(r.agg.count == 3 && r.agg.voltageMin == 229 && r.agg.voltageMax == 231 && r.agg.worstSeverity == 1,
+              "tumbling: [0,60) totals");
+    }
+
+    w.add(a, 50, 240, 24, 2); // late, within the allowed lateness
+    check(out.size() == 2 && out.back().lateUpdate && out.back().start == 0 && out.back().agg.count == 4 &&
+              out.back().agg.voltageMax == 240,
+          "tumbling: late reading re-emits [0,60)");
+
+    w.add(a, 100, 233, 25, 0); // watermark 90 = end + allowedLateness
+    check(w.stats().openWindows == 1, "tumbling: [0,60) purged, [60,120) still open");
+
+    w.add(a, 55, 250, 26, 3); // later than the allowed lateness
+    WindowedAggregator::Stats s = w.stats();
+    check(s.droppedLate == 1, "tumbling: reading past the allowed lateness dropped");
+    check(out.size() == 2, "tumbling: dropped reading emits nothing");
+
+    w.flush();
+    s = w.stats();
+    check(out.size() == 3 && !out.back().lateUpdate && out.back().start == 60 && out.back().agg.count == 2,
+          "tumbling: flush fires [60,120)");
+    check(s.fired == 2 && s.lateUpdates == 1 && s.openWindows == 0, "tumbling: stats after flush");
+}
+
+static void sliding()
+{
+    StringInterner keys;
+    std::vector<WindowResult> out;
+    WindowSpec spec;
+    spec.kind = WindowKind::Sliding;
+    spec.size = 60;
+    spec.slide = 30;
+    spec.maxOutOfOrder = 0;
+    spec.allowedLateness = 0;
+    WindowedAggregator w(spec, [&](const WindowResult& r) { out.push_back(r); }, keys);
+
+    w.add(keys.intern("A"), 45, 230, 20, 0); // in [0,60) and [30,90)
+    w.flush();
+    check(out.size() == 2, "sliding: one reading lands in two windows");
+    check(w.stats().openWindows == 0, "sliding: flush purges every window");
+}
+
+static void session()
+{
+    StringInterner keys;
+    std::vector<WindowResult> out;
+    WindowSpec spec;
+    spec.kind = WindowKind::Session;
+    spec.gap = 100;
+    spec.maxOutOfOrder = 10;
+    spec.allowedLateness = 100;
+    WindowedAggregator w(spec, [&](const WindowResult& r) { out.push_back(r); }, keys);
+    const uint32_t a = keys.intern("A");
+    const uint32_t b = keys.intern("B");
+
+    w.add(a, 0, 230, 20, 0);
+    w.add(a, 50, 231, 21, 0);
+    w.add(b, 60, 232, 22, 0);
+    check(w.stats().openWindows == 2, "session: one session per device");
+
+    w.add(b, 200, 233, 23, 0); // watermark 190, before A's purge at 250
+    check(out.size() == 2, "session: both idle sessions fired");
+    bool sawA = false;
+    for (const auto& r : out)
+    {
+        if (r.key != a) continue;
+        sawA = true;
+        check(r.start == 0 && r.end == 150 && r.agg.count == 2 && !r.lateUpdate, "session: A is [0,150) with 2 readings");
+    }
+    check(sawA, "session: A fired");
+
+    w.add(a, 140, 234, 24, 0); // extends A's fired session, within lateness
+    check(out.size() == 3 && out.back().lateUpdate && out.back().key == a && out.back().end == 240 &&
+              out.back().agg.count == 3,
+          "session: late reading extends and re-emits A");
+
+    w.add(b, 1000, 235, 25, 0); // watermark 990, past every purge time
+    w.add(a, 100, 236, 26, 0);
+    check(w.stats().droppedLate == 1, "session: reading for a purged session dropped");
+    check(w.stats().openWindows == 1, "session: only B's new session is open");
+}
+
+static void observe()
+{
+    StringInterner keys;
+    size_t emitted = 0;
+    WindowSpec spec;
+    WindowedAggregator w(spec, [&](const WindowResult&) { ++emitted; }, keys);
+
+    DeviceRecord rec;
+    rec.deviceId = "A";
+    rec.createdAt = "not a time";
+    w.observe(rec);
+    check(w.stats().openWindows == 0, "observe: reading without created_at ignored");
+
+    rec.createdAt = "2026-03-01 00:00:00";
+    w.observe(rec);
+    w.flush();
+    check(emitted == 1, "observe: reading with created_at windowed");
+}
+
+int main()
+{
+    tumbling();
+    sliding();
+    session();
+    observe();
+    if (g_failures) return 1;
+    std::printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Harmonic analysis accuracy on a synthetic capture, then batch throughput
+#include "waveform.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    size_t captures = argc > 1 ? std::stoul(argv[1]) : 4000;
+    const uint32_t samples = 1280;     // 10 cycles at 50 Hz
+    const float rate = 6400.0f;
+    const double pi = 3.14159265358979323846;
+    const std::string heapPath = (std::filesystem::temp_directory_path() / "waveform_bench.bin").string();
+    std::filesystem::remove(heapPath);
+
+    // 230 V fundamental with 5% 3rd, 3% 5th and 1% 7th harmonic plus noise
+    std::mt19937 gen(7);
+    std::normal_distribution<float> noise(0.0f, 0.5f);
+    std::vector<WaveformRef> refs;
+    {
+        WaveformHeap heap(heapPath);
+        std::vector<float> wave(samples);
+        for (size_t c = 0; c < captures; ++c)
+        {
+            const double phase = 0.1 * double(c);
+            for (uint32_t i = 0; i < samples; ++i)
+            {
+                const double t = double(i) / rate;
+                const double w = 2 * pi * 50.0 * t + phase;
+                wave[i] = float(230.0 * std::sqrt(2.0) * (std::sin(w) + 0.05 * std::sin(3 * w) +
+                                                         0.03 * std::sin(5 * w) + 0.01 * std::sin(7 * w))) + noise(gen);
+            }
+            refs.push_back(heap.append(wave.data(), samples, rate));
+        }
+        heap.sync();
+    }
+
+    const double expectedThd = std::sqrt(0.05 * 0.05 + 0.03 * 0.03 + 0.01 * 0.01);
+    std::vector<SimdLevel> levels{SimdLevel::Scalar};
+    if (detect_simd_level() >= SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+    if (detect_simd_level() >= SimdLevel::Avx512) levels.push_back(SimdLevel::Avx512);
+
+    std::printf("captures=%zu samples=%u rate=%.0f Hz expected THD=%.4f\n", captures, samples, rate, expectedThd);
+    for (SimdLevel level : levels)
+    {
+        HarmonicConfig cfg;
+        cfg.simd = level;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<WaveformAnalysis> results = analyze_waveforms(heapPath, refs, cfg);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const WaveformAnalysis& a = results.front();
+        std::printf("%-7s %8.0f captures/s  rms=%.2f V1=%.2f V3=%.2f V5=%.2f THD=%.4f\n", simd_level_name(level),
+                    double(captures) / secs, a.rms, a.harmonics[0], a.harmonics[2], a.harmonics[4], a.thd);
+    }
+    std::filesystem::remove(heapPath);
+    return 0;
+}
@@ -0,0 +1,354 @@
+// MiniGridMonitor - per-device temperature trends and time-to-threshold forecasts
+#pragma once
+
+#include "device_record.h"
+#include "epoch.h"
+#include "executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class TrendMethod {
+    LeastSquares, // exponentially weighted linear regression
+    Holt          // Holt's linear (level + slope) smoothing
+};
+
+struct TrendConfig {
+    TrendMethod method = TrendMethod::LeastSquares;
+    double halfLifeHours = 24.0 * 7; // least squares forgetting, 0 = never forget
+    double alpha = 0.3;              // Holt level smoothing
+    double beta = 0.1;               // Holt slope smoothing
+};
+
+// O(1) state for one metric of one device. Times are hours since the
+// first reading so the regression sums stay well conditioned.
+class TrendState {
+public:
+    void add(int64_t ts, double y, const TrendConfig& cfg) {
+        if (std::isnan(y)) return;
+        if (m_n == 0) m_origin = ts;
+        const double t = hours(ts);
+        if (cfg.method == TrendMethod::Holt) addHolt(t, y, cfg);
+        else addLeastSquares(t, y, cfg);
+        ++m_n;
+    }
+
+    uint64_t count() const { return m_n; }
+
+    // Metric change per hour; NaN until two readings at distinct times
+    double slopePerHour() const {
+        double a, b;
+        return line(a, b) ? b : NAN;
+    }
+
+    double forecast(int64_t ts) const {
+        double a, b;
+        if (!line(a, b)) return NAN;
+        return a + b * hours(ts);
+    }
+
+    // Seconds from `now` until the trend line reaches `threshold`: 0 if it
+    // already has, +infinity if the trend is flat or falling.
+    double secondsToThreshold(double threshold, int64_t now) const {
+        double a, b;
+        if (!line(a, b)) return std::numeric_limits<double>::infinity();
+        const double tNow = hours(now);
+        if (a + b * tNow >= threshold) return 0.0;
+        if (b <= 1e-9) return std::numeric_limits<double>::infinity(); // flat within rounding
+        return ((threshold - a) / b - tNow) * 3600.0;
+    }
+
+private:
+    double hours(int64_t ts) const { return double(ts - m_origin) / 3600.0; }
+
+    void addLeastSquares(double t, double y, const TrendConfig& cfg) {
+        double w = 1.0;
+        if (cfg.halfLifeHours > 0 && m_n > 0)
+        {
+            const double k = std::log(2.0) / cfg.halfLifeHours;
+            if (t > m_lastT)
+            {
+                // Age the existing sums instead of weighting every point
+                const double decay = std::exp(-k * (t - m_lastT));
+                m_sw *= decay; m_st *= decay; m_sy *= decay; m_stt *= decay; m_sty *= decay;
+            }
+            else
+            {
+                w = std::exp(-k * (m_lastT - t)); // out-of-order reading
+            }
+        }
+        m_lastT = std::max(m_lastT, t);
+        m_sw += w;
+        m_st += w * t;
+        m_sy += w * y;
+        m_stt += w * t * t;
+        m_sty += w * t * y;
+    }
+
+    void addHolt(double t, double y, const TrendConfig& cfg) {
+        if (m_n == 0)
+        {
+            m_level = y;
+            m_slope = 0;
+            m_lastT = t;
+            return;
+        }
+        const double dt = t - m_lastT;
+        if (dt <= 0)
+        {
+            // Same or earlier timestamp: only nudge the level
+            m_level = cfg.alpha * y + (1 - cfg.alpha) * m_level;
+            return;
+        }
+        const double prevLevel = m_level;
+        m_level = cfg.alpha * y + (1 - cfg.alpha) * (m_level + m_slope * dt);
+        m_slope = cfg.beta * (m_level - prevLevel) / dt + (1 - cfg.beta) * m_slope;
+        m_lastT = t;
+        m_holtReady = true;
+    }
+
+    // Trend line y = a + b * t (t in hours since origin)
+    bool line(double& a, double& b) const {
+        if (m_holtReady)
+        {
+            b = m_slope;
+            a = m_level - m_slope * m_lastT;
+            return true;
+        }
+        const double det = m_sw * m_stt - m_st * m_st;
+        if (m_n < 2 || m_sw <= 0 || std::fabs(det) < 1e-12 * m_sw * m_sw) return false;
+        b = (m_sw * m_sty - m_st * m_sy) / det;
+        a = (m_sy - b * m_st) / m_sw;
+        return true;
+    }
+
+    uint64_t m_n = 0;
+    int64_t m_origin = 0;
+    double m_lastT = 0;
+    double m_sw = 0, m_st = 0, m_sy = 0, m_stt = 0, m_sty = 0;
+    double m_level = 0, m_slope = 0;
+    bool m_holtReady = false;
+};
+
+struct DeviceTrend {
+    TrendState temperature;
+    TrendState voltage;
+    int64_t lastSeen = 0;
+};
+
+// Per-device trend models, updated in O(1) from the commit listener.
+// rebuild() refits every device from history in parallel (e.g. after the
+// config changes) while live updates keep flowing.
+//
+// Readers never lock. They look the device up in an immutable index and
+// copy its current DeviceTrend through one atomic pointer, under an epoch
+// guard. Writers (serialized by m_mutex) publish an updated copy per
+// device per batch and retire the old one; the index itself is copied
+// only when a batch brings new devices.
+class TrendRegistry {
+public:
+    using Models = std::unordered_map<std::string, DeviceTrend>;
+
+    explicit TrendRegistry(TrendConfig cfg = TrendConfig())
+        : m_config(cfg), m_index(std::make_unique<Index>()) {}
+
+    void observe(const DeviceRecord& rec) { observe(&rec, 1); }
+
+    void observe(const std::vector<DeviceRecord>& batch) { observe(batch.data(), batch.size()); }
+
+    bool trend(const std::string& deviceId, DeviceTrend& out) const {
+        EpochDomain::Guard guard = m_index.domain().pin();
+        const Index* index = m_index.load(guard);
+        auto it = index->find(deviceId);
+        if (it == index->end()) return false;
+        out = *it->second->current.load(std::memory_order_acquire);
+        return true;
+    }
+
+    // Seconds until the device's temperature trend reaches `limit`
+    double secondsToTemperatureLimit(const std::string& deviceId, double limit, int64_t now) const {
+        DeviceTrend t;
+        if (!trend(deviceId, t)) return std::numeric_limits<double>::infinity();
+        return t.temperature.secondsToThreshold(limit, now);
+    }
+
+    // Calls fn once per stored reading, in any order
+    using HistoryScan = std::function<void(const std::function<void(DeviceRecord&&)>& fn)>;
+
+    // Refit every model with `cfg` from the readings `scanHistory` streams.
+    // Only time, temperature and voltage are kept per reading, never the
+    // records. Readings observed while the rebuild runs are replayed onto
+    // the new models unless the history already contained them (matched by
+    // uuid hash). Returns false, leaving the models as they were, when
+    // `token` is cancelled first.
+    bool rebuild(const HistoryScan& scanHistory, TrendConfig cfg, CancellationToken token = CancellationToken(),
+                 Executor& executor = shared_executor()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rebuilding = true;
+            m_pending.clear();
+        }
+        struct Cancelled {};
+        std::unordered_map<std::string, std::vector<Sample>> byDevice;
+        std::vector<size_t> seen; // uuid hashes of the history
+        try {
+            scanHistory([&](DeviceRecord&& rec) {
+                if (seen.size() % 4096 == 0 && token.isCancelled()) throw Cancelled();
+                seen.push_back(std::hash<std::string>()(rec.uuid));
+                int64_t ts;
+                if (parse_timestamp(rec.createdAt, ts))
+                    byDevice[rec.deviceId].push_back(Sample{ts, rec.temperature, rec.voltage});
+            });
+        }
+        catch (const Cancelled&) {
+            endRebuild();
+            return false;
+        }
+        catch (...) {
+            endRebuild();
+            throw;
+        }
+
+        // Fit devices in parallel, each over its readings in time order
+        std::vector<std::pair<const std::string*, std::vector<Sample>*>> devices;
+        devices.reserve(byDevice.size());
+        for (auto& kv : byDevice) devices.emplace_back(&kv.first, &kv.second);
+        std::vector<DeviceTrend> fitted(devices.size());
+        parallel_for(0, devices.size(), 16, [&](size_t lo, size_t hi) {
+            for (size_t d = lo; d < hi; ++d)
+            {
+                std::vector<Sample>& rows = *devices[d].second;
+                std::stable_sort(rows.begin(), rows.end(), [](const Sample& a, const Sample& b) { return a.ts < b.ts; });
+                for (const Sample& r : rows) apply(fitted[d], r.ts, r.temperature, r.voltage, cfg);
+                std::vector<Sample>().swap(rows);
+            }
+        }, token, executor);
+        if (token.isCancelled())
+        {
+            endRebuild();
+            return false;
+        }
+
+        auto fresh = std::make_shared<Models>();
+        fresh->reserve(devices.size());
+        for (size_t d = 0; d < devices.size(); ++d) fresh->emplace(*devices[d].first, std::move(fitted[d]));
+        std::sort(seen.begin(), seen.end());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& rec : m_pending)
+        {
+            int64_t ts;
+            const bool inHistory = std::binary_search(seen.begin(), seen.end(), std::hash<std::string>()(rec.uuid));
+            if (!inHistory && parse_timestamp(rec.createdAt, ts)) apply(*fresh, rec, ts, cfg);
+        }
+        auto index = std::make_unique<Index>();
+        index->reserve(fresh->size());
+        for (auto& kv : *fresh)
+        {
+            auto slot = std::make_shared<Slot>();
+            slot->current.store(new DeviceTrend(kv.second), std::memory_order_relaxed);
+            index->emplace(kv.first, std::move(slot));
+        }
+        m_index.publish(std::move(index));
+        m_config = cfg;
+        m_rebuilding = false;
+        m_pending.clear();
+        return true;
+    }
+
+    size_t deviceCount() const {
+        EpochDomain::Guard guard = m_index.domain().pin();
+        return m_index.load(guard)->size();
+    }
+
+private:
+    // One device's published model. Freed with the last index that
+    // refers to it, which is after every reader of that index is done.
+    struct Slot {
+        std::atomic<const DeviceTrend*> current{nullptr};
+        ~Slot() { delete current.load(std::memory_order_relaxed); }
+    };
+    using Index = std::unordered_map<std::string, std::shared_ptr<Slot>>;
+
+    // What a refit needs of one reading
+    struct Sample {
+        int64_t ts;
+        double temperature;
+        double voltage;
+    };
+
+    void endRebuild() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rebuilding = false;
+        m_pending.clear();
+    }
+
+    void observe(const DeviceRecord* batch, size_t n) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Index* index = m_index.current();
+        std::unique_ptr<Index> grown;
+        // Working copies, published once the batch is applied
+        std::unordered_map<Slot*, DeviceTrend*> updated;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const DeviceRecord& rec = batch[i];
+            int64_t ts;
+            if (!parse_timestamp(rec.createdAt, ts)) continue;
+            auto it = index->find(rec.deviceId);
+            if (it == index->end())
+            {
+                if (!grown)
+                {
+                    grown = std::make_unique<Index>(*index);
+                    index = grown.get();
+                }
+                it = grown->emplace(rec.deviceId, std::make_shared<Slot>()).first;
+            }
+            Slot* slot = it->second.get();
+            DeviceTrend*& t = updated[slot];
+            if (!t)
+            {
+                const DeviceTrend* prev = slot->current.load(std::memory_order_relaxed);
+                t = prev ? new DeviceTrend(*prev) : new DeviceTrend();
+            }
+            apply(*t, rec, ts, m_config);
+            if (m_rebuilding) m_pending.push_back(rec);
+        }
+        for (auto& u : updated)
+        {
+            const DeviceTrend* old = u.first->current.exchange(u.second, std::memory_order_release);
+            if (old) m_index.domain().retire(old);
+        }
+        if (grown) m_index.publish(std::move(grown));
+    }
+
+    static void apply(Models& models, const DeviceRecord& rec, int64_t ts, const TrendConfig& cfg) {
+        apply(models[rec.deviceId], rec, ts, cfg);
+    }
+
+    static void apply(DeviceTrend& t, const DeviceRecord& rec, int64_t ts, const TrendConfig& cfg) {
+        apply(t, ts, rec.temperature, rec.voltage, cfg);
+    }
+
+    static void apply(DeviceTrend& t, int64_t ts, double temperature, double voltage, const TrendConfig& cfg) {
+        t.temperature.add(ts, temperature, cfg);
+        t.voltage.add(ts, voltage, cfg);
+        t.lastSeen = std::max(t.lastSeen, ts);
+    }
+
+    mutable std::mutex m_mutex; // writers
+    TrendConfig m_config;
+    RcuPtr<Index> m_index;
+    bool m_rebuilding = false;
+    std::vector<DeviceRecord> m_pending;
+};
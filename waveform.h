@@ -0,0 +1,322 @@
+// MiniGridMonitor - waveform capture heap and FFT harmonic analysis
+//
+// Captures are float32 samples appended to a side file (waveforms.bin);
+// the reading only carries a WaveformRef. Analysis windows each capture
+// (Hann), runs a radix-2 FFT and reports RMS, per-harmonic RMS for the
+// first 50 harmonics and THD. Butterflies use AVX-512/AVX2 when available.
+#pragma once
+
+#include "aggregate_kernels.h"
+#include "device_record.h"
+#include "executor.h"
+#include "file_sync.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Append-only store of raw float32 samples (native byte order). append()
+// returns the reference to put in DeviceRecord::waveform; sync() before
+// the rows that reference the data are committed.
+class WaveformHeap {
+public:
+    explicit WaveformHeap(const std::string& path)
+        : m_path(path) {}
+
+    ~WaveformHeap() {
+        if (m_file) std::fclose(m_file);
+    }
+
+    WaveformHeap(const WaveformHeap&) = delete;
+    WaveformHeap& operator=(const WaveformHeap&) = delete;
+
+    WaveformRef append(const float* samples, uint32_t count, float sampleRate) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        open();
+        WaveformRef ref{m_size, count, sampleRate};
+        if (std::fwrite(samples, sizeof(float), count, m_file) != count)
+            throw std::runtime_error("unable to write file: " + m_path);
+        m_size += int64_t(count) * int64_t(sizeof(float));
+        return ref;
+    }
+
+    // Makes appended samples visible to readers of the file
+    void flush() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_file && std::fflush(m_file) != 0)
+            throw std::runtime_error("unable to flush file: " + m_path);
+    }
+
+    void sync() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_file) return;
+        sync_file(m_file, m_path);
+    }
+
+    const std::string& path() const { return m_path; }
+
+private:
+    void open() {
+        if (m_file) return;
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::path dir = fs::path(m_path).parent_path();
+        if (!dir.empty()) fs::create_directories(dir, ec);
+        m_file = std::fopen(m_path.c_str(), "ab");
+        if (!m_file)
+            throw std::runtime_error("unable to open file for append: " + m_path);
+        uintmax_t size = fs::file_size(m_path, ec);
+        m_size = ec ? 0 : static_cast<int64_t>(size);
+    }
+
+    std::string m_path;
+    std::mutex m_mutex;
+    std::FILE* m_file = nullptr;
+    int64_t m_size = 0;
+};
+
+inline bool read_waveform(std::istream& in, const WaveformRef& ref, std::vector<float>& out)
+{
+    if (ref.empty()) return false;
+    out.resize(ref.samples);
+    in.clear();
+    in.seekg(ref.offset);
+    in.read(reinterpret_cast<char*>(out.data()), std::streamsize(ref.samples) * sizeof(float));
+    return in.gcount() == std::streamsize(ref.samples) * std::streamsize(sizeof(float));
+}
+
+// Radix-2 decimation-in-time FFT on split real/imaginary arrays. Plans are
+// immutable and shared; get one with fft_plan(n).
+class FftPlan {
+public:
+    explicit FftPlan(size_t n)
+        : m_n(n), m_bitrev(n), m_twRe(n ? n - 1 : 0), m_twIm(n ? n - 1 : 0) {
+        if (n == 0 || (n & (n - 1)) != 0)
+            throw std::runtime_error("FFT size must be a power of two");
+        unsigned bits = 0;
+        while ((size_t(1) << bits) < n) ++bits;
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t r = 0;
+            for (unsigned b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+            m_bitrev[i] = static_cast<uint32_t>(r);
+        }
+        // Twiddles for the stage with half-length h start at index h - 1
+        const double pi = 3.14159265358979323846;
+        for (size_t h = 1; h < n; h <<= 1)
+        {
+            for (size_t j = 0; j < h; ++j)
+            {
+                m_twRe[h - 1 + j] = float(std::cos(pi * double(j) / double(h)));
+                m_twIm[h - 1 + j] = float(-std::sin(pi * double(j) / double(h)));
+            }
+        }
+    }
+
+    size_t size() const { return m_n; }
+
+    // In-place forward transform of n complex values
+    void forward(float* re, float* im, SimdLevel level = active_simd_level()) const {
+        for (size_t i = 0; i < m_n; ++i)
+        {
+            size_t r = m_bitrev[i];
+            if (r > i)
+            {
+                std::swap(re[i], re[r]);
+                std::swap(im[i], im[r]);
+            }
+        }
+        for (size_t h = 1; h < m_n; h <<= 1)
+        {
+            const float* wr = &m_twRe[h - 1];
+            const float* wi = &m_twIm[h - 1];
+#ifdef GRID_X86
+            if (level == SimdLevel::Avx512 && h >= 16) { stage_avx512(re, im, h, wr, wi); continue; }
+            if (level >= SimdLevel::Avx2 && h >= 8) { stage_avx2(re, im, h, wr, wi); continue; }
+#endif
+            stage_scalar(re, im, h, wr, wi);
+        }
+    }
+
+private:
+    void stage_scalar(float* re, float* im, size_t h, const float* wr, const float* wi) const {
+        for (size_t i = 0; i < m_n; i += 2 * h)
+        {
+            for (size_t j = 0; j < h; ++j)
+            {
+                const size_t a = i + j, b = a + h;
+                const float tr = re[b] * wr[j] - im[b] * wi[j];
+                const float ti = re[b] * wi[j] + im[b] * wr[j];
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+
+#ifdef GRID_X86
+    GRID_TARGET_AVX2 void stage_avx2(float* re, float* im, size_t h, const float* wr, const float* wi) const {
+        for (size_t i = 0; i < m_n; i += 2 * h)
+        {
+            for (size_t j = 0; j < h; j += 8)
+            {
+                const size_t a = i + j, b = a + h;
+                const __m256 vwr = _mm256_loadu_ps(wr + j), vwi = _mm256_loadu_ps(wi + j);
+                const __m256 br = _mm256_loadu_ps(re + b), bi = _mm256_loadu_ps(im + b);
+                const __m256 tr = _mm256_sub_ps(_mm256_mul_ps(br, vwr), _mm256_mul_ps(bi, vwi));
+                const __m256 ti = _mm256_add_ps(_mm256_mul_ps(br, vwi), _mm256_mul_ps(bi, vwr));
+                const __m256 ar = _mm256_loadu_ps(re + a), ai = _mm256_loadu_ps(im + a);
+                _mm256_storeu_ps(re + b, _mm256_sub_ps(ar, tr));
+                _mm256_storeu_ps(im + b, _mm256_sub_ps(ai, ti));
+                _mm256_storeu_ps(re + a, _mm256_add_ps(ar, tr));
+                _mm256_storeu_ps(im + a, _mm256_add_ps(ai, ti));
+            }
+        }
+    }
+
+    GRID_TARGET_AVX512 void stage_avx512(float* re, float* im, size_t h, const float* wr, const float* wi) const {
+        for (size_t i = 0; i < m_n; i += 2 * h)
+        {
+            for (size_t j = 0; j < h; j += 16)
+            {
+                const size_t a = i + j, b = a + h;
+                const __m512 vwr = _mm512_loadu_ps(wr + j), vwi = _mm512_loadu_ps(wi + j);
+                const __m512 br = _mm512_loadu_ps(re + b), bi = _mm512_loadu_ps(im + b);
+                const __m512 tr = _mm512_sub_ps(_mm512_mul_ps(br, vwr), _mm512_mul_ps(bi, vwi));
+                const __m512 ti = _mm512_add_ps(_mm512_mul_ps(br, vwi), _mm512_mul_ps(bi, vwr));
+                const __m512 ar = _mm512_loadu_ps(re + a), ai = _mm512_loadu_ps(im + a);
+                _mm512_storeu_ps(re + b, _mm512_sub_ps(ar, tr));
+                _mm512_storeu_ps(im + b, _mm512_sub_ps(ai, ti));
+                _mm512_storeu_ps(re + a, _mm512_add_ps(ar, tr));
+                _mm512_storeu_ps(im + a, _mm512_add_ps(ai, ti));
+            }
+        }
+    }
+#endif
+
+    size_t m_n;
+    std::vector<uint32_t> m_bitrev;
+    std::vector<float> m_twRe, m_twIm;
+};
+
+inline std::shared_ptr<const FftPlan> fft_plan(size_t n)
+{
+    static std::mutex mutex;
+    static std::map<size_t, std::shared_ptr<const FftPlan>> plans;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& plan = plans[n];
+    if (!plan) plan = std::make_shared<const FftPlan>(n);
+    return plan;
+}
+
+struct HarmonicConfig {
+    double fundamentalHz = 50.0;
+    SimdLevel simd = active_simd_level();
+};
+
+struct WaveformAnalysis {
+    static constexpr size_t kHarmonics = 50;
+
+    bool valid = false;
+    size_t samplesUsed = 0;  // largest power of two <= capture length
+    double rms = NAN;        // time domain, whole capture
+    double thd = NAN;        // sqrt(sum V2..V50^2) / V1
+    // RMS of harmonic h at harmonics[h - 1]; NaN above Nyquist
+    std::array<float, kHarmonics> harmonics;
+
+    WaveformAnalysis() { harmonics.fill(NAN); }
+};
+
+// Per-thread buffers so batch analysis does not allocate per capture
+struct FftScratch {
+    std::vector<float> re, im, window;
+    double windowEnergy = 0; // sum of w^2
+};
+
+inline WaveformAnalysis analyze_waveform(const float* samples, size_t count, float sampleRate,
+                                         const HarmonicConfig& cfg, FftScratch& scratch)
+{
+    WaveformAnalysis out;
+    if (count < 16 || !(sampleRate > 0)) return out;
+
+    double sumSq = 0;
+    for (size_t i = 0; i < count; ++i) sumSq += double(samples[i]) * samples[i];
+    out.rms = std::sqrt(sumSq / double(count));
+
+    size_t n = 1;
+    while (n * 2 <= count) n *= 2;
+    out.samplesUsed = n;
+    const std::shared_ptr<const FftPlan> plan = fft_plan(n);
+
+    if (scratch.window.size() != n)
+    {
+        const double pi = 3.14159265358979323846;
+        scratch.window.resize(n);
+        scratch.windowEnergy = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double w = 0.5 - 0.5 * std::cos(2 * pi * double(i) / double(n));
+            scratch.window[i] = float(w);
+            scratch.windowEnergy += w * w;
+        }
+    }
+    scratch.re.resize(n);
+    scratch.im.assign(n, 0.0f);
+    for (size_t i = 0; i < n; ++i) scratch.re[i] = samples[i] * scratch.window[i];
+    plan->forward(scratch.re.data(), scratch.im.data(), cfg.simd);
+
+    // Sum the energy of each harmonic's main lobe (Hann: +-2 bins) so
+    // captures that are not a whole number of cycles still measure right.
+    const double binsPerHarmonic = cfg.fundamentalHz * double(n) / sampleRate;
+    const int halfWidth = std::min(2, std::max(0, int((binsPerHarmonic - 1) / 2)));
+    const double scale = 2.0 / (double(n) * scratch.windowEnergy);
+    double distortion = 0;
+    for (size_t h = 1; h <= WaveformAnalysis::kHarmonics; ++h)
+    {
+        const long center = std::lround(double(h) * binsPerHarmonic);
+        if (center + halfWidth >= long(n / 2)) break;
+        double energy = 0;
+        for (long k = std::max(1L, center - halfWidth); k <= center + halfWidth; ++k)
+            energy += double(scratch.re[k]) * scratch.re[k] + double(scratch.im[k]) * scratch.im[k];
+        const double vh = std::sqrt(energy * scale);
+        out.harmonics[h - 1] = float(vh);
+        if (h > 1) distortion += vh * vh;
+    }
+    const double v1 = out.harmonics[0];
+    out.thd = v1 > 0 ? std::sqrt(distortion) / v1 : NAN;
+    out.valid = true;
+    return out;
+}
+
+// Analyzes every capture in `refs` from the heap file at `heapPath`,
+// spreading the work over the executor. Each worker reads through its own
+// stream and scratch buffers. out[i] is invalid when refs[i] is empty or
+// unreadable.
+inline std::vector<WaveformAnalysis> analyze_waveforms(const std::string& heapPath, const std::vector<WaveformRef>& refs,
+                                                       const HarmonicConfig& cfg = HarmonicConfig(),
+                                                       Executor& executor = shared_executor())
+{
+    std::vector<WaveformAnalysis> out(refs.size());
+    parallel_for(0, refs.size(), 64, [&](size_t lo, size_t hi) {
+        std::ifstream in(heapPath, std::ios::in | std::ios::binary);
+        FftScratch scratch;
+        std::vector<float> samples;
+        for (size_t i = lo; i < hi; ++i)
+        {
+            if (!in || !read_waveform(in, refs[i], samples)) continue;
+            out[i] = analyze_waveform(samples.data(), samples.size(), refs[i].sampleRate, cfg, scratch);
+        }
+    }, CancellationToken(), executor);
+    return out;
+}